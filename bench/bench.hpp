@@ -0,0 +1,70 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_BENCH_HPP
+#define ZMMK_IG_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define ZMMK_BENCH_RDTSC() __rdtsc()
+#elif defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define ZMMK_BENCH_RDTSC() __rdtsc()
+#else
+#define ZMMK_BENCH_RDTSC() 0ull
+#endif
+
+namespace bench
+{
+	struct measurement
+	{
+		double              seconds;
+		unsigned long long  cycles;   // Timestamp counter ticks (0 if unavailable) - reference cycles, not core clocks.
+	};
+
+	// Fastest of several runs of f.
+	template < typename F > measurement measure(F f)
+	{
+		measurement best = { 1e300, 0 };
+		for (int run = 0; run < 5; ++run)
+		{
+			const auto               start      = std::chrono::steady_clock::now();
+			const unsigned long long startTicks = ZMMK_BENCH_RDTSC();
+			f();
+			const unsigned long long ticks      = ZMMK_BENCH_RDTSC() - startTicks;
+			const double             seconds    = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (seconds < best.seconds) { best.seconds = seconds; best.cycles = ticks; }
+		}
+		return best;
+	}
+
+	// Prints a row of the human readable table, and appends a line to the machine readable results (see main.cpp.)
+	// values is however many "things" the case writes (strings, numbers, records...), bytes is the JSON output size.
+	void report(const char* suite, const char* name, const measurement& m, size_t values, size_t bytes);
+
+	// Registers a suite of cases to run, see BENCH_SUITE.
+	struct suite
+	{
+		suite(const char* name, void (*run)());
+	};
+}
+
+// BENCH_SUITE(strings) { ... bench::report("strings", ...); }
+#define BENCH_SUITE(name) static void bench_ ## name(); static ::bench::suite bench_ ## name ## _suite(#name, bench_ ## name); static void bench_ ## name()
+
+#endif /* ndef ZMMK_IG_BENCH_HPP */
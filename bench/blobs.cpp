@@ -0,0 +1,85 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Memory snippets in a crash report:  base64 encoded into a temporary string that's then escaped like any other, vs
+// mmk::json::base64 and mmk::json::hex encoding straight into the buffer.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <string>
+#include <vector>
+
+namespace
+{
+	std::string toBase64(const unsigned char* data, size_t size) // The usual byte at a time encoder
+	{
+		static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		std::string out;
+		out.reserve((size + 2) / 3 * 4);
+		size_t i = 0;
+		for (; i + 3 <= size; i += 3)
+		{
+			const unsigned group = (unsigned)data[i] << 16 | (unsigned)data[i+1] << 8 | data[i+2];
+			out += chars[group >> 18];
+			out += chars[(group >> 12) & 63];
+			out += chars[(group >>  6) & 63];
+			out += chars[group & 63];
+		}
+		if (i < size)
+		{
+			const unsigned group = (unsigned)data[i] << 16 | (i + 1 < size ? (unsigned)data[i+1] << 8 : 0);
+			out += chars[group >> 18];
+			out += chars[(group >> 12) & 63];
+			out += i + 1 < size ? chars[(group >> 6) & 63] : '=';
+			out += '=';
+		}
+		return out;
+	}
+
+	BENCH_SUITE(blobs)
+	{
+		const size_t snippets = 256, snippetSize = 4096;
+		std::vector<unsigned char> memory(snippets * snippetSize);
+		unsigned seed = 1;
+		for (size_t i = 0; i < memory.size(); ++i) { seed = seed * 1103515245u + 12345u; memory[i] = (unsigned char)(seed >> 16); }
+
+		std::vector<char> buffer(memory.size() * 3);
+		size_t bytes = 0;
+
+		const bench::measurement temporary = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t s = 0; s < snippets; ++s) w(toBase64(&memory[s * snippetSize], snippetSize));
+			bytes = w.size();
+		});
+		bench::report("blobs", "base64 string, then escaped", temporary, memory.size(), bytes);
+
+		const bench::measurement base64 = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t s = 0; s < snippets; ++s) w(mmk::json::base64(&memory[s * snippetSize], snippetSize));
+			bytes = w.size();
+		});
+		bench::report("blobs", "mmk::json::base64", base64, memory.size(), bytes);
+
+		const bench::measurement hex = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t s = 0; s < snippets; ++s) w(mmk::json::hex(&memory[s * snippetSize], snippetSize));
+			bytes = w.size();
+		});
+		bench::report("blobs", "mmk::json::hex", hex, memory.size(), bytes);
+	}
+}
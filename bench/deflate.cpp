@@ -0,0 +1,107 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// gzip end to end:  writing the whole document then compressing it, vs streaming it through a deflater.  Peak RSS is
+// measured by running each once more in a forked child, on top of what the child inherits.
+
+#include "bench.hpp"
+#ifdef ZMMK_HAVE_ZLIB // Defined by the Makefile when zlib is installed, and linked
+#include <mmk/json/deflate.hpp>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+	const int records = 500000;
+
+	template < typename ArrayWriter > void writeRecords(ArrayWriter& a)
+	{
+		for (int i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(a)
+		{
+			a(MMK_JSON_KEY("id"), i);
+			a(MMK_JSON_KEY("name"), "sensor \"north\"");
+			a(MMK_JSON_KEY("value"), i * 0.25);
+			a(MMK_JSON_KEY("ok"), (i & 1) == 0);
+		}
+	}
+
+	bool discard(void* context, const char*, size_t size) { *(size_t*)context += size; return true; }
+
+	size_t writeThenCompress()
+	{
+		std::vector<char> json;
+		MMK_JSON_WRITER_GROW_ARRAY(w, json, 0) writeRecords(w);
+
+		std::vector<Bytef> compressed(compressBound((uLong)w.size()) + 32); // + gzip's larger header and trailer
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+		stream.next_in   = (Bytef*)w.c_str();
+		stream.avail_in  = (uInt)w.size();
+		stream.next_out  = compressed.data();
+		stream.avail_out = (uInt)compressed.size();
+		deflate(&stream, Z_FINISH);
+		deflateEnd(&stream);
+
+		size_t out = 0;
+		discard(&out, 0, stream.total_out);
+		return out;
+	}
+
+	size_t streamThroughDeflater()
+	{
+		size_t out = 0;
+		mmk::json::deflater gz(mmk::json::sink(discard, &out));
+		MMK_JSON_WRITER_STREAM_ARRAY(w, 64 * 1024, mmk::json::deflateSink(gz)) writeRecords(w);
+		gz.finish();
+		return out;
+	}
+
+	long peakKiB(size_t (*f)()) // Peak RSS of a child running f once
+	{
+		fflush(stdout);
+		const pid_t child = fork();
+		if (child == 0) { f(); _exit(0); }
+
+		int status = 0;
+		rusage usage;
+		if (child < 0 || wait4(child, &status, 0, &usage) != child) return -1;
+		return usage.ru_maxrss;
+	}
+
+	BENCH_SUITE(deflate)
+	{
+		size_t bytes = 0, compressed = 0;
+		{
+			MMK_JSON_WRITER_MEASURE_ARRAY(m) writeRecords(m);
+			bytes = m.required();
+		}
+
+		const bench::measurement thenTime = bench::measure([&] { compressed = writeThenCompress(); });
+		bench::report("deflate", "write, then compress", thenTime, records, bytes);
+
+		const bench::measurement streamTime = bench::measure([&] { compressed = streamThroughDeflater(); });
+		bench::report("deflate", "stream through deflater", streamTime, records, bytes);
+
+		const long idle = peakKiB([]() -> size_t { return 0; });
+		printf("%-12s peak RSS over idle (%ld KiB):  write, then compress %+ld KiB, stream through deflater %+ld KiB, %zu -> %zu bytes\n",
+			"deflate", idle, peakKiB(writeThenCompress) - idle, peakKiB(streamThroughDeflater) - idle, bytes, compressed);
+	}
+}
+#endif
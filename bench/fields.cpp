@@ -0,0 +1,116 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// The same records written by hand with const char* keys, by hand with MMK_JSON_KEY, and through a field list.
+
+#include "bench.hpp"
+#include <mmk/json/fields.hpp>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct source  { int shard; int replica; };
+	struct request
+	{
+		unsigned            id;
+		std::string         route;
+		int                 status;
+		int                 latencyUs;
+		bool                cached;
+		source              from;
+		std::vector<int>    retries;
+	};
+
+	MMK_JSON_FIELDS_BEGIN(source)
+		MMK_JSON_FIELD(shard)
+		MMK_JSON_FIELD(replica)
+	MMK_JSON_FIELDS_END()
+
+	MMK_JSON_FIELDS_BEGIN(request)
+		MMK_JSON_FIELD(id)
+		MMK_JSON_FIELD(route)
+		MMK_JSON_FIELD(status)
+		MMK_JSON_FIELD(latencyUs)
+		MMK_JSON_FIELD(cached)
+		MMK_JSON_FIELD(from)
+		MMK_JSON_FIELD(retries)
+	MMK_JSON_FIELDS_END()
+
+	BENCH_SUITE(fields)
+	{
+		const size_t records = 50000;
+		std::vector<request> requests(records);
+		for (size_t i = 0; i < records; ++i)
+		{
+			request& r      = requests[i];
+			r.id            = (unsigned)i;
+			r.route         = i % 3 ? "/api/items" : "/api/users";
+			r.status        = i % 17 ? 200 : 404;
+			r.latencyUs     = (int)(i * 37 % 5000);
+			r.cached        = (i & 1) == 0;
+			r.from.shard    = (int)(i % 8);
+			r.from.replica  = (int)(i % 3);
+			r.retries.assign(i % 3, 250);
+		}
+
+		std::vector<char> buffer(records * 256);
+		size_t bytes = 0;
+
+		const bench::measurement byHand = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				const request& r = requests[i];
+				w("id",         r.id);
+				w("route",      r.route);
+				w("status",     r.status);
+				w("latencyUs",  r.latencyUs);
+				w("cached",     r.cached);
+				MMK_JSON_WRITER_OBJECT_OBJECT(w, "from") { w("shard", r.from.shard); w("replica", r.from.replica); }
+				w.array("retries", r.retries);
+			}
+			bytes = w.size();
+		});
+		bench::report("fields", "by hand, const char*", byHand, records, bytes);
+
+		const bench::measurement byHandKeys = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				const request& r = requests[i];
+				w(MMK_JSON_KEY("id"),         r.id);
+				w(MMK_JSON_KEY("route"),      r.route);
+				w(MMK_JSON_KEY("status"),     r.status);
+				w(MMK_JSON_KEY("latencyUs"),  r.latencyUs);
+				w(MMK_JSON_KEY("cached"),     r.cached);
+				MMK_JSON_WRITER_OBJECT_OBJECT(w, MMK_JSON_KEY("from")) { w(MMK_JSON_KEY("shard"), r.from.shard); w(MMK_JSON_KEY("replica"), r.from.replica); }
+				w.array(MMK_JSON_KEY("retries"), r.retries);
+			}
+			bytes = w.size();
+		});
+		bench::report("fields", "by hand, MMK_JSON_KEY", byHandKeys, records, bytes);
+
+		const bench::measurement generated = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) writeJsonElement(w, requests[i]);
+			bytes = w.size();
+		});
+		bench::report("fields", "MMK_JSON_FIELDS", generated, records, bytes);
+	}
+}
@@ -0,0 +1,82 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Float formatting vs the snprintf formats it replaced ("%f" is lossy, "%.9g"/"%.17g" round-trip but aren't shortest.)
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	template < typename Float > std::vector<Float> sensorSamples(size_t count)
+	{
+		// Mix of magnitudes and precisions: coordinates, small deltas, whole numbers
+		std::vector<Float> samples(count);
+		unsigned long long x = 0x2545F4914F6CDD1Dull;
+		for (size_t i = 0; i < count; ++i)
+		{
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			const double unit = (double)(x >> 11) / 9007199254740992.0;
+			switch (i % 4)
+			{
+			case 0:  samples[i] = (Float)(unit * 360.0 - 180.0);       break;
+			case 1:  samples[i] = (Float)(unit * 1e-6);                break;
+			case 2:  samples[i] = (Float)(int)(unit * 100000.0);       break;
+			default: samples[i] = (Float)(unit * 1e9);                 break;
+			}
+		}
+		return samples;
+	}
+
+	template < typename Float > void benchFloats(const char* type, const char* printfFormat, const char* roundTripFormat)
+	{
+		const size_t count = 200000;
+		const std::vector<Float> samples = sensorSamples<Float>(count);
+		std::vector<char> buffer(count * 32);
+		size_t bytes = 0;
+
+		const char* const formats[] = { printfFormat, roundTripFormat };
+		for (size_t f = 0; f < 2; ++f)
+		{
+			const bench::measurement m = bench::measure([&]
+			{
+				char* out = buffer.data();
+				for (size_t i = 0; i < count; ++i) out += snprintf(out, 32, formats[f], samples[i]);
+				bytes = out - buffer.data();
+			});
+			bench::report(type, formats[f], m, count, bytes);
+		}
+
+		const bench::measurement m = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) w.array(samples);
+			bytes = w.size();
+		});
+		bench::report(type, "arrayWriter", m, count, bytes);
+	}
+
+	BENCH_SUITE(float)
+	{
+		benchFloats<float>("float", "%f", "%.9g");
+	}
+
+	BENCH_SUITE(double)
+	{
+		benchFloats<double>("double", "%f", "%.17g");
+	}
+}
@@ -0,0 +1,140 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Workloads written only with the macros and documentWriter, so the same source can be compiled once per format:
+// formats_json.cpp, formats_cbor.cpp and formats_msgpack.cpp define (or don't define) MMK_JSON_WRITER_FORMAT_* first.
+// Compare the bytes column for size, ns/value for speed.
+
+#ifndef ZMMK_IG_BENCH_FORMATS_HPP
+#define ZMMK_IG_BENCH_FORMATS_HPP
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <vector>
+
+namespace
+{
+	const size_t formatRecords = 20000;
+
+	template < typename ArrayWriter > void writeLogRecords(ArrayWriter& w)
+	{
+		static const char* const levels[]   = { "trace", "debug", "info", "warn", "error" };
+		static const char* const messages[] =
+		{
+			"Connection accepted from 10.0.3.17:51234, handing off to worker pool",
+			"Cache miss for key \"user:8812:profile\", falling back to backing store",
+			"Request completed in 12ms: GET /api/v2/devices?page=3&limit=50 -> 200",
+			"Retrying upload of C:\\Users\\build\\AppData\\Local\\Temp\\crash-4412.dmp (attempt 2 of 5)",
+		};
+
+		for (size_t i = 0; i < formatRecords; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+		{
+			w("timestamp", "2017-06-14T21:07:33.412Z");
+			w("level",     levels[i % 5]);
+			w("logger",    "net.session.manager");
+			w("thread",    "worker-7");
+			w("message",   messages[i % 4]);
+			w("host",      "build-agent-03.example.internal");
+			w("version",   "1.4.2-rc1+g3f9a2c1");
+			MMK_JSON_WRITER_OBJECT_OBJECT(w, "context")
+			{
+				w("session", "5f2b9c4e-8d1a-4c7e-9b3f-2a6d8e1c0f47");
+				w("route",   "/api/v2/devices");
+			}
+		}
+	}
+
+	template < typename ArrayWriter > void writeMetricRecords(ArrayWriter& w)
+	{
+		for (size_t i = 0; i < formatRecords; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+		{
+			const long long n = (long long)i;
+			w(MMK_JSON_KEY("ts"),            1497474453000ll + n);
+			w(MMK_JSON_KEY("pid"),           4412);
+			w(MMK_JSON_KEY("cpuUser"),       (int)(n * 7 % 1000));
+			w(MMK_JSON_KEY("cpuSystem"),     (int)(n * 3 % 1000));
+			w(MMK_JSON_KEY("rss"),           104857600ll + n * 4096);
+			w(MMK_JSON_KEY("threads"),       (int)(8 + n % 24));
+			w(MMK_JSON_KEY("requests"),      n * 17);
+			w(MMK_JSON_KEY("errors"),        n % 5 == 0 ? -1 : (int)(n % 5));
+			w(MMK_JSON_KEY("bytesIn"),       n * 1460);
+			w(MMK_JSON_KEY("latencyP99Us"),  (int)(12000 + n % 9000));
+			w(MMK_JSON_KEY("load"),          (double)(n % 400) * 0.25);
+			w(MMK_JSON_KEY("healthy"),       n % 11 != 0);
+		}
+	}
+
+	void runFormat(const char* suite)
+	{
+		std::vector<char> buffer(formatRecords * 512);
+		size_t bytes = 0;
+
+		const bench::measurement log = bench::measure([&]
+		{
+			::mmk::json::documentWriter w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) writeLogRecords(w);
+			bytes = w.size();
+		});
+		bench::report(suite, "log records", log, formatRecords * 9, bytes);
+
+		const bench::measurement metrics = bench::measure([&]
+		{
+			::mmk::json::documentWriter w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) writeMetricRecords(w);
+			bytes = w.size();
+		});
+		bench::report(suite, "metrics records", metrics, formatRecords * 12, bytes);
+
+		const size_t points = 100000;
+		std::vector<double> track(points * 3);
+		for (size_t i = 0; i < points; ++i)
+		{
+			track[i*3+0] = 47.6062 + i * 1.3e-5;
+			track[i*3+1] = -122.3321 - i * 0.7e-5;
+			track[i*3+2] = 56.0 + (i % 1000) * 0.25;
+		}
+		std::vector<char> coordinates(points * 3 * 32);
+		const bench::measurement track3 = bench::measure([&]
+		{
+			::mmk::json::documentWriter w(coordinates);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < points; ++i) MMK_JSON_WRITER_ARRAY_ARRAY(w)
+			{
+				w(track[i*3+0]);
+				w(track[i*3+1]);
+				w(track[i*3+2]);
+			}
+			bytes = w.size();
+		});
+		bench::report(suite, "coordinate triplets", track3, points * 3, bytes);
+
+		const size_t documents = 200000;
+		const bench::measurement tiny = bench::measure([&]
+		{
+			bytes = 0;
+			for (size_t i = 0; i < documents; ++i)
+			{
+				MMK_JSON_WRITER_ROOT_OBJECT(doc, 64)
+				{
+					doc("id", (unsigned)i);
+					doc("ok", true);
+				}
+				bytes += doc.size();
+			}
+		});
+		bench::report(suite, "tiny documents", tiny, documents, bytes);
+	}
+}
+
+#endif /* ndef ZMMK_IG_BENCH_FORMATS_HPP */
@@ -0,0 +1,91 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Documents carrying large pre-serialized blobs: copied into the buffer and write()n vs gathered and writev()d.
+// Output goes to /dev/null, so this is the cost of getting bytes to the kernel, not of the device.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+	template < typename Writer > void writeDocument(Writer& w, int i, const mmk::json::raw& tail)
+	{
+		MMK_JSON_WRITER_ARRAY_OBJECT(w)
+		{
+			w("id",       i);
+			w("level",    "warning");
+			w("tail",     tail);
+			w("attached", tail);
+		}
+	}
+
+	void benchBlob(int devNull, const char* name, size_t blobBytes)
+	{
+		const std::string blob = "\"" + std::string(blobBytes - 2, 'x') + "\"";
+		const mmk::json::raw tail(blob);
+		const int documents = blobBytes >= 65536 ? 50 : 2000;
+		std::vector<char> buffer(2 * blobBytes + 256);
+		std::string label;
+
+		size_t documentBytes = 0;
+		{
+			mmk::json::writer w(buffer);
+			writeDocument(w, 0, tail);
+			documentBytes = w.size();
+		}
+
+		const bench::measurement copied = bench::measure([&]
+		{
+			for (int i = 0; i < documents; ++i)
+			{
+				mmk::json::writer w(buffer.data(), buffer.size(), mmk::json::fdSink(devNull));
+				writeDocument(w, i, tail);
+			}
+		});
+		label = std::string(name) + ", copied";
+		bench::report("gather", label.c_str(), copied, documents, documents * documentBytes);
+
+		const bench::measurement gathered = bench::measure([&]
+		{
+			for (int i = 0; i < documents; ++i)
+			{
+				mmk::json::segment segments[8];
+				mmk::json::gather g(segments);
+				char small[256];
+				mmk::json::writer w(small, g);
+				writeDocument(w, i, tail);
+				mmk::json::writeSegments(devNull, g);
+			}
+		});
+		label = std::string(name) + ", gathered";
+		bench::report("gather", label.c_str(), gathered, documents, documents * documentBytes);
+	}
+
+	BENCH_SUITE(gather)
+	{
+		const int devNull = open("/dev/null", O_WRONLY);
+		if (devNull < 0) return;
+		benchBlob(devNull, "1 KiB",   1024);
+		benchBlob(devNull, "16 KiB",  16 * 1024);
+		benchBlob(devNull, "256 KiB", 256 * 1024);
+		benchBlob(devNull, "4 MiB",   4 * 1024 * 1024);
+		close(devNull);
+	}
+}
@@ -0,0 +1,60 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Growable std::vector<char> writers vs a presized fixed buffer.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <vector>
+
+namespace
+{
+	template < typename ObjectWriter > void writeRecord(ObjectWriter& o, int i)
+	{
+		o("id", i);
+		o("name", "sensor");
+		o("value", i * 0.25);
+		o("ok", (i & 1) == 0);
+	}
+
+	BENCH_SUITE(growth)
+	{
+		const int records = 100000;
+		std::vector<char> fixed(records * 64);
+		size_t bytes = 0;
+
+		const bench::measurement fixedTime = bench::measure([&]
+		{
+			mmk::json::writer w(fixed);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (int i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w) writeRecord(w, i);
+			bytes = w.size();
+		});
+		bench::report("growth", "fixed buffer", fixedTime, records, bytes);
+
+		const bench::measurement growTime = bench::measure([&]
+		{
+			std::vector<char> buffer;
+			MMK_JSON_WRITER_GROW_ARRAY(w, buffer, 0) for (int i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w) writeRecord(w, i);
+		});
+		bench::report("growth", "growable, no hint", growTime, records, bytes);
+
+		const bench::measurement hintTime = bench::measure([&]
+		{
+			std::vector<char> buffer;
+			MMK_JSON_WRITER_GROW_ARRAY(w, buffer, bytes) for (int i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w) writeRecord(w, i);
+		});
+		bench::report("growth", "growable, exact hint", hintTime, records, bytes);
+	}
+}
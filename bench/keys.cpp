@@ -0,0 +1,66 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Escaping const char* keys at runtime vs MMK_JSON_KEY.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <vector>
+
+namespace
+{
+	BENCH_SUITE(keys)
+	{
+		const size_t records = 50000;
+		std::vector<char> buffer(records * 256);
+		size_t bytes = 0;
+
+		const bench::measurement escaped = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				w("id",          (unsigned)i);
+				w("session",     7);
+				w("requests",    12);
+				w("errors",      0);
+				w("queueDepth",  3);
+				w("latencyUs",   1234);
+				w("ok",          true);
+				MMK_JSON_WRITER_OBJECT_OBJECT(w, "source") w("shard", 2);
+			}
+			bytes = w.size();
+		});
+		bench::report("keys", "const char*", escaped, records * 9, bytes);
+
+		const bench::measurement preEscaped = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				w(MMK_JSON_KEY("id"),          (unsigned)i);
+				w(MMK_JSON_KEY("session"),     7);
+				w(MMK_JSON_KEY("requests"),    12);
+				w(MMK_JSON_KEY("errors"),      0);
+				w(MMK_JSON_KEY("queueDepth"),  3);
+				w(MMK_JSON_KEY("latencyUs"),   1234);
+				w(MMK_JSON_KEY("ok"),          true);
+				MMK_JSON_WRITER_OBJECT_OBJECT(w, MMK_JSON_KEY("source")) w(MMK_JSON_KEY("shard"), 2);
+			}
+			bytes = w.size();
+		});
+		bench::report("keys", "MMK_JSON_KEY", preEscaped, records * 9, bytes);
+	}
+}
@@ -0,0 +1,129 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// logRing producers contending for one ring (drained to /dev/null):  per thread throughput, and the p99 latency of a
+// whole MMK_JSON_LOG_OBJECT statement - claim, format, commit.  Compared against the alternative of per thread buffers
+// and a mutex around write().  The ring has a slot for every record, so none are dropped for being full and every one
+// measured was written - with one core, the drain thread can't otherwise keep up.  Each row says how many were dropped.
+
+#include "bench.hpp"
+#include <mmk/json/log.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const size_t records = 100000;
+
+	template < typename Writer > void writeRecord(Writer& log, unsigned t, size_t i)
+	{
+		log("level",  "info");
+		log("thread", t);
+		log("seq",    i);
+		log("msg",    "request completed");
+		log("us",     (unsigned)(i * 7 % 1000));
+	}
+
+	struct timings
+	{
+		std::vector<double>                 threadSeconds;
+		std::vector< std::vector<double> >  latencies;
+	};
+
+	void report(unsigned producers, const char* method, unsigned long long dropped, const timings& timed)
+	{
+		const std::vector<double>&                 threadSeconds = timed.threadSeconds;
+		const std::vector< std::vector<double> >&  latencies     = timed.latencies;
+
+		std::vector<double> all;
+		for (unsigned t = 0; t < producers; ++t) all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+		std::sort(all.begin(), all.end());
+
+		double seconds = 0;
+		for (unsigned t = 0; t < producers; ++t) seconds += threadSeconds[t] / producers;
+
+		const std::string label = std::to_string(producers) + (producers == 1 ? " producer, " : " producers, ") + method + " (" + std::to_string(dropped) + " dropped)";
+		const bench::measurement perThread = { seconds, 0 };
+		bench::report("logring", (label + ", per thread").c_str(), perThread, records, 0);
+		const bench::measurement p99 = { all[all.size() * 99 / 100], 0 };
+		bench::report("logring", (label + ", p99").c_str(), p99, 1, 0);
+	}
+
+	// Runs record(t, i) on each producer thread, timing every call.
+	template < typename Record > timings run(unsigned producers, Record record)
+	{
+		timings timed;
+		timed.latencies.assign(producers, std::vector<double>(records));
+		timed.threadSeconds.assign(producers, 0);
+		std::vector< std::vector<double> >& latencies     = timed.latencies;
+		std::vector<double>&                threadSeconds = timed.threadSeconds;
+
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < producers; ++t) threads.push_back(std::thread([&, t]
+		{
+			std::vector<double>& latency = latencies[t];
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < records; ++i)
+			{
+				const auto before = std::chrono::steady_clock::now();
+				record(t, i);
+				latency[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+			}
+			threadSeconds[t] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}));
+		for (size_t t = 0; t < threads.size(); ++t) threads[t].join();
+		return timed;
+	}
+
+	BENCH_SUITE(logring)
+	{
+		const int devNull = open("/dev/null", O_WRONLY);
+		if (devNull < 0) return;
+
+		for (unsigned producers = 1; producers <= 8; producers *= 2)
+		{
+			std::mutex lock;
+			report(producers, "mutex", 0, run(producers, [&](unsigned t, size_t i)
+			{
+				char buffer[256];
+				mmk::json::writer log(buffer);
+				MMK_JSON_WRITER_ARRAY_OBJECT(log) writeRecord(log, t, i);
+				buffer[log.size()] = '\n';
+				std::lock_guard<std::mutex> guard(lock);
+				if (::write(devNull, buffer, log.size() + 1) < 0) return;
+			}));
+
+			timings timed;
+			mmk::json::logRing::statistics stats;
+			{
+				mmk::json::logRing ring(devNull, producers * records, 256);
+				timed = run(producers, [&](unsigned t, size_t i)
+				{
+					MMK_JSON_LOG_OBJECT(log, ring) writeRecord(log, t, i);
+				});
+				stats = ring.stats();
+			}
+			report(producers, "logRing", stats.dropped + stats.oversized, timed);
+		}
+
+		close(devNull);
+	}
+}
@@ -0,0 +1,131 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Throughput benchmarks against the release library.
+//
+//     bench [--json results.json] [--baseline old.json] [suite...]
+//
+// "make bench" builds and runs every suite, leaving results next to the executable.  Results are one JSON object per
+// line, so runs can be diffed, grepped, or fed back in as a --baseline to print relative changes.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+	namespace
+	{
+		struct registeredSuite { const char* name; void (*run)(); };
+		struct baselineCase    { std::string suite, name; double nsPerValue; };
+
+		std::vector<registeredSuite>& suites() { static std::vector<registeredSuite> s; return s; }
+
+		FILE*                       results = 0;
+		std::vector<baselineCase>   baseline;
+
+		bool extract(const char* line, const char* field, std::string& value)
+		{
+			const char* start = strstr(line, field);
+			if (!start) return false;
+			start += strlen(field);
+			const char* stop = strchr(start, '\"');
+			if (!stop) return false;
+			value.assign(start, stop);
+			return true;
+		}
+
+		void loadBaseline(const char* path)
+		{
+			FILE* file = fopen(path, "r");
+			if (!file) { fprintf(stderr, "Couldn't open baseline %s\n", path); return; }
+
+			char line[1024];
+			while (fgets(line, sizeof(line), file))
+			{
+				baselineCase c;
+				const char* ns = strstr(line, "\"nsPerValue\":");
+				if (!ns || !extract(line, "\"suite\":\"", c.suite) || !extract(line, "\"case\":\"", c.name)) continue;
+				c.nsPerValue = atof(ns + strlen("\"nsPerValue\":"));
+				baseline.push_back(c);
+			}
+			fclose(file);
+		}
+
+		const baselineCase* findBaseline(const char* suite, const char* name)
+		{
+			for (size_t i = 0; i < baseline.size(); ++i) if (baseline[i].suite == suite && baseline[i].name == name) return &baseline[i];
+			return 0;
+		}
+	}
+
+	suite::suite(const char* name, void (*run)())
+	{
+		const registeredSuite s = { name, run };
+		suites().push_back(s);
+	}
+
+	void report(const char* suite, const char* name, const measurement& m, size_t values, size_t bytes)
+	{
+		const double mbPerSecond   = bytes / m.seconds / 1e6;
+		const double nsPerValue    = m.seconds * 1e9 / values;
+		const double cyclesPerByte = bytes ? (double)m.cycles / bytes : 0.0;
+
+		printf("%-12s %-32s %9.1f MB/s %9.2f ns/value %7.2f cycles/byte", suite, name, mbPerSecond, nsPerValue, cyclesPerByte);
+		if (const baselineCase* b = findBaseline(suite, name)) printf(" %+6.1f%%", (nsPerValue / b->nsPerValue - 1.0) * 100.0);
+		printf("\n");
+
+		if (!results) return;
+		char buffer[512];
+		mmk::json::writer w(buffer);
+		MMK_JSON_WRITER_ARRAY_OBJECT(w)
+		{
+			w("suite",          suite);
+			w("case",           name);
+			w("values",         values);
+			w("bytes",          bytes);
+			w("seconds",        m.seconds);
+			w("mbPerSecond",    mbPerSecond);
+			w("nsPerValue",     nsPerValue);
+			w("cyclesPerByte",  cyclesPerByte);
+		}
+		if (w) fprintf(results, "%s\n", w.c_str());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const char*> filters;
+	for (int i = 1; i < argc; ++i)
+	{
+		if      (!strcmp(argv[i], "--json")     && i+1 < argc) { if (!(bench::results = fopen(argv[++i], "w"))) { fprintf(stderr, "Couldn't open %s\n", argv[i]); return 1; } }
+		else if (!strcmp(argv[i], "--baseline") && i+1 < argc) bench::loadBaseline(argv[++i]);
+		else filters.push_back(argv[i]);
+	}
+
+	const std::vector<bench::registeredSuite>& suites = bench::suites();
+	for (size_t i = 0; i < suites.size(); ++i)
+	{
+		bool selected = filters.empty();
+		for (size_t f = 0; f < filters.size(); ++f) selected |= !strcmp(filters[f], suites[i].name);
+		if (selected) suites[i].run();
+	}
+
+	if (bench::results) fclose(bench::results);
+}
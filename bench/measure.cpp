@@ -0,0 +1,91 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Dry runs vs writing, and sizing a buffer from required() vs retrying with doubled buffers.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <vector>
+
+namespace
+{
+	const int records = 100000;
+
+	template < typename ArrayWriter > void writeRecords(ArrayWriter& a)
+	{
+		for (int i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(a)
+		{
+			a(MMK_JSON_KEY("id"), i);
+			a(MMK_JSON_KEY("name"), "sensor \"north\"");
+			a(MMK_JSON_KEY("value"), i * 0.25);
+			a(MMK_JSON_KEY("ok"), (i & 1) == 0);
+		}
+	}
+
+	BENCH_SUITE(measure)
+	{
+		std::vector<char> fixed(records * 96);
+		size_t bytes = 0;
+
+		const bench::measurement writeTime = bench::measure([&]
+		{
+			mmk::json::writer w(fixed);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) writeRecords(w);
+			bytes = w.size();
+		});
+		bench::report("measure", "write", writeTime, records, bytes);
+
+		const bench::measurement dryTime = bench::measure([&]
+		{
+			MMK_JSON_WRITER_MEASURE_ARRAY(m) writeRecords(m);
+			bytes = m.required();
+		});
+		bench::report("measure", "dry run", dryTime, records, bytes);
+
+		const bench::measurement retryTime = bench::measure([&]
+		{
+			for (std::vector<char> buffer(4096); ; buffer.resize(buffer.size() * 2))
+			{
+				mmk::json::writer w(buffer);
+				MMK_JSON_WRITER_ARRAY_ARRAY(w) writeRecords(w);
+				if (w) { bytes = w.size(); break; }
+			}
+		});
+		bench::report("measure", "retry, doubling from 4K", retryTime, records, bytes);
+
+		const bench::measurement requiredTime = bench::measure([&]
+		{
+			std::vector<char> small(4096);
+			mmk::json::writer first(small);
+			MMK_JSON_WRITER_ARRAY_ARRAY(first) writeRecords(first);
+
+			std::vector<char> buffer(first.required() + 1);
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) writeRecords(w);
+			bytes = w.size();
+		});
+		bench::report("measure", "retry, sized by required()", requiredTime, records, bytes);
+
+		const bench::measurement measuredTime = bench::measure([&]
+		{
+			MMK_JSON_WRITER_MEASURE_ARRAY(m) writeRecords(m);
+			std::vector<char> buffer(m.required() + 1);
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) writeRecords(w);
+			bytes = w.size();
+		});
+		bench::report("measure", "dry run, then write", measuredTime, records, bytes);
+	}
+}
@@ -0,0 +1,86 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// A big dump to a file in the working directory:  streamed through fwrite(), streamed through write(), and written
+// straight into a memory mapped file.  1 GB by default - set BENCH_MMAP_GB (up to 10 or so) for bigger ones.  Nothing is
+// fsync()ed, so once a dump outgrows the page cache's dirty limit, writeback sets the pace for all three.
+
+#include "bench.hpp"
+#include <mmk/json/mmap.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+	const char* const path = "bench-mmap.json";
+
+	template < typename ArrayWriter > void writeRecords(ArrayWriter& a, size_t records)
+	{
+		for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(a)
+		{
+			a(MMK_JSON_KEY("id"), i);
+			a(MMK_JSON_KEY("name"), "sensor \"north\"");
+			a(MMK_JSON_KEY("value"), i * 0.25);
+			a(MMK_JSON_KEY("ok"), (i & 1) == 0);
+		}
+	}
+
+	BENCH_SUITE(mmap)
+	{
+		const char* gb = getenv("BENCH_MMAP_GB");
+		const double target = (gb ? atof(gb) : 1.0) * 1e9;
+
+		size_t perThousand = 0;
+		{
+			MMK_JSON_WRITER_MEASURE_ARRAY(m) writeRecords(m, 1000);
+			perThousand = m.required();
+		}
+		const size_t records = (size_t)(target / perThousand * 1000);
+		size_t bytes = 0;
+		{
+			MMK_JSON_WRITER_MEASURE_ARRAY(m) writeRecords(m, records);
+			bytes = m.required();
+		}
+
+		const bench::measurement viaFile = bench::measure([&]
+		{
+			FILE* file = fopen(path, "wb");
+			MMK_JSON_WRITER_STREAM_ARRAY(w, 64 * 1024, mmk::json::fileSink(file)) writeRecords(w, records);
+			fclose(file);
+		});
+		bench::report("mmap", "FILE* (64 KiB buffer)", viaFile, records, bytes);
+
+		const bench::measurement viaFd = bench::measure([&]
+		{
+			const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			MMK_JSON_WRITER_STREAM_ARRAY(w, 1024 * 1024, mmk::json::fdSink(fd)) writeRecords(w, records);
+			close(fd);
+		});
+		bench::report("mmap", "write() (1 MiB buffer)", viaFd, records, bytes);
+
+		const bench::measurement viaMapping = bench::measure([&]
+		{
+			mmk::json::mappedFile file(path);
+			mmk::json::writer w(mmk::json::mappedStorage(file));
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) writeRecords(w, records);
+			file.close(w.size());
+		});
+		bench::report("mmap", "memory mapped", viaMapping, records, bytes);
+
+		remove(path);
+	}
+}
@@ -0,0 +1,75 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Numeric arrays written element by element vs array(...)'s bulk path, from 1K to 10M elements.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <string>
+#include <vector>
+
+namespace
+{
+	template < typename Value > std::vector<Value> samples(size_t count)
+	{
+		// Metrics-like magnitudes:  mostly small counters, some large ids
+		std::vector<Value> values(count);
+		unsigned long long x = 0x2545F4914F6CDD1Dull;
+		for (size_t i = 0; i < count; ++i)
+		{
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			const double unit = (double)(x >> 11) / 9007199254740992.0;
+			values[i] = (Value)(i % 4 == 0 ? unit * 4e9 - 2e9 : unit * 20000.0 - 10000.0);
+		}
+		return values;
+	}
+
+	template < typename Value > void benchNumbers(const char* type, size_t count)
+	{
+		const std::vector<Value> values = samples<Value>(count);
+		std::vector<char> buffer(count * 28 + 64);
+		size_t bytes = 0;
+		std::string label;
+
+		const bench::measurement serial = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < count; ++i) w(values[i]);
+			bytes = w.size();
+		});
+		label = std::string(type) + " x" + std::to_string(count) + ", per element";
+		bench::report("numbers", label.c_str(), serial, count, bytes);
+
+		const bench::measurement bulk = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) w.array(values);
+			bytes = w.size();
+		});
+		label = std::string(type) + " x" + std::to_string(count) + ", array(...)";
+		bench::report("numbers", label.c_str(), bulk, count, bytes);
+	}
+
+	BENCH_SUITE(numbers)
+	{
+		const size_t counts[] = { 1000, 100000, 10000000 };
+		for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i)
+		{
+			benchNumbers<int      >("int32",  counts[i]);
+			benchNumbers<long long>("int64",  counts[i]);
+			benchNumbers<double   >("double", counts[i]);
+		}
+	}
+}
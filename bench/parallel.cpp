@@ -0,0 +1,71 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Large arrays written by array(...) vs mmk::json::parallel on 1..N threads.
+
+#include "bench.hpp"
+#include <mmk/json/parallel.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	template < typename Value > void benchScaling(const char* type, const std::vector<Value>& values, size_t bytesPerValue)
+	{
+		std::vector<char> buffer(values.size() * bytesPerValue);
+		size_t bytes = 0;
+
+		const bench::measurement serial = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) w.array(values);
+			bytes = w.size();
+		});
+		bench::report("parallel", (std::string(type) + ", array(...)").c_str(), serial, values.size(), bytes);
+
+		const unsigned hardware = std::thread::hardware_concurrency();
+		const unsigned maxThreads = hardware > 4 ? hardware : 4;
+		for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+		{
+			mmk::json::parallel p(threads);
+			const bench::measurement m = bench::measure([&]
+			{
+				mmk::json::writer w(buffer);
+				MMK_JSON_WRITER_ARRAY_ARRAY(w) p.array(w, values);
+				bytes = w.size();
+			});
+			const std::string label = std::string(type) + ", " + std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+			bench::report("parallel", label.c_str(), m, values.size(), bytes);
+		}
+	}
+
+	BENCH_SUITE(parallel)
+	{
+		const size_t count = 2000000;
+		std::vector<double> doubles(count);
+		std::vector<int>    ints(count);
+		unsigned long long x = 0x2545F4914F6CDD1Dull;
+		for (size_t i = 0; i < count; ++i)
+		{
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			doubles[i] = (double)(x >> 11) / 9007199254740992.0 * 1000.0;
+			ints[i]    = (int)(x >> 40) - (1 << 23);
+		}
+
+		benchScaling("doubles", doubles, 32);
+		benchScaling("ints",    ints,    16);
+	}
+}
@@ -0,0 +1,157 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Many connections, each sent the same document 4 KB at a time, round robin - as an event loop would as sockets become
+// writable.  Either every connection's whole document is written up front and held until sent, or each connection
+// pulls its next 4 KB when it's its turn.  Peak RSS is measured like deflate.cpp does.
+
+#include "bench.hpp"
+#include <mmk/json/pull.hpp>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+	const size_t connections = 2000;
+	const size_t entries     = 200;
+	const size_t chunkSize   = 4096;
+
+	struct entry
+	{
+		unsigned    id;
+		std::string path;
+		int         status;
+		double      seconds;
+	};
+
+	MMK_JSON_FIELDS_BEGIN(entry)
+		MMK_JSON_FIELD(id)
+		MMK_JSON_FIELD(path)
+		MMK_JSON_FIELD(status)
+		MMK_JSON_FIELD(seconds)
+	MMK_JSON_FIELDS_END()
+
+	std::vector<entry> requests;
+
+	bool writeDocument(mmk::json::pullWriter& p, mmk::json::objectWriter& o, void*, size_t index)
+	{
+		switch (index)
+		{
+		case 0:  o(MMK_JSON_KEY("server"), "eu-1"); return true;
+		case 1:  p.array(o, MMK_JSON_KEY("entries"), requests); return true;
+		default: return false;
+		}
+	}
+
+	void send(size_t& sent, const char* data, size_t size) { sent += size + (unsigned char)data[size-1]; } // Stand-in for send(2)
+
+	size_t fullBuffers()
+	{
+		std::vector< std::vector<char> > documents(connections);
+		std::vector<size_t>              sizes(connections);
+		for (size_t c = 0; c < connections; ++c)
+		{
+			mmk::json::writer w(documents[c], mmk::json::growTag());
+			MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				w(MMK_JSON_KEY("server"), "eu-1");
+				MMK_JSON_WRITER_OBJECT_ARRAY(w, MMK_JSON_KEY("entries")) for (size_t i = 0; i < requests.size(); ++i) writeJsonElement(w, requests[i]);
+			}
+			sizes[c] = w.size();
+		}
+
+		size_t sent = 0;
+		for (size_t offset = 0, open = connections; open; offset += chunkSize)
+		{
+			open = 0;
+			for (size_t c = 0; c < connections; ++c)
+			{
+				if (offset >= sizes[c]) continue;
+				send(sent, &documents[c][offset], sizes[c] - offset < chunkSize ? sizes[c] - offset : chunkSize);
+				++open;
+			}
+		}
+		return sent;
+	}
+
+	size_t pulled()
+	{
+		std::vector< std::unique_ptr<mmk::json::pullWriter> > pulls(connections);
+		for (size_t c = 0; c < connections; ++c) pulls[c].reset(new mmk::json::pullWriter(writeDocument, 0));
+
+		char   chunk[chunkSize];
+		size_t sent = 0;
+		for (size_t open = connections; open; )
+		{
+			open = 0;
+			for (size_t c = 0; c < connections; ++c)
+			{
+				if (pulls[c]->done()) continue;
+				if (const size_t size = pulls[c]->pull(chunk, sizeof(chunk))) send(sent, chunk, size);
+				++open;
+			}
+		}
+		return sent;
+	}
+
+	long peakKiB(size_t (*f)()) // Peak RSS of a child running f once
+	{
+		fflush(stdout);
+		const pid_t child = fork();
+		if (child == 0) { f(); _exit(0); }
+
+		int status = 0;
+		rusage usage;
+		if (child < 0 || wait4(child, &status, 0, &usage) != child) return -1;
+		return usage.ru_maxrss;
+	}
+
+	BENCH_SUITE(pull)
+	{
+		requests.resize(entries);
+		for (size_t i = 0; i < entries; ++i)
+		{
+			requests[i].id      = (unsigned)i;
+			requests[i].path    = i % 3 ? "/api/v2/items/search?q=lamp&page=2" : "/api/v2/users/1138/preferences";
+			requests[i].status  = i % 11 ? 200 : 503;
+			requests[i].seconds = 0.001 * (double)(i % 97);
+		}
+
+		size_t bytes = 0;
+		{
+			MMK_JSON_WRITER_MEASURE_OBJECT(m)
+			{
+				m(MMK_JSON_KEY("server"), "eu-1");
+				MMK_JSON_WRITER_OBJECT_ARRAY(m, MMK_JSON_KEY("entries")) for (size_t i = 0; i < requests.size(); ++i) writeJsonElement(m, requests[i]);
+			}
+			bytes = m.required() * connections;
+		}
+
+		const bench::measurement fullTime = bench::measure([] { fullBuffers(); });
+		bench::report("pull", "full buffers, then send", fullTime, connections * entries, bytes);
+
+		const bench::measurement pullTime = bench::measure([] { pulled(); });
+		bench::report("pull", "pull 4 KB per send", pullTime, connections * entries, bytes);
+
+		const long idle = peakKiB([]() -> size_t { return 0; });
+		printf("%-12s peak RSS over idle (%ld KiB), %u connections:  full buffers %+ld KiB, pulled %+ld KiB, %zu bytes each\n",
+			"pull", idle, (unsigned)connections, peakKiB(fullBuffers) - idle, peakKiB(pulled) - idle, bytes / connections);
+	}
+}
@@ -0,0 +1,119 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// The same fixed shape records written by hand with const char* keys, by hand with MMK_JSON_KEY, and through a skeleton.
+
+#include "bench.hpp"
+#include <mmk/json/skeleton.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct request
+	{
+		unsigned    id;
+		std::string route;
+		int         status;
+		int         latencyUs;
+		bool        cached;
+		int         shard;
+		int         replica;
+	};
+
+	BENCH_SUITE(skeleton)
+	{
+		const size_t records = 50000;
+		std::vector<request> requests(records);
+		for (size_t i = 0; i < records; ++i)
+		{
+			request& r  = requests[i];
+			r.id        = (unsigned)i;
+			r.route     = i % 3 ? "/api/items" : "/api/users";
+			r.status    = i % 17 ? 200 : 404;
+			r.latencyUs = (int)(i * 37 % 5000);
+			r.cached    = (i & 1) == 0;
+			r.shard     = (int)(i % 8);
+			r.replica   = (int)(i % 3);
+		}
+
+		std::vector<char> buffer(records * 256);
+		size_t bytes = 0;
+
+		const bench::measurement byHand = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				const request& r = requests[i];
+				w("type",       "request");
+				w("id",         r.id);
+				w("route",      r.route);
+				w("status",     r.status);
+				w("latencyUs",  r.latencyUs);
+				w("cached",     r.cached);
+				MMK_JSON_WRITER_OBJECT_OBJECT(w, "from") { w("shard", r.shard); w("replica", r.replica); }
+			}
+			bytes = w.size();
+		});
+		bench::report("skeleton", "by hand, const char*", byHand, records, bytes);
+
+		const bench::measurement byHandKeys = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				const request& r = requests[i];
+				w(MMK_JSON_KEY("type"),       "request");
+				w(MMK_JSON_KEY("id"),         r.id);
+				w(MMK_JSON_KEY("route"),      r.route);
+				w(MMK_JSON_KEY("status"),     r.status);
+				w(MMK_JSON_KEY("latencyUs"),  r.latencyUs);
+				w(MMK_JSON_KEY("cached"),     r.cached);
+				MMK_JSON_WRITER_OBJECT_OBJECT(w, MMK_JSON_KEY("from")) { w(MMK_JSON_KEY("shard"), r.shard); w(MMK_JSON_KEY("replica"), r.replica); }
+			}
+			bytes = w.size();
+		});
+		bench::report("skeleton", "by hand, MMK_JSON_KEY", byHandKeys, records, bytes);
+
+		std::vector<char> rendered;
+		{
+			MMK_JSON_WRITER_GROW_OBJECT(shape, rendered, 0)
+			{
+				shape("type",       "request");
+				shape("id",         mmk::json::slot());
+				shape("route",      mmk::json::slot());
+				shape("status",     mmk::json::slot());
+				shape("latencyUs",  mmk::json::slot());
+				shape("cached",     mmk::json::slot());
+				MMK_JSON_WRITER_OBJECT_OBJECT(shape, "from") { shape("shard", mmk::json::slot()); shape("replica", mmk::json::slot()); }
+			}
+		}
+		const mmk::json::skeleton shape(&rendered[0], strlen(&rendered[0]));
+
+		const bench::measurement viaSkeleton = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_RECORD(w, shape)
+			{
+				const request& r = requests[i];
+				w(r.id); w(r.route); w(r.status); w(r.latencyUs); w(r.cached); w(r.shard); w(r.replica);
+			}
+			bytes = w.size();
+		});
+		bench::report("skeleton", "skeleton", viaSkeleton, records, bytes);
+	}
+}
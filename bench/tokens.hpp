@@ -0,0 +1,75 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Per token overhead:  the cheapest tokens there are, so scope bookkeeping dominates.  Included by tokens_checked.cpp,
+// tokens_unchecked.cpp and tokens_stats.cpp, which differ only in MMK_JSON_WRITER_UNCHECKED and MMK_JSON_WRITER_STATS.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <vector>
+
+#ifdef MMK_JSON_WRITER_STATS
+	#define BENCH_TOKENS_WRITER(name) mmk::json::writer name(buffer); mmk::json::writerStats name ## _stats(name)
+#else
+	#define BENCH_TOKENS_WRITER(name) mmk::json::writer name(buffer)
+#endif
+
+namespace
+{
+	void benchTokens(const char* suite)
+	{
+		const size_t tokens = 1000000;
+		std::vector<char> buffer(tokens * 16);
+		size_t bytes = 0;
+
+		const bench::measurement bools = bench::measure([&]
+		{
+			BENCH_TOKENS_WRITER(w);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < tokens; ++i) w(true);
+			bytes = w.size();
+		});
+		bench::report(suite, "array of bools", bools, tokens, bytes);
+
+		const bench::measurement digits = bench::measure([&]
+		{
+			BENCH_TOKENS_WRITER(w);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < tokens; ++i) w((int)(i % 10));
+			bytes = w.size();
+		});
+		bench::report(suite, "array of digits", digits, tokens, bytes);
+
+		const bench::measurement keyed = bench::measure([&]
+		{
+			BENCH_TOKENS_WRITER(w);
+			MMK_JSON_WRITER_ARRAY_OBJECT(w) for (size_t i = 0; i < tokens / 4; ++i)
+			{
+				w(MMK_JSON_KEY("a"), true);
+				w(MMK_JSON_KEY("b"), false);
+				w(MMK_JSON_KEY("c"), true);
+				w(MMK_JSON_KEY("d"), false);
+			}
+			bytes = w.size();
+		});
+		bench::report(suite, "MMK_JSON_KEY + bool", keyed, tokens, bytes);
+
+		const bench::measurement scopes = bench::measure([&]
+		{
+			BENCH_TOKENS_WRITER(w);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < tokens; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w) { (void)w; }
+			bytes = w.size();
+		});
+		bench::report(suite, "empty objects", scopes, tokens, bytes);
+	}
+}
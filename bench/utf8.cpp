@@ -0,0 +1,64 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Non-ASCII text escaped byte by byte (the const char* default) vs passed through with mmk::json::utf8.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <string>
+#include <vector>
+
+namespace
+{
+	std::string repeat(const char* text, size_t bytes)
+	{
+		std::string s;
+		while (s.size() < bytes) s += text;
+		return s;
+	}
+
+	void benchText(const char* name, const std::string& text)
+	{
+		const size_t strings = 2000;
+		std::vector<char> buffer(strings * (text.size() * 6 + 8));
+		size_t bytes = 0;
+		std::string label;
+
+		const bench::measurement escaped = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < strings; ++i) w(text.c_str());
+			bytes = w.size();
+		});
+		label = std::string(name) + ", escaped";
+		bench::report("utf8", label.c_str(), escaped, strings, bytes);
+
+		const bench::measurement passthrough = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < strings; ++i) w(mmk::json::utf8(text));
+			bytes = w.size();
+		});
+		label = std::string(name) + ", utf8";
+		bench::report("utf8", label.c_str(), passthrough, strings, bytes);
+	}
+
+	BENCH_SUITE(utf8)
+	{
+		benchText("ascii",  repeat("The quick brown fox jumps over the lazy dog. ", 1024));
+		benchText("latin",  repeat("Voix ambigu\xC3\xAB d'un c\xC5\x93ur qui, au z\xC3\xA9phyr, pr\xC3\xA9" "f\xC3\xA8re les jattes de kiwis. ", 1024));
+		benchText("cjk",    repeat("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\xE3\x81\xAE\xE3\x83\x86\xE3\x82\xAD\xE3\x82\xB9\xE3\x83\x88\xE3\x81\xA8\xE4\xB8\xAD\xE6\x96\x87\xE6\x96\x87\xE6\x9C\xAC\xE3\x80\x82", 1024));
+	}
+}
@@ -0,0 +1,79 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// wchar_t strings transcoded by the writer vs converted to a temporary narrow string first.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// What callers had to do before - a naive UTF-16/32 -> UTF-8 conversion into a temporary.
+	std::string toUtf8(const std::wstring& text)
+	{
+		std::string out;
+		for (size_t i = 0; i < text.size(); ++i)
+		{
+			unsigned long ch = (unsigned long)text[i];
+			if (sizeof(wchar_t) == 2 && ch >= 0xD800 && ch <= 0xDBFF && i+1 < text.size()) ch = 0x10000 + ((ch - 0xD800) << 10) + ((unsigned long)text[++i] - 0xDC00);
+			if      (ch < 0x80)    { out += (char)ch; }
+			else if (ch < 0x800)   { out += (char)(0xC0 | (ch >> 6));  out += (char)(0x80 | (ch & 0x3F)); }
+			else if (ch < 0x10000) { out += (char)(0xE0 | (ch >> 12)); out += (char)(0x80 | ((ch >> 6) & 0x3F));  out += (char)(0x80 | (ch & 0x3F)); }
+			else                   { out += (char)(0xF0 | (ch >> 18)); out += (char)(0x80 | ((ch >> 12) & 0x3F)); out += (char)(0x80 | ((ch >> 6) & 0x3F)); out += (char)(0x80 | (ch & 0x3F)); }
+		}
+		return out;
+	}
+
+	void benchText(const char* name, const std::wstring& text)
+	{
+		const size_t strings = 2000;
+		std::vector<char> buffer(strings * (text.size() * 12 + 8));
+		size_t bytes = 0;
+		std::string label;
+
+		const bench::measurement converted = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < strings; ++i) w(mmk::json::utf8(toUtf8(text)));
+			bytes = w.size();
+		});
+		label = std::string(name) + ", temporary";
+		bench::report("wide", label.c_str(), converted, strings, bytes);
+
+		const bench::measurement direct = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < strings; ++i) w(mmk::json::wide(text, mmk::json::wide::utf8Output));
+			bytes = w.size();
+		});
+		label = std::string(name) + ", direct";
+		bench::report("wide", label.c_str(), direct, strings, bytes);
+	}
+
+	std::wstring repeat(const wchar_t* text, size_t units)
+	{
+		std::wstring s;
+		while (s.size() < units) s += text;
+		return s;
+	}
+
+	BENCH_SUITE(wide)
+	{
+		benchText("ascii", repeat(L"C:\\Windows\\System32\\drivers\\etc\\hosts - The quick brown fox. ", 1024));
+		benchText("cjk",   repeat(L"\u65e5\u672c\u8a9e\u306e\u30c6\u30ad\u30b9\u30c8\u3068\u4e2d\u6587\u6587\u672c\u3002", 1024));
+	}
+}
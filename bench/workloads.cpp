@@ -0,0 +1,183 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// The canonical workloads - roughly the shapes of document this library gets used for.
+
+#include "bench.hpp"
+#include <mmk/json/writer.hpp>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	const size_t records = 20000;
+
+	// String heavy:  Structured log lines.  9 strings per record, with the occasional escape.
+	BENCH_SUITE(log)
+	{
+		static const char* const levels[]   = { "trace", "debug", "info", "warn", "error" };
+		static const char* const messages[] =
+		{
+			"Connection accepted from 10.0.3.17:51234, handing off to worker pool",
+			"Cache miss for key \"user:8812:profile\", falling back to backing store",
+			"Request completed in 12ms: GET /api/v2/devices?page=3&limit=50 -> 200",
+			"Retrying upload of C:\\Users\\build\\AppData\\Local\\Temp\\crash-4412.dmp (attempt 2 of 5)",
+		};
+
+		std::vector<char> buffer(records * 512);
+		size_t bytes = 0;
+		const bench::measurement m = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				w("timestamp", "2017-06-14T21:07:33.412Z");
+				w("level",     levels[i % 5]);
+				w("logger",    "net.session.manager");
+				w("thread",    "worker-7");
+				w("message",   messages[i % 4]);
+				w("host",      "build-agent-03.example.internal");
+				w("version",   "1.4.2-rc1+g3f9a2c1");
+				MMK_JSON_WRITER_OBJECT_OBJECT(w, "context")
+				{
+					w("session", "5f2b9c4e-8d1a-4c7e-9b3f-2a6d8e1c0f47");
+					w("route",   "/api/v2/devices");
+				}
+			}
+			bytes = w.size();
+		});
+		bench::report("log", "records", m, records * 9, bytes);
+	}
+
+	// Integer heavy:  Metrics snapshots, 24 counters of assorted magnitudes per record.
+	BENCH_SUITE(metrics)
+	{
+		std::vector<char> buffer(records * 512);
+		size_t bytes = 0;
+		const bench::measurement m = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < records; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(w)
+			{
+				const long long n = (long long)i;
+				w("ts",              1497474453000ll + n);
+				w("pid",             4412);
+				w("cpuUser",         (int)(n * 7 % 1000));
+				w("cpuSystem",       (int)(n * 3 % 1000));
+				w("rss",             104857600ll + n * 4096);
+				w("vsz",             2147483648ll + n * 65536);
+				w("threads",         (int)(8 + n % 24));
+				w("handles",         (int)(300 + n % 700));
+				w("gcCount",         (unsigned)(n / 3));
+				w("gcPauseUs",       (unsigned)(n * 13 % 50000));
+				w("requests",        n * 17);
+				w("errors",          n % 5 == 0 ? -1 : (int)(n % 5));
+				w("bytesIn",         n * 1460);
+				w("bytesOut",        n * 8192);
+				w("queueDepth",      (int)(n % 64));
+				w("latencyP50Us",    (int)(900 + n % 300));
+				w("latencyP99Us",    (int)(12000 + n % 9000));
+				w("cacheHits",       n * 31);
+				w("cacheMisses",     n * 2);
+				w("dbConnections",   (int)(n % 16));
+				w("openFiles",       (int)(64 + n % 128));
+				w("ctxSwitches",     n * 101);
+				w("pageFaults",      n % 7);
+				w("uptimeSeconds",   86400ll * 3 + n);
+			}
+			bytes = w.size();
+		});
+		bench::report("metrics", "records", m, records * 24, bytes);
+	}
+
+	// Float heavy:  GPS tracks, [lat, lon, altitude] triplets.
+	BENCH_SUITE(coordinates)
+	{
+		const size_t points = 100000;
+		std::vector<double> track(points * 3);
+		for (size_t i = 0; i < points; ++i)
+		{
+			track[i*3+0] = 47.6062 + i * 1.3e-5;
+			track[i*3+1] = -122.3321 - i * 0.7e-5;
+			track[i*3+2] = 56.0 + (i % 1000) * 0.25;
+		}
+
+		std::vector<char> buffer(points * 3 * 32);
+		size_t bytes = 0;
+		const bench::measurement m = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < points; ++i) MMK_JSON_WRITER_ARRAY_ARRAY(w)
+			{
+				w(track[i*3+0]);
+				w(track[i*3+1]);
+				w(track[i*3+2]);
+			}
+			bytes = w.size();
+		});
+		bench::report("coordinates", "triplets", m, points * 3, bytes);
+	}
+
+	// Structure heavy:  Alternating object/array nesting 64 deep, a leaf at the bottom, repeated.
+	template < typename ObjectWriter > void nestObject(ObjectWriter& o, int depth);
+	template < typename ArrayWriter  > void nestArray (ArrayWriter&  a, int depth);
+
+	template < typename ObjectWriter > void nestObject(ObjectWriter& o, int depth)
+	{
+		if (!depth) { o("leaf", depth); return; }
+		MMK_JSON_WRITER_OBJECT_ARRAY(o, "a") nestArray(o, depth-1);
+	}
+
+	template < typename ArrayWriter > void nestArray(ArrayWriter& a, int depth)
+	{
+		if (!depth) { a(depth); return; }
+		MMK_JSON_WRITER_ARRAY_OBJECT(a) nestObject(a, depth-1);
+	}
+
+	BENCH_SUITE(nesting)
+	{
+		const size_t trees = 2000, depth = 64;
+		std::vector<char> buffer(trees * depth * 8);
+		size_t bytes = 0;
+		const bench::measurement m = bench::measure([&]
+		{
+			mmk::json::writer w(buffer);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) for (size_t i = 0; i < trees; ++i) nestArray(w, (int)depth);
+			bytes = w.size();
+		});
+		bench::report("nesting", "scopes", m, trees * depth, bytes);
+	}
+
+	// Setup heavy:  Lots of separate little documents on the stack, the way one-off events get written.
+	BENCH_SUITE(tiny)
+	{
+		const size_t documents = 200000;
+		size_t bytes = 0;
+		const bench::measurement m = bench::measure([&]
+		{
+			bytes = 0;
+			for (size_t i = 0; i < documents; ++i)
+			{
+				MMK_JSON_WRITER_ROOT_OBJECT(doc, 64)
+				{
+					doc("id", (unsigned)i);
+					doc("ok", true);
+				}
+				bytes += doc.size();
+			}
+		});
+		bench::report("tiny", "documents", m, documents, bytes);
+	}
+}
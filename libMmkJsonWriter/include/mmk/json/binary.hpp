@@ -0,0 +1,710 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_BINARY_HPP
+#define ZMMK_IG_JSON_BINARY_HPP
+
+#include "writer.hpp"
+#include <float.h>
+#include <new>
+
+namespace mmk { namespace json {
+
+	// Binary encodings of the same documents - no number formatting, no escaping.  Header only.
+	//
+	// Define MMK_JSON_WRITER_FORMAT_CBOR or MMK_JSON_WRITER_FORMAT_MSGPACK (program wide, like MMK_JSON_WRITER_UNCHECKED)
+	// and objectWriter, arrayWriter, documentWriter and the ROOT/STREAM/GROW/MEASURE macros all switch to that format, so
+	// code written against them doesn't change.  Or use cborWriter/msgpackWriter and their scopes directly.
+	//
+	// Differences from JSON:  strings are copied through as UTF-8 without validation (wide strings are transcoded), NaN
+	// and infinities are kept, doubles that are exactly representable as floats are written as floats, base64 and hex
+	// values are written as byte strings (not encoded), MMK_JSON_KEY's escapes are decoded, and raw JSON, gathering, truncating, parallel.hpp and log.hpp
+	// aren't available.  Buffers need a spare byte, like JSON's '\0'.
+
+	// RFC 7049.  Containers use indefinite lengths (0x9f/0xbf ... 0xff), so they can stream through a sink.
+	struct cbor
+	{
+		static const bool   indefiniteLengths = true;
+		static const size_t openSize          = 1;
+		enum { nil = 0xf6, no = 0xf4, yes = 0xf5, float32 = 0xfa, float64 = 0xfb };
+
+		static size_t head(unsigned char* out, unsigned major, unsigned long long value) // Major type and smallest argument
+		{
+			const unsigned char m = (unsigned char)(major << 5);
+			if (value < 24)                  { out[0] = (unsigned char)(m | value); return 1; }
+			if (value <= 0xffu)              { out[0] = m | 24; out[1] = (unsigned char)value; return 2; }
+			if (value <= 0xffffu)            { out[0] = m | 25; bigEndian(out+1, value, 2); return 3; }
+			if (value <= 0xffffffffu)        { out[0] = m | 26; bigEndian(out+1, value, 4); return 5; }
+			out[0] = m | 27; bigEndian(out+1, value, 8); return 9;
+		}
+
+		static size_t positive (unsigned char* out, unsigned long long value)   { return head(out, 0, value); }
+		static size_t negative (unsigned char* out, unsigned long long minus1)  { return head(out, 1, minus1); } // -1-minus1
+		static size_t bytes    (unsigned char* out, size_t size)                { return head(out, 2, size); }
+		static size_t text     (unsigned char* out, size_t size)                { return head(out, 3, size); }
+		static size_t container(unsigned char* out, bool object, size_t count)  { return head(out, object ? 5 : 4, count); }
+		static void   open     (unsigned char* out, bool object)                { out[0] = object ? 0xbf : 0x9f; }
+		static size_t close    (unsigned char* out)                             { out[0] = 0xff; return 1; }
+
+		static void bigEndian(unsigned char* out, unsigned long long value, unsigned bytes) { while (bytes--) { out[bytes] = (unsigned char)value; value >>= 8; } }
+	};
+
+	// msgpack.org.  Lengths come first and aren't known until a container closes:  containers open with a 5 byte
+	// placeholder that's patched - and shrunk - when they close.  So streaming writers can only flush between documents.
+	struct msgpack
+	{
+		static const bool   indefiniteLengths = false;
+		static const size_t openSize          = 5;
+		enum { nil = 0xc0, no = 0xc2, yes = 0xc3, float32 = 0xca, float64 = 0xcb };
+
+		static size_t positive(unsigned char* out, unsigned long long value)
+		{
+			if (value <= 0x7fu)              { out[0] = (unsigned char)value; return 1; }
+			if (value <= 0xffu)              { out[0] = 0xcc; out[1] = (unsigned char)value; return 2; }
+			if (value <= 0xffffu)            { out[0] = 0xcd; cbor::bigEndian(out+1, value, 2); return 3; }
+			if (value <= 0xffffffffu)        { out[0] = 0xce; cbor::bigEndian(out+1, value, 4); return 5; }
+			out[0] = 0xcf; cbor::bigEndian(out+1, value, 8); return 9;
+		}
+
+		static size_t negative(unsigned char* out, unsigned long long minus1) // -1-minus1, in two's complement
+		{
+			const unsigned long long value = ~minus1;
+			if (minus1 < 32u)                { out[0] = (unsigned char)value; return 1; }
+			if (minus1 < 0x80u)              { out[0] = 0xd0; out[1] = (unsigned char)value; return 2; }
+			if (minus1 < 0x8000u)            { out[0] = 0xd1; cbor::bigEndian(out+1, value, 2); return 3; }
+			if (minus1 < 0x80000000u)        { out[0] = 0xd2; cbor::bigEndian(out+1, value, 4); return 5; }
+			out[0] = 0xd3; cbor::bigEndian(out+1, value, 8); return 9;
+		}
+
+		// Returns 0 for anything past 32 bits of length (or count), which MessagePack has no way to write.
+		static size_t bytes(unsigned char* out, size_t size)
+		{
+			if ((unsigned long long)size > 0xffffffffull) return 0;
+			if (size <= 0xffu)               { out[0] = 0xc4; out[1] = (unsigned char)size; return 2; }
+			if (size <= 0xffffu)             { out[0] = 0xc5; cbor::bigEndian(out+1, size, 2); return 3; }
+			out[0] = 0xc6; cbor::bigEndian(out+1, size, 4); return 5;
+		}
+
+		static size_t text(unsigned char* out, size_t size)
+		{
+			if ((unsigned long long)size > 0xffffffffull) return 0;
+			if (size < 32)                   { out[0] = (unsigned char)(0xa0 | size); return 1; }
+			if (size <= 0xffu)               { out[0] = 0xd9; out[1] = (unsigned char)size; return 2; }
+			if (size <= 0xffffu)             { out[0] = 0xda; cbor::bigEndian(out+1, size, 2); return 3; }
+			out[0] = 0xdb; cbor::bigEndian(out+1, size, 4); return 5;
+		}
+
+		static size_t container(unsigned char* out, bool object, size_t count)
+		{
+			if ((unsigned long long)count > 0xffffffffull) return 0;
+			if (count < 16)                  { out[0] = (unsigned char)((object ? 0x80 : 0x90) | count); return 1; }
+			if (count <= 0xffffu)            { out[0] = object ? 0xde : 0xdc; cbor::bigEndian(out+1, count, 2); return 3; }
+			out[0] = object ? 0xdf : 0xdd; cbor::bigEndian(out+1, count, 4); return 5;
+		}
+
+		static void   open (unsigned char* out, bool object) { out[0] = object ? 0xdf : 0xdd; out[1] = out[2] = out[3] = out[4] = 0; }
+		static size_t close(unsigned char*)                  { return 0; }
+	};
+
+	template < typename Format > class basic_binaryWriter;
+	template < typename Format, typename Checks > class basic_binaryObjectWriter;
+	template < typename Format, typename Checks > class basic_binaryArrayWriter;
+
+	typedef basic_binaryWriter<cbor>    cborWriter;
+	typedef basic_binaryWriter<msgpack> msgpackWriter;
+
+	// Same buffers, sinks, growth, counting and failure rules as writer - see there.
+	template < typename Format > class basic_binaryWriter
+	{
+		char*               begin;
+		char*               end;
+		char*               position;
+		bool                locked;
+		sink                output;
+		std::vector<char>*  growable;
+		size_t              skipped; // Bytes counted instead of stored, once position == end - see required()
+		size_t              depth;   // Containers open
+		size_t              peak;    // Most ever counted - MessagePack needs room for unpatched headers before they shrink
+
+		template < typename F, typename C > friend class basic_binaryObjectWriter;
+		template < typename F, typename C > friend class basic_binaryArrayWriter;
+
+		static char* nowhere() { static char measuring[1]; return measuring; } // Where dry runs point - never written
+
+		void error(const char* message) { reportError(message); }
+
+		void write(const void* data, size_t size)
+		{
+			if (position && size < size_t(end-position)) { memcpy(position, data, size); position += size; }
+			else if (position == end) skipped += size;
+			else overflow((const char*)data, size);
+		}
+
+		void byte(unsigned char b) { write(&b, 1); }
+
+		void overflow(const char* data, size_t size)
+		{
+			if (!position) return;
+			if (growable) { if (!grow(size)) return; }
+			else if (!output.callback || (!Format::indefiniteLengths && depth) || !flush()) { skip(size); return; }
+			if (size >= size_t(end-position))
+			{
+				// Bigger than the entire buffer - hand it straight to the sink.
+				if (!output.callback(output.context, data, size)) position = 0;
+				return;
+			}
+			memcpy(position, data, size);
+			position += size;
+		}
+
+		// Out of room for good:  stop storing, keep counting.  Also what MessagePack streams do when a document outgrows
+		// the buffer, so required() says how big it needs to be.
+		void skip(size_t size)
+		{
+			if (!position) return;
+			if (position != end) { skipped = position - begin; position = end; }
+			skipped += size;
+		}
+
+		bool grow(size_t size)
+		{
+			const size_t used   = position - begin;
+			const size_t needed = used + size + 1;
+			size_t capacity = growable->size() < 64 ? 64 : growable->size();
+			while (capacity < needed) capacity *= 2;
+
+			try { growable->resize(capacity); }
+			catch (const std::bad_alloc&) { error("basic_binaryWriter::grow(...) failed to allocate!"); position = 0; return false; }
+
+			begin    = &(*growable)[0];
+			end      = begin + capacity;
+			position = begin + used;
+			return true;
+		}
+
+		size_t open(bool object) // Returns where the container starts, for close(...)
+		{
+			const size_t at = position && position != end ? size_t(position - begin) : 0;
+			unsigned char head[Format::openSize];
+			Format::open(head, object);
+			write(head, Format::openSize);
+			++depth;
+			return at;
+		}
+
+		void close(bool object, size_t at, size_t count)
+		{
+			--depth;
+			unsigned char head[9];
+			if (Format::indefiniteLengths) { write(head, Format::close(head)); return; }
+
+			const size_t size = Format::container(head, object, count);
+			if (!size) { tooBig(); return; }
+			if (!position) return;
+			if (position == end) { if (skipped > peak) peak = skipped; skipped -= Format::openSize - size; return; }
+
+			char* const container = begin + at;
+			if (size < Format::openSize)
+			{
+				memmove(container + size, container + Format::openSize, position - (container + Format::openSize));
+				position -= Format::openSize - size;
+			}
+			memcpy(container, head, size);
+		}
+
+		void tooBig() { error("basic_binaryWriter: string, byte string or container too big for the format!"); position = 0; }
+
+		void text(const char* value, size_t size)
+		{
+			unsigned char head[9];
+			const size_t headSize = Format::text(head, size);
+			if (!headSize) { tooBig(); return; }
+			write(head, headSize);
+			write(value, size);
+		}
+
+		void blob(const void* value, size_t size)
+		{
+			unsigned char head[9];
+			const size_t headSize = Format::bytes(head, size);
+			if (!headSize) { tooBig(); return; }
+			write(head, headSize);
+			write(value, size);
+		}
+
+		template < typename Unit > static unsigned long decode(const Unit*& units, const Unit* last)
+		{
+			const unsigned long unit = (unsigned long)*units++;
+			if (sizeof(Unit) == 2 && unit >= 0xd800 && unit < 0xdc00 && units != last && (unsigned long)*units >= 0xdc00 && (unsigned long)*units < 0xe000)
+				return 0x10000 + ((unit - 0xd800) << 10) + ((unsigned long)*units++ - 0xdc00);
+			return (unit >= 0xd800 && unit < 0xe000) || unit > 0x10ffff ? 0xfffd : unit; // Unpaired surrogates and garbage
+		}
+
+		static size_t encode(char* out, unsigned long cp)
+		{
+			if (cp < 0x80)    { out[0] = (char)cp; return 1; }
+			if (cp < 0x800)   { out[0] = (char)(0xc0 | (cp >> 6));  out[1] = (char)(0x80 | (cp & 0x3f)); return 2; }
+			if (cp < 0x10000) { out[0] = (char)(0xe0 | (cp >> 12)); out[1] = (char)(0x80 | ((cp >> 6) & 0x3f)); out[2] = (char)(0x80 | (cp & 0x3f)); return 3; }
+			out[0] = (char)(0xf0 | (cp >> 18)); out[1] = (char)(0x80 | ((cp >> 12) & 0x3f)); out[2] = (char)(0x80 | ((cp >> 6) & 0x3f)); out[3] = (char)(0x80 | (cp & 0x3f)); return 4;
+		}
+
+		template < typename Unit > void transcode(const Unit* units, size_t size) // Two passes:  the length comes first
+		{
+			if (size == (size_t)-1) { size = 0; while (units[size]) ++size; }
+			const Unit* const last = units + size;
+
+			char   chunk[64];
+			size_t length = 0;
+			for (const Unit* u = units; u != last; ) length += encode(chunk, decode(u, last));
+
+			unsigned char head[9];
+			const size_t headSize = Format::text(head, length);
+			if (!headSize) { tooBig(); return; }
+			write(head, headSize);
+
+			size_t used = 0;
+			for (const Unit* u = units; u != last; )
+			{
+				used += encode(chunk + used, decode(u, last));
+				if (used > sizeof(chunk) - 4) { write(chunk, used); used = 0; }
+			}
+			write(chunk, used);
+		}
+
+		static unsigned long hex4(const char*& p, const char* last)
+		{
+			unsigned long value = 0;
+			for (int i = 0; i < 4; ++i, ++p)
+			{
+				if (p == last) return 0xfffd;
+				const char c = *p;
+				const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+				if (digit < 0) return 0xfffd;
+				value = value * 16 + (unsigned long)digit;
+			}
+			return value;
+		}
+
+		// One byte, or one JSON escape decoded to UTF-8.  Returns how many bytes it wrote to out.
+		static size_t unescape(char* out, const char*& p, const char* last)
+		{
+			if (*p != '\\' || p + 1 == last) { *out = *p++; return 1; }
+			const char escape = p[1];
+			p += 2;
+			switch (escape)
+			{
+			case 'b': *out = '\b'; return 1;
+			case 'f': *out = '\f'; return 1;
+			case 'n': *out = '\n'; return 1;
+			case 'r': *out = '\r'; return 1;
+			case 't': *out = '\t'; return 1;
+			case 'u': break;
+			default:  *out = escape; return 1; // \" \\ \/
+			}
+
+			unsigned long cp = hex4(p, last);
+			if (cp >= 0xd800 && cp < 0xdc00 && last - p >= 6 && p[0] == '\\' && p[1] == 'u')
+			{
+				const char* next = p + 2;
+				const unsigned long low = hex4(next, last);
+				if (low >= 0xdc00 && low < 0xe000) { cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00); p = next; }
+			}
+			return encode(out, cp >= 0xd800 && cp < 0xe000 ? 0xfffd : cp);
+		}
+
+		// JSON escaped text - MMK_JSON_KEY literals - as the UTF-8 it stands for.  Two passes, like transcode.
+		void escapedText(const char* value, size_t size)
+		{
+			const char* const last = value + size;
+
+			char   chunk[64];
+			size_t length = 0;
+			for (const char* p = value; p != last; ) length += unescape(chunk, p, last);
+
+			unsigned char head[9];
+			const size_t headSize = Format::text(head, length);
+			if (!headSize) { tooBig(); return; }
+			write(head, headSize);
+
+			size_t used = 0;
+			for (const char* p = value; p != last; )
+			{
+				used += unescape(chunk + used, p, last);
+				if (used > sizeof(chunk) - 4) { write(chunk, used); used = 0; }
+			}
+			write(chunk, used);
+		}
+
+		template < typename Unsigned > void integer(Unsigned value)            { unsigned char head[9]; write(head, Format::positive(head, value)); }
+		template < typename Signed   > void signedInteger(Signed value)        { unsigned char head[9]; write(head, value < 0 ? Format::negative(head, ~(unsigned long long)(long long)value) : Format::positive(head, (unsigned long long)value)); }
+
+		void float32(float value)
+		{
+			unsigned int bits;
+			memcpy(&bits, &value, 4);
+			unsigned char encoded[5] = { Format::float32 };
+			cbor::bigEndian(encoded+1, bits, 4);
+			write(encoded, 5);
+		}
+
+		void float64(double value)
+		{
+			if (value >= -FLT_MAX && value <= FLT_MAX && (double)(float)value == value) { float32((float)value); return; } // Exact, and half the size
+			unsigned long long bits;
+			memcpy(&bits, &value, 8);
+			unsigned char encoded[9] = { Format::float64 };
+			cbor::bigEndian(encoded+1, bits, 8);
+			write(encoded, 9);
+		}
+
+		void operator()(         const char* value) { if (!value) byte(Format::nil); else text(value, strlen(value)); }
+		void operator()(const char* value, size_t size) { if (!value) byte(Format::nil); else text(value, size); } // May contain '\0's
+		void operator()(const std::string&   value) { text(value.data(), value.size()); }
+		void operator()(const json::utf8&    value) { if (!value.data) byte(Format::nil); else text(value.data, value.size == (size_t)-1 ? strlen(value.data) : value.size); }
+		void operator()(const json::base64&  value) { if (!value.data) byte(Format::nil); else blob(value.data, value.size); }
+		void operator()(const json::hex&     value) { if (!value.data) byte(Format::nil); else blob(value.data, value.size); }
+		void operator()(const wchar_t*       value) { (*this)(json::wide(value)); }
+		void operator()(const std::wstring&  value) { (*this)(json::wide(value)); }
+		void operator()(const json::wide&    value)
+		{
+			if (!value.data) byte(Format::nil);
+			else if (value.unitSize == 2) transcode((const unsigned short*)value.data, value.size);
+			else transcode((const unsigned int*)value.data, value.size);
+		}
+#ifdef ZMMK_JSON_WRITER_CHAR16_T
+		void operator()(const char16_t*      value) { (*this)(json::wide(value)); }
+#endif
+
+		void operator()(         bool        value) { byte(value ? Format::yes : Format::no); }
+
+		void operator()(unsigned int         value) { integer(value); }
+		void operator()(  signed int         value) { signedInteger(value); }
+		void operator()(unsigned long        value) { integer(value); }
+		void operator()(  signed long        value) { signedInteger(value); }
+		void operator()(unsigned long long   value) { integer(value); }
+		void operator()(  signed long long   value) { signedInteger(value); }
+
+		void operator()(         float       value) { float32(value); }
+		void operator()(         double      value) { float64(value); }
+		void operator()(         long double value) { float64((double)value); }
+
+		ZMMK_JSON_WRITER_SAFE_BOOL(basic_binaryWriter) { return position && (position != end || begin == end); } // Counting is only a failure if there was a buffer
+
+	public:
+		explicit basic_binaryWriter(char* buffer, size_t bufferSize, sink output = sink())
+			: begin   (buffer+0)
+			, end     (buffer+bufferSize)
+			, position(bufferSize ? buffer+0 : 0)
+			, locked  (false)
+			, output  (output)
+			, growable(0)
+			, skipped (0)
+			, depth   (0)
+			, peak    (0)
+		{
+		}
+
+		template < size_t bufferSize > explicit basic_binaryWriter(char (&buffer)[bufferSize], sink output = sink())
+			: begin   (buffer+0)
+			, end     (buffer+bufferSize)
+			, position(bufferSize ? buffer+0 : 0)
+			, locked  (false)
+			, output  (output)
+			, growable(0)
+			, skipped (0)
+			, depth   (0)
+			, peak    (0)
+		{
+		}
+
+		explicit basic_binaryWriter(std::vector<char>& buffer)
+			: begin   (buffer.data())
+			, end     (buffer.data()+buffer.size())
+			, position(buffer.size() ? buffer.data() : 0)
+			, locked  (false)
+			, growable(0)
+			, skipped (0)
+			, depth   (0)
+			, peak    (0)
+		{
+		}
+
+		basic_binaryWriter(std::vector<char>& buffer, growTag, size_t expectedBytes = 0)
+			: locked  (false)
+			, growable(&buffer)
+			, skipped (0)
+			, depth   (0)
+			, peak    (0)
+		{
+			if (buffer.size() <= expectedBytes) buffer.resize(expectedBytes+1);
+			begin    = &buffer[0];
+			end      = begin + buffer.size();
+			position = begin;
+		}
+
+		explicit basic_binaryWriter(measureTag)
+			: begin   (nowhere())
+			, end     (nowhere())
+			, position(nowhere())
+			, locked  (false)
+			, growable(0)
+			, skipped (0)
+			, depth   (0)
+			, peak    (0)
+		{
+		}
+
+		bool flush()
+		{
+			if (!position) return false;
+			if (position == end) return begin == end;
+			if (!output.callback || position == begin || (!Format::indefiniteLengths && depth)) return true;
+			if (!output.callback(output.context, begin, position-begin)) { position = 0; return false; }
+			position = begin;
+			return true;
+		}
+
+		// Binary - not '\0' terminated, and may contain '\0's.  c_str() is the same thing, so code written against writer
+		// keeps compiling.
+		const char* data()  const { return locked ? 0 : position && position != end ? begin : 0; }
+		const char* c_str() const { return data(); }
+		size_t      size()  const { return locked ? 0 : position && position != end ? size_t(position-begin) : 0; }
+		// Like writer::required(), with room for MessagePack's container headers before they're patched - so it can be a
+		// few bytes more than a MessagePack document's final size.
+		size_t      required() const { return locked || !position ? 0 : position == end ? (skipped > peak ? skipped : peak) : size_t(position-begin); }
+	};
+
+	template < typename Format, typename Checks > class basic_binaryObjectWriter
+	{
+		typedef basic_binaryWriter<Format> writer;
+
+		writer& w;
+		bool&   parentLock;
+		bool    locked;
+		size_t  at;
+		size_t  count;
+
+		friend class basic_binaryArrayWriter<Format, Checks>;
+
+		template < typename Key > void writeStringKey(const Key& key) { ++count; w(key); }
+
+		void writeKey(const char*         key) { writeStringKey(key); }
+		void writeKey(const std::string&  key) { writeStringKey(key); }
+		void writeKey(const json::utf8&   key) { writeStringKey(key); }
+		void writeKey(const wchar_t*      key) { writeStringKey(key); }
+		void writeKey(const json::wide&   key) { writeStringKey(key); }
+#ifdef ZMMK_JSON_WRITER_CHAR16_T
+		void writeKey(const char16_t*     key) { writeStringKey(key); }
+#endif
+		void writeKey(const json::key&    key) // Just the literal out of ,"literal": - unescaped, if it needs it
+		{
+			++count;
+			const char* const literal = key.fragment + 2;
+			const size_t      size    = key.size - 4;
+			if (memchr(literal, '\\', size)) w.escapedText(literal, size);
+			else w.text(literal, size);
+		}
+
+		ZMMK_JSON_WRITER_SAFE_BOOL(basic_binaryObjectWriter) { return !!w.position; }
+
+	public:
+		basic_binaryObjectWriter(writer& w, noKeyTag)
+			: w         (w)
+			, parentLock(w.locked)
+			, locked    (false)
+			, at        (0)
+			, count     (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("objectWriter constructed against already locked writer!"); return; }
+			parentLock = true;
+			at = w.open(true);
+		}
+
+		basic_binaryObjectWriter(basic_binaryArrayWriter<Format, Checks>& parent, noKeyTag)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, at        (0)
+			, count     (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("objectWriter constructed against already locked arrayWriter!"); return; }
+			parentLock = true;
+			++parent.count;
+			at = w.open(true);
+		}
+
+		template < typename Key > basic_binaryObjectWriter(basic_binaryObjectWriter& parent, const Key& key)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, at        (0)
+			, count     (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("objectWriter constructed against already locked objectWriter!"); return; }
+			parentLock = true;
+			parent.writeKey(key);
+			at = w.open(true);
+		}
+
+		~basic_binaryObjectWriter()
+		{
+			w.close(true, at, count);
+			parentLock = false;
+			if (&parentLock == &w.locked) w.flush(); // Root scope finished
+		}
+
+		template < typename Key, typename Value > void operator()(const Key& key, const Value& value)
+		{
+			if (Checks::enabled && locked) { w.error("objectWriter::operator()(...) invoked while locked by child writer!"); return; }
+			writeKey(key);
+			w(value);
+		}
+
+		template < typename Key > void operator()(const Key& key, const char* value, size_t size)
+		{
+			if (Checks::enabled && locked) { w.error("objectWriter::operator()(...) invoked while locked by child writer!"); return; }
+			writeKey(key);
+			w(value, size);
+		}
+
+		template < typename Key, typename Container > void array(const Key& key, const Container& container)
+		{
+			basic_binaryArrayWriter<Format, Checks> child(*this, key);
+			const typename Container::const_iterator end=container.end();
+			for (typename Container::const_iterator i=container.begin(); i != end; ++i) child(*i);
+		}
+		template < typename Key, typename Value, typename Allocator > void array(const Key& key, const std::vector<Value, Allocator>& values) { basic_binaryArrayWriter<Format, Checks> child(*this, key); child.values(values.empty() ? 0 : &values[0], values.size()); }
+		template < typename Key, typename Allocator > void array(const Key& key, const std::vector<bool, Allocator>& values) { basic_binaryArrayWriter<Format, Checks> child(*this, key); for (size_t i = 0; i < values.size(); ++i) child((bool)values[i]); }
+		template < typename Key, typename Value, size_t N > void array(const Key& key, const Value (&values)[N]) { basic_binaryArrayWriter<Format, Checks> child(*this, key); child.values(values, N); }
+		template < typename Key, typename Value > void array(const Key& key, const Value* values, size_t count) { basic_binaryArrayWriter<Format, Checks> child(*this, key); child.values(values, count); }
+	};
+
+	template < typename Format, typename Checks > class basic_binaryArrayWriter
+	{
+		typedef basic_binaryWriter<Format> writer;
+
+		writer& w;
+		bool&   parentLock;
+		bool    locked;
+		size_t  at;
+		size_t  count;
+
+		friend class basic_binaryObjectWriter<Format, Checks>;
+
+		ZMMK_JSON_WRITER_SAFE_BOOL(basic_binaryArrayWriter) { return !!w.position; }
+
+		template < typename Value > void values(const Value* data, size_t n)
+		{
+			if (Checks::enabled && locked) { w.error("arrayWriter::array(...) invoked while locked by child writer!"); return; }
+			for (size_t i = 0; i < n; ++i) w(data[i]);
+			count += n;
+		}
+
+	public:
+		explicit basic_binaryArrayWriter(writer& w, noKeyTag)
+			: w         (w)
+			, parentLock(w.locked)
+			, locked    (false)
+			, at        (0)
+			, count     (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("arrayWriter constructed against already locked writer!"); return; }
+			parentLock = true;
+			at = w.open(false);
+		}
+
+		explicit basic_binaryArrayWriter(basic_binaryArrayWriter& parent, noKeyTag)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, at        (0)
+			, count     (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("arrayWriter constructed against already locked arrayWriter!"); return; }
+			parentLock = true;
+			++parent.count;
+			at = w.open(false);
+		}
+
+		template < typename Key > basic_binaryArrayWriter(basic_binaryObjectWriter<Format, Checks>& parent, const Key& key)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, at        (0)
+			, count     (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("arrayWriter constructed against already locked objectWriter!"); return; }
+			parentLock = true;
+			parent.writeKey(key);
+			at = w.open(false);
+		}
+
+		~basic_binaryArrayWriter()
+		{
+			w.close(false, at, count);
+			parentLock = false;
+			if (&parentLock == &w.locked) w.flush(); // Root scope finished
+		}
+
+		template < typename Value > void operator()(const Value& value)
+		{
+			if (Checks::enabled && locked) { w.error("arrayWriter::operator()(...) invoked while locked by child writer!"); return; }
+			++count;
+			w(value);
+		}
+
+		void operator()(const char* value, size_t size)
+		{
+			if (Checks::enabled && locked) { w.error("arrayWriter::operator()(...) invoked while locked by child writer!"); return; }
+			++count;
+			w(value, size);
+		}
+
+		template < typename Container > void array(const Container& container)
+		{
+			basic_binaryArrayWriter child(*this, noKeyTag());
+			const typename Container::const_iterator end=container.end();
+			for (typename Container::const_iterator i=container.begin(); i != end; ++i) child(*i);
+		}
+		template < typename Value, typename Allocator > void array(const std::vector<Value, Allocator>& values) { basic_binaryArrayWriter child(*this, noKeyTag()); child.values(values.empty() ? 0 : &values[0], values.size()); }
+		template < typename Allocator > void array(const std::vector<bool, Allocator>& values) { basic_binaryArrayWriter child(*this, noKeyTag()); for (size_t i = 0; i < values.size(); ++i) child((bool)values[i]); }
+		template < typename Value, size_t N > void array(const Value (&values)[N]) { basic_binaryArrayWriter child(*this, noKeyTag()); child.values(values, N); }
+		template < typename Value > void array(const Value* values, size_t count) { basic_binaryArrayWriter child(*this, noKeyTag()); child.values(values, count); }
+	};
+
+#ifdef MMK_JSON_WRITER_UNCHECKED
+	typedef basic_binaryObjectWriter<cbor,    unchecked> cborObjectWriter;
+	typedef basic_binaryArrayWriter <cbor,    unchecked> cborArrayWriter;
+	typedef basic_binaryObjectWriter<msgpack, unchecked> msgpackObjectWriter;
+	typedef basic_binaryArrayWriter <msgpack, unchecked> msgpackArrayWriter;
+#else
+	typedef basic_binaryObjectWriter<cbor,    checked>   cborObjectWriter;
+	typedef basic_binaryArrayWriter <cbor,    checked>   cborArrayWriter;
+	typedef basic_binaryObjectWriter<msgpack, checked>   msgpackObjectWriter;
+	typedef basic_binaryArrayWriter <msgpack, checked>   msgpackArrayWriter;
+#endif
+
+#if defined(MMK_JSON_WRITER_FORMAT_CBOR)
+	typedef cborWriter             documentWriter;
+	typedef cborObjectWriter       objectWriter;
+	typedef cborArrayWriter        arrayWriter;
+#elif defined(MMK_JSON_WRITER_FORMAT_MSGPACK)
+	typedef msgpackWriter          documentWriter;
+	typedef msgpackObjectWriter    objectWriter;
+	typedef msgpackArrayWriter     arrayWriter;
+#endif
+}} // namespace mmk::json
+
+#endif /* ndef ZMMK_IG_JSON_BINARY_HPP */
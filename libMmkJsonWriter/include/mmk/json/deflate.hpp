@@ -0,0 +1,132 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_DEFLATE_HPP
+#define ZMMK_IG_JSON_DEFLATE_HPP
+
+#include "writer.hpp"
+#include <zlib.h> // Header only, so only code that includes this needs to link zlib (-lz)
+
+namespace mmk { namespace json {
+
+	// Compresses a streaming writer's output on the fly:  each buffer the writer drains is deflated straight out of the
+	// writer's own storage, and compressed output is handed on to another sink whenever this one's buffer fills.  Memory
+	// stays bounded by the two buffers plus zlib's state - the uncompressed document never exists in full.
+	//
+	//     mmk::json::deflater gz(mmk::json::fdSink(fd));
+	//     MMK_JSON_WRITER_STREAM_OBJECT( example, 4096, mmk::json::deflateSink(gz) ) { ... }
+	//     if (!example || !gz.finish()) { ... }
+	//
+	// finish() writes the end of the compressed stream (the gzip trailer, by default) - the writer can't tell its sink
+	// that the document is over, so call it once the root scope has closed.
+	class deflater
+	{
+	public:
+		enum format
+		{
+			gzip,       // .gz files, HTTP "Content-Encoding: gzip"
+			zlib,       // HTTP "Content-Encoding: deflate"
+			rawDeflate  // No header or checksum, for embedding in other containers
+		};
+
+		explicit deflater(sink output, format f = gzip, int level = Z_DEFAULT_COMPRESSION)
+			: output  (output)
+			, failed  (false)
+			, finished(false)
+		{
+			memset(&stream, 0, sizeof(stream));
+			const int windowBits = f == gzip ? 15 + 16 : f == zlib ? 15 : -15;
+			failed = !output.callback || deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK;
+			stream.next_out  = buffer;
+			stream.avail_out = sizeof(buffer);
+		}
+
+		~deflater() { deflateEnd(&stream); }
+
+		// Feeds uncompressed bytes in, see deflateSink.  False (and every call after) once zlib or the output sink fails.
+		bool write(const char* data, size_t size)
+		{
+			if (failed || finished) return false;
+
+			while (size)
+			{
+				const uInt chunk = size > 0x40000000 ? 0x40000000 : (uInt)size;
+				stream.next_in  = (Bytef*)data;
+				stream.avail_in = chunk;
+				while (stream.avail_in)
+				{
+					if (deflate(&stream, Z_NO_FLUSH) == Z_STREAM_ERROR) return fail();
+					if (!stream.avail_out && !drain()) return false;
+				}
+				data += chunk;
+				size -= chunk;
+			}
+			return true;
+		}
+
+		// Compresses whatever zlib's still holding on to and ends the stream.  Nothing more can be written afterwards.
+		bool finish()
+		{
+			if (failed || finished) return !failed && finished;
+
+			stream.next_in  = 0;
+			stream.avail_in = 0;
+			for (;;)
+			{
+				const int result = deflate(&stream, Z_FINISH);
+				if (result == Z_STREAM_ERROR) return fail();
+				if (result == Z_STREAM_END) break;
+				if (!drain()) return false;
+			}
+			finished = true;
+			return drain();
+		}
+
+		bool   ok()         const { return !failed; }
+		size_t totalIn()    const { return (size_t)stream.total_in;  } // Uncompressed bytes written so far
+		size_t totalOut()   const { return (size_t)stream.total_out; } // Compressed bytes produced so far, drained or not
+
+	private:
+		enum { bufferSize = 16 * 1024 };
+
+		z_stream    stream;
+		sink        output;
+		bool        failed;
+		bool        finished;
+		Bytef       buffer[bufferSize];
+
+		deflater(const deflater&);            // Not copyable - zlib's state points back into this
+		deflater& operator=(const deflater&);
+
+		bool fail() { failed = true; return false; }
+
+		bool drain()
+		{
+			const size_t size = sizeof(buffer) - stream.avail_out;
+			stream.next_out  = buffer;
+			stream.avail_out = sizeof(buffer);
+			if (size && !output.callback(output.context, (const char*)buffer, size)) return fail();
+			return true;
+		}
+
+		static bool sinkCallback(void* context, const char* data, size_t size) { return ((deflater*)context)->write(data, size); }
+
+		friend sink deflateSink(deflater& d);
+	};
+
+	inline sink deflateSink(deflater& d) { return sink(deflater::sinkCallback, &d); } // Writes into d
+}} // namespace mmk::json
+
+#endif /* ndef ZMMK_IG_JSON_DEFLATE_HPP */
@@ -0,0 +1,98 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_FIELDS_HPP
+#define ZMMK_IG_JSON_FIELDS_HPP
+
+#include "writer.hpp"
+
+// Serializers generated from a list of a struct's fields, written once next to the struct (same namespace, public fields):
+//
+//     struct reading { int id; std::string name; position where; std::vector<double> samples; };
+//
+//     MMK_JSON_FIELDS_BEGIN(reading)
+//         MMK_JSON_FIELD(id)
+//         MMK_JSON_FIELD(name)
+//         MMK_JSON_FIELD_AS(where, "position")
+//         MMK_JSON_FIELD(samples)
+//     MMK_JSON_FIELDS_END()
+//
+//     MMK_JSON_WRITER_ROOT_OBJECT(o, 1024) { writeJsonFields(o, r); }  // {"id":...,"name":...,"position":{...},"samples":[...]}
+//     writeJsonField(o, "latest", r);                                   // Nested in any other object
+//
+// Every key is a MMK_JSON_KEY - quoted, escaped and merged with its comma at compile time.  Fields that are listed structs
+// themselves nest through MMK_JSON_WRITER_OBJECT_OBJECT, std::vectors and C arrays through objectWriter::array (numbers
+// keep their bulk path), vectors and C arrays of listed structs become arrays of objects, and char arrays are '\0'
+// terminated strings.
+// Anything else is written as o(key, value).  To write another type your own way, overload writeJsonField(o, key, value)
+// and writeJsonElement(a, value) for it in its own namespace - that's all the macros do.
+
+namespace mmk { namespace json {
+
+	template < typename ObjectWriter, typename Key, typename Value > void writeJsonField(ObjectWriter& o, const Key& key, const Value& value)
+	{
+		o(key, value);
+	}
+
+	template < typename ObjectWriter, typename Key, typename Value, typename Allocator > void writeJsonField(ObjectWriter& o, const Key& key, const std::vector<Value, Allocator>& values)
+	{
+		o.array(key, values);
+	}
+
+	template < typename ObjectWriter, typename Key, typename Value, size_t N > void writeJsonField(ObjectWriter& o, const Key& key, const Value (&values)[N])
+	{
+		o.array(key, values);
+	}
+
+	template < typename ObjectWriter, typename Key, size_t N > void writeJsonField(ObjectWriter& o, const Key& key, const char (&text)[N])
+	{
+		o(key, text, (const char*)memchr(text, '\0', N) ? strlen(text) : N);
+	}
+
+	template < typename ArrayWriter, typename Value > void writeJsonElement(ArrayWriter& a, const Value& value)
+	{
+		a(value);
+	}
+}} // namespace mmk::json
+
+#define MMK_JSON_FIELDS_BEGIN(type)                                                                                                 \
+	template < typename ObjectWriter > void writeJsonFields(ObjectWriter& o, const type& value);                                   \
+	template < typename ObjectWriter, typename Key > void writeJsonField(ObjectWriter& o, const Key& key, const type& value)        \
+	{                                                                                                                               \
+		MMK_JSON_WRITER_OBJECT_OBJECT(o, key) writeJsonFields(o, value);                                                            \
+	}                                                                                                                               \
+	template < typename ObjectWriter, typename Key, typename Allocator >                                                            \
+	void writeJsonField(ObjectWriter& o, const Key& key, const std::vector<type, Allocator>& values)                               \
+	{                                                                                                                               \
+		MMK_JSON_WRITER_OBJECT_ARRAY(o, key) for (size_t i = 0; i < values.size(); ++i) writeJsonElement(o, values[i]);              \
+	}                                                                                                                               \
+	template < typename ObjectWriter, typename Key, size_t N >                                                                      \
+	void writeJsonField(ObjectWriter& o, const Key& key, const type (&values)[N])                                                   \
+	{                                                                                                                               \
+		MMK_JSON_WRITER_OBJECT_ARRAY(o, key) for (size_t i = 0; i < N; ++i) writeJsonElement(o, values[i]);                          \
+	}                                                                                                                               \
+	template < typename ArrayWriter > void writeJsonElement(ArrayWriter& a, const type& value)                                      \
+	{                                                                                                                               \
+		MMK_JSON_WRITER_ARRAY_OBJECT(a) writeJsonFields(a, value);                                                                  \
+	}                                                                                                                               \
+	template < typename ObjectWriter > void writeJsonFields(ObjectWriter& o, const type& value)                                    \
+	{                                                                                                                               \
+		(void)o; (void)value; /* MMK_JSON_FIELD(...) ... */
+
+#define MMK_JSON_FIELD(name)            writeJsonField(o, MMK_JSON_KEY(#name), value.name);
+#define MMK_JSON_FIELD_AS(name, key)    writeJsonField(o, MMK_JSON_KEY(key),   value.name);
+#define MMK_JSON_FIELDS_END()           }
+
+#endif /* ndef ZMMK_IG_JSON_FIELDS_HPP */
@@ -0,0 +1,211 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_LOG_HPP
+#define ZMMK_IG_JSON_LOG_HPP
+
+#include "writer.hpp"
+
+#if __cplusplus < 201103L && !(defined(_MSC_VER) && _MSC_VER >= 1800)
+	#error mmk/json/log.hpp requires C++11 (std::atomic, std::thread), unlike the rest of the library
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace mmk { namespace json {
+
+	class logRecord;
+
+	// Newline delimited JSON records from any number of threads, written to fd by a background thread.
+	//
+	// Producers claim a fixed size slot from a lock-free ring (a single CAS), write one record into it, and commit it -
+	// see MMK_JSON_LOG_OBJECT.  They never wait:  if the ring is full the record is dropped, and if it doesn't fit in a
+	// slot it's discarded, both counted in stats().  The background thread writev()s runs of committed records, sleeping
+	// for idleWait when there are none.  Destruction writes out everything committed so far - don't log concurrently.
+	class logRing
+	{
+	public:
+		struct statistics
+		{
+			unsigned long long committed; // Records handed to the background thread
+			unsigned long long written;   // ...and written out by it
+			unsigned long long dropped;   // Ring was full
+			unsigned long long oversized; // Record didn't fit in a slot
+			unsigned long long failed;    // Records writeSegments(...) failed to write
+		};
+
+		explicit logRing(int fd, size_t slots = 1024, size_t slotBytes = 512, std::chrono::microseconds idleWait = std::chrono::microseconds(1000))
+			: fd       (fd)
+			, slotBytes(slotBytes)
+			, mask     (roundUpToPowerOf2(slots) - 1)
+			, headers  (mask + 1)
+			, buffers  ((mask + 1) * slotBytes)
+			, head     (0)
+			, idleWait (idleWait)
+			, stopping (false)
+			, written  (0), failed(0)
+			, tail     (0)
+			, committed(0), dropped(0), oversized(0)
+		{
+			for (size_t i = 0; i <= mask; ++i) headers[i].sequence.store(i, std::memory_order_relaxed);
+			consumer = std::thread([this] { drain(); });
+		}
+
+		~logRing()
+		{
+			stopping.store(true, std::memory_order_release);
+			consumer.join();
+		}
+
+		statistics stats() const
+		{
+			statistics s = { committed.load(), written.load(), dropped.load(), oversized.load(), failed.load() };
+			return s;
+		}
+
+	private:
+		friend class logRecord;
+
+		logRing(const logRing&);
+		logRing& operator=(const logRing&);
+
+		static const size_t full = (size_t)-1; // acquire() found no free slot
+
+		struct header
+		{
+			std::atomic<size_t> sequence; // == position: free, == position+1: committed (Vyukov's bounded queue)
+			size_t              size;     // Record length, 0 if it was oversized
+			char                padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+		};
+
+		static size_t roundUpToPowerOf2(size_t n) { size_t p = 2; while (p < n) p *= 2; return p; }
+
+		// Returns the claimed ring position, or full if there are none free.
+		size_t acquire()
+		{
+			size_t position = tail.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				const size_t sequence = headers[position & mask].sequence.load(std::memory_order_acquire);
+				const ptrdiff_t diff = (ptrdiff_t)(sequence - position);
+				if (diff == 0)
+				{
+					if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) return position;
+				}
+				else if (diff < 0) { dropped.fetch_add(1, std::memory_order_relaxed); return full; }
+				else position = tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		void commit(size_t position, size_t size)
+		{
+			header& h = headers[position & mask];
+			h.size = size;
+			if (size) committed.fetch_add(1, std::memory_order_relaxed);
+			else      oversized.fetch_add(1, std::memory_order_relaxed);
+			h.sequence.store(position + 1, std::memory_order_release);
+		}
+
+		char* buffer(size_t position) { return &buffers[(position & mask) * slotBytes]; }
+
+		void drain()
+		{
+			segment output[64];
+			for (;;)
+			{
+				const bool last = stopping.load(std::memory_order_acquire); // Check before draining so nothing committed beforehand is missed
+
+				size_t ready = 0, records = 0;
+				while (ready < sizeof(output)/sizeof(output[0]) && headers[(head + ready) & mask].sequence.load(std::memory_order_acquire) == head + ready + 1)
+				{
+					const size_t position = head + ready++;
+					const size_t size     = headers[position & mask].size;
+					if (!size) continue;
+					char* record = buffer(position);
+					record[size] = '\n'; // Over the writer's '\0' terminator
+					segment s = { record, size + 1 };
+					output[records++] = s;
+				}
+
+				if (records)
+				{
+					gather batch(output, records);
+					batch.count = records;
+					(writeSegments(fd, batch) ? written : failed).fetch_add(records, std::memory_order_relaxed);
+				}
+				for (size_t i = 0; i < ready; ++i, ++head) headers[head & mask].sequence.store(head + mask + 1, std::memory_order_release);
+
+				if (ready) continue;
+				if (last) return;
+				std::this_thread::sleep_for(idleWait);
+			}
+		}
+
+		// Consumer side
+		const int                   fd;
+		const size_t                slotBytes;
+		const size_t                mask;
+		std::vector<header>         headers;
+		std::vector<char>           buffers;
+		size_t                      head;
+		std::chrono::microseconds   idleWait;
+		std::atomic<bool>           stopping;
+		std::atomic<unsigned long long> written, failed;
+		std::thread                 consumer;
+
+		// Producer side, on its own cache line
+		char                        padding[64];
+		std::atomic<size_t>         tail;
+		std::atomic<unsigned long long> committed, dropped, oversized;
+	};
+
+	// One record's claim on a logRing slot, committed when destroyed.  Converts to false (and w to a failed writer) when
+	// the ring was full.  Normally only seen through MMK_JSON_LOG_OBJECT.
+	class logRecord
+	{
+		logRing* ring;
+		size_t   position;
+
+		logRecord(const logRecord&);
+		logRecord& operator=(const logRecord&);
+
+	public:
+		writer   w;
+
+		explicit logRecord(logRing& ring)
+			: ring    (&ring)
+			, position(ring.acquire())
+			, w       (position == logRing::full ? 0 : ring.buffer(position), position == logRing::full ? 0 : ring.slotBytes)
+		{
+			if (position == logRing::full) this->ring = 0;
+		}
+
+		logRecord(logRecord&& other) : ring(other.ring), position(other.position), w(other.w) { other.ring = 0; }
+
+		~logRecord() { if (ring) ring->commit(position, !!w ? w.size() : 0); }
+
+		explicit operator bool() const { return !!ring; }
+	};
+}} // namespace mmk::json
+
+// Writes one record to a logRing:  MMK_JSON_LOG_OBJECT(log, ring) { log("level", "warn"); log("msg", message); }
+// The block is skipped entirely when the ring is full.
+#define MMK_JSON_LOG_OBJECT(name, ring) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::logRecord name ## _record = ::mmk::json::logRecord(ring)) if (::mmk::json::writer& name = name ## _record.w) ZMMK_JSON_WARN_UNSUPRESS() MMK_JSON_WRITER_ARRAY_OBJECT(name) /* { ... } */
+#define MMK_JSON_LOG_ARRAY( name, ring) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::logRecord name ## _record = ::mmk::json::logRecord(ring)) if (::mmk::json::writer& name = name ## _record.w) ZMMK_JSON_WARN_UNSUPRESS() MMK_JSON_WRITER_ARRAY_ARRAY(name)  /* { ... } */
+
+#endif /* ndef ZMMK_IG_JSON_LOG_HPP */
@@ -0,0 +1,139 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_MMAP_HPP
+#define ZMMK_IG_JSON_MMAP_HPP
+
+#include "writer.hpp"
+
+#ifdef _WIN32
+	#error mmk/json/mmap.hpp is POSIX only
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace mmk { namespace json {
+
+	// Writes a document straight into a memory mapped file, for dumps far bigger than any buffer:  no copying out of a
+	// buffer, and no write() calls.  The mapping grows a window at a time - the file is extended (fallocate or ftruncate)
+	// and remapped (mremap on Linux, which may move it) whenever the writer runs out of room - and close(size) trims off
+	// the rest.  Left to the destructor, the file is trimmed to where the writer's last root scope closed.
+	//
+	//     mmk::json::mappedFile file("dump.json");
+	//     mmk::json::writer w(mmk::json::mappedStorage(file));
+	//     MMK_JSON_WRITER_ARRAY_OBJECT(w) { ... }
+	//     if (!w || !file.close(w.size())) { ... }
+	//
+	// Windows should be big, each costs a few syscalls.  Where the kernel has MADV_POPULATE_WRITE, new windows are faulted
+	// in with one call instead of a page fault per page.  Closing doesn't fsync - the kernel writes the pages back.
+	class mappedFile
+	{
+	public:
+		explicit mappedFile(const char* path, size_t window = 64 << 20)
+			: fd    (open(path, O_RDWR | O_CREAT | O_TRUNC, 0666))
+			, data  (0)
+			, mapped(0)
+			, used  (0)
+			, window(window)
+		{
+			const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+			if (this->window < page) this->window = page;
+			this->window = (this->window + page - 1) / page * page;
+		}
+
+		~mappedFile() { if (fd != -1) close(used); }
+
+		bool ok() const { return fd != -1; } // False if opening or growing failed, and once closed
+
+		// Unmaps the file and truncates it to size.  False if that, or anything before it, failed.
+		bool close(size_t size)
+		{
+			if (fd == -1) return false;
+			bool closed = true;
+			if (data && munmap(data, mapped) != 0) closed = false;
+			if (ftruncate(fd, (off_t)size) != 0) closed = false;
+			if (::close(fd) != 0) closed = false;
+			fd     = -1;
+			data   = 0;
+			mapped = 0;
+			return closed;
+		}
+
+	private:
+		int     fd;
+		char*   data;
+		size_t  mapped;
+		size_t  used;   // As of the last grow(...), or the document's size once a root scope closes
+		size_t  window;
+
+		mappedFile(const mappedFile&);
+		mappedFile& operator=(const mappedFile&);
+
+		friend storage mappedStorage(mappedFile& file);
+
+		char* fail()
+		{
+			if (data) munmap(data, mapped);
+			::close(fd);
+			fd     = -1;
+			data   = 0;
+			mapped = 0;
+			return 0;
+		}
+
+		static char* grow(void* context, size_t used, size_t needed, size_t& capacity)
+		{
+			mappedFile& f = *(mappedFile*)context;
+			if (f.fd == -1) return 0;
+			if (!needed) { f.used = used; return f.data; } // Root scope closed
+
+			// Allocating the window's blocks up front saves the filesystem doing it a page fault at a time.
+			const size_t size = (needed + f.window - 1) / f.window * f.window;
+#ifdef __linux__
+			if (fallocate(f.fd, 0, (off_t)f.mapped, (off_t)(size - f.mapped)) != 0 && ftruncate(f.fd, (off_t)size) != 0) return f.fail();
+#else
+			if (ftruncate(f.fd, (off_t)size) != 0) return f.fail();
+#endif
+#ifdef MREMAP_MAYMOVE
+			void* moved = f.data ? mremap(f.data, f.mapped, size, MREMAP_MAYMOVE) : mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, f.fd, 0);
+#else
+			if (f.data) munmap(f.data, f.mapped);
+			void* moved = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, f.fd, 0);
+			if (moved == MAP_FAILED) f.data = 0;
+#endif
+			if (moved == MAP_FAILED) return f.fail();
+
+			const size_t added = size - f.mapped;
+			f.data   = (char*)moved;
+			f.used   = used;
+			madvise(f.data, size, MADV_SEQUENTIAL);
+#ifdef MADV_POPULATE_WRITE
+			madvise(f.data + f.mapped, added, MADV_POPULATE_WRITE); // Just a hint - older kernels reject it
+#else
+			(void)added;
+#endif
+			f.mapped = size;
+			capacity = size;
+			return f.data;
+		}
+	};
+
+	inline storage mappedStorage(mappedFile& file) { return storage(mappedFile::grow, &file); }
+}} // namespace mmk::json
+
+#endif /* ndef ZMMK_IG_JSON_MMAP_HPP */
@@ -0,0 +1,132 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_PARALLEL_HPP
+#define ZMMK_IG_JSON_PARALLEL_HPP
+
+#include "writer.hpp"
+
+#if __cplusplus < 201103L && !(defined(_MSC_VER) && _MSC_VER >= 1700)
+	#error mmk/json/parallel.hpp requires C++11 (std::thread), unlike the rest of the library
+#endif
+
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace mmk { namespace json {
+
+	// Writes big random access containers on several threads:  each chunk is formatted into its own growable buffer, and
+	// the chunks are then joined into the parent array in order - byte for byte what array(...) would've written.
+	// Containers smaller than two minChunks are just written serially.
+	//
+	// Buffers are kept and reused by later calls.  Gathering writers reference chunks rather than copying them (see
+	// gather), so keep this around until the segments have been written.
+	class parallel
+	{
+		std::vector< std::vector<char> > buffers;
+		unsigned                         threads;
+		size_t                           minChunk;
+
+		// Contiguous ranges take arrayWriter's bulk path for numbers, anything else goes an element at a time.
+		template < typename Checks, typename Iterator > static void put(basic_arrayWriter<Checks>& a, Iterator first, Iterator last) { for (; first != last; ++first) a(*first); }
+		template < typename Checks, typename Value > static void put(basic_arrayWriter<Checks>& a, const Value* first, const Value* last) { a.values(first, last - first); }
+
+		template < typename Checks, typename Iterator > static size_t format(std::vector<char>& buffer, Iterator first, Iterator last)
+		{
+			try
+			{
+				writer w(buffer, growTag(), buffer.empty() ? 0 : buffer.size()-1);
+				{
+					basic_arrayWriter<Checks> a(w, noKeyTag());
+					put(a, first, last);
+				}
+				return !!w ? w.size() - 2 : (size_t)-1; // Sans []
+			}
+			catch (const std::bad_alloc&) { return (size_t)-1; } // Growing the buffer is handled, but elements may allocate
+		}
+
+		template < typename Checks, typename Container > void join(basic_arrayWriter<Checks>& child, const Container& container)
+		{
+			join(child, container.begin(), container.size());
+		}
+
+		template < typename Checks, typename Value, typename Allocator > void join(basic_arrayWriter<Checks>& child, const std::vector<Value, Allocator>& container)
+		{
+			join(child, container.empty() ? (const Value*)0 : &container[0], container.size());
+		}
+
+		template < typename Checks, typename Allocator > void join(basic_arrayWriter<Checks>& child, const std::vector<bool, Allocator>& container)
+		{
+			join(child, container.begin(), container.size());
+		}
+
+		template < typename Checks, typename Iterator > void join(basic_arrayWriter<Checks>& child, const Iterator first, const size_t count)
+		{
+			const size_t chunks = count / minChunk < threads ? count / minChunk : threads;
+			if (chunks < 2)
+			{
+				put(child, first, first + count);
+				return;
+			}
+
+			if (buffers.size() < chunks) buffers.resize(chunks);
+			std::vector<size_t>      sizes(chunks);
+			std::vector<std::thread> workers;
+			workers.reserve(chunks);
+
+			for (size_t c = chunks; c-- > 0; ) // Chunk 0 runs on this thread, after the rest have been started
+			{
+				const Iterator begin = first + (count * c / chunks);
+				const Iterator end   = first + (count * (c+1) / chunks);
+				std::vector<char>& buffer = buffers[c];
+				size_t&            size   = sizes[c];
+
+				if (c) try { workers.push_back(std::thread([&buffer, &size, begin, end] { size = format<Checks>(buffer, begin, end); })); continue; }
+				catch (const std::system_error&) {} // Out of threads - do it ourselves
+				size = format<Checks>(buffer, begin, end);
+			}
+			for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+
+			for (size_t c = 0; c < chunks; ++c)
+			{
+				if (sizes[c] == (size_t)-1) { child.w.error("parallel::array(...) failed to allocate!"); child.w.position = 0; return; }
+				child(raw(buffers[c].data() + 1, sizes[c]));
+			}
+		}
+
+	public:
+		explicit parallel(unsigned threads = 0, size_t minChunk = 4096) // 0 threads: one per hardware thread
+			: threads (threads ? threads : std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1)
+			, minChunk(minChunk ? minChunk : 1)
+		{
+		}
+
+		template < typename Checks, typename Container > void array(basic_arrayWriter<Checks>& parent, const Container& container)
+		{
+			basic_arrayWriter<Checks> child(parent, noKeyTag());
+			join(child, container);
+		}
+
+		template < typename Checks, typename Key, typename Container > void array(basic_objectWriter<Checks>& parent, const Key& key, const Container& container)
+		{
+			basic_arrayWriter<Checks> child(parent, key);
+			join(child, container);
+		}
+	};
+}} // namespace mmk::json
+
+#endif /* ndef ZMMK_IG_JSON_PARALLEL_HPP */
@@ -0,0 +1,202 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_PULL_HPP
+#define ZMMK_IG_JSON_PULL_HPP
+
+#include "fields.hpp"
+
+#if defined(MMK_JSON_WRITER_FORMAT_CBOR) || defined(MMK_JSON_WRITER_FORMAT_MSGPACK)
+	#error mmk/json/pull.hpp only writes JSON
+#endif
+
+namespace mmk { namespace json {
+
+	// Writes a document a chunk at a time, whenever the consumer asks for one - say whenever a non-blocking socket is
+	// writable - instead of all at once.  Between chunks, only the position in the document is kept:  a stack of the
+	// scopes still open, each with the source writing it, how far along that source is, and whether it needs a comma.
+	//
+	// Sources write one member (or element) per call, into a scope resumed from the stack:
+	//
+	//     bool writeLog(mmk::json::pullWriter& p, mmk::json::objectWriter& log, void* context, size_t index)
+	//     {
+	//         const serverLog& l = *(const serverLog*)context;
+	//         switch (index)
+	//         {
+	//         case 0:  log("server", l.server); return true;
+	//         case 1:  p.array(log, "entries", l.entries); return true; // A child scope, resumed an element at a time
+	//         default: return false;                                   // Nothing left - closes the scope
+	//         }
+	//     }
+	//
+	//     mmk::json::pullWriter p(writeLog, &l);
+	//     while (size_t size = p.pull(chunk, sizeof(chunk))) { ... send ... }
+	//
+	// A call may write anything that fits in one member - nested scopes and all - or hand a child scope off to another
+	// source, at most once and as the last thing it does.  Calls must be repeatable:  one that doesn't fit the rest of
+	// a chunk is run again into an overflow buffer, which what didn't fit is handed out from by later pulls.  Anything
+	// sources refer to must outlive the pulls.
+	class pullWriter
+	{
+	public:
+		typedef bool (*objectSource)(pullWriter& p, objectWriter& o, void* context, size_t index);
+		typedef bool (*arraySource) (pullWriter& p, arrayWriter&  a, void* context, size_t index);
+
+		pullWriter(objectSource root, void* context) : started(false), failed(false), pushed(false), spillBegin(0), spillEnd(0) { frame f = { root, 0, context, 0, false }; stack.push_back(f); }
+		pullWriter(arraySource  root, void* context) : started(false), failed(false), pushed(false), spillBegin(0), spillEnd(0) { frame f = { 0, root, context, 0, false }; stack.push_back(f); }
+
+		// Fills buffer with up to size more bytes of the document, and returns how many.  Always size, until the document
+		// ends (or fails) partway through a chunk - 0 after that.
+		size_t pull(char* buffer, size_t size);
+
+		bool   done()  const { return failed || (stack.empty() && spillBegin == spillEnd); }
+		bool   ok()    const { return !failed; }   // False once the overflow buffer couldn't be allocated
+		size_t depth() const { return stack.size(); } // Scopes still open
+
+		// Opens a child scope, written by source a call at a time once the current call returns.
+		template < typename Key > void object(objectWriter& parent, const Key& key, objectSource source, void* context) { if (hold(parent.w, parent.locked)) { parent.writeKey(key); parent.w.syntax('{'); push(source, 0, context); } }
+		template < typename Key > void array (objectWriter& parent, const Key& key, arraySource  source, void* context) { if (hold(parent.w, parent.locked)) { parent.writeKey(key); parent.w.syntax('['); push(0, source, context); } }
+		void object(arrayWriter& parent, objectSource source, void* context) { if (hold(parent.w, parent.locked)) { comma(parent); parent.w.syntax('{'); push(source, 0, context); } }
+		void array (arrayWriter& parent, arraySource  source, void* context) { if (hold(parent.w, parent.locked)) { comma(parent); parent.w.syntax('['); push(0, source, context); } }
+
+		// Random access containers, an element per call (via writeJsonElement, so listed structs work - see fields.hpp.)
+		template < typename Key, typename Container > void array(objectWriter& parent, const Key& key, const Container& container) { array(parent, key, &elements<Container>, (void*)&container); }
+		template < typename Container > void array(arrayWriter& parent, const Container& container) { array(parent, &elements<Container>, (void*)&container); }
+
+	private:
+		struct frame
+		{
+			objectSource    object; // Exactly one of object and array is set
+			arraySource     array;
+			void*           context;
+			size_t          index;  // Calls that have written a member or element so far
+			bool            needsComma;
+		};
+
+		std::vector<frame>  stack;
+		frame               child;  // Opened by the current call, pushed once its output is kept
+		bool                started;
+		bool                failed;
+		bool                pushed;
+		std::vector<char>   spill;  // Grows to the largest call that didn't fit the rest of a chunk
+		size_t              spillBegin;
+		size_t              spillEnd;
+
+		pullWriter(const pullWriter&);            // Not copyable - sources get handed *this
+		pullWriter& operator=(const pullWriter&);
+
+		template < typename Container > static bool elements(pullWriter&, arrayWriter& a, void* context, size_t index)
+		{
+			const Container& container = *(const Container*)context;
+			if (index >= (size_t)container.size()) return false;
+			writeJsonElement(a, container[index]);
+			return true;
+		}
+
+		bool hold(writer& w, bool& parentLocked)
+		{
+			if (pushed)       { w.error("pullWriter can only open one child scope per call!"); return false; }
+			if (parentLocked) { w.error("pullWriter child scope opened while locked by child writer!"); return false; }
+			parentLocked = true; // Nothing more from this call
+			return true;
+		}
+
+		void comma(arrayWriter& parent)
+		{
+			if (parent.needsComma) parent.w.syntax(',');
+			parent.needsComma = true;
+		}
+
+		void push(objectSource object, arraySource array, void* context)
+		{
+			const frame f = { object, array, context, 0, false };
+			child  = f;
+			pushed = true;
+		}
+
+		// Runs the innermost scope's next call into w.  Nothing changes until commit(...) - it may be run again.
+		void run(writer& w, bool& more, bool& needsComma)
+		{
+			const frame& f = stack.back();
+			pushed = false;
+			if (f.object)
+			{
+				objectWriter o(w, f.needsComma, resumeTag());
+				more       = f.object(*this, o, f.context, f.index) || pushed;
+				needsComma = o.needsComma;
+			}
+			else
+			{
+				arrayWriter a(w, f.needsComma, resumeTag());
+				more       = f.array(*this, a, f.context, f.index) || pushed;
+				needsComma = a.needsComma;
+			}
+			if (!more) w.syntax(f.object ? '}' : ']');
+		}
+
+		void commit(bool more, bool needsComma)
+		{
+			frame& f = stack.back();
+			if (!more) { stack.pop_back(); return; }
+			f.needsComma = needsComma;
+			++f.index;
+			if (pushed) stack.push_back(child);
+		}
+
+		size_t unspill(char* buffer, size_t size)
+		{
+			const size_t n = spillEnd - spillBegin < size ? spillEnd - spillBegin : size;
+			if (n) memcpy(buffer, &spill[spillBegin], n);
+			spillBegin += n;
+			return n;
+		}
+	};
+
+	inline size_t pullWriter::pull(char* buffer, size_t size)
+	{
+		size_t n = unspill(buffer, size);
+		if (!started && n < size && !stack.empty())
+		{
+			buffer[n++] = stack.back().object ? '{' : '[';
+			started = true;
+		}
+
+		while (n < size && !stack.empty() && !failed)
+		{
+			bool more = false, needsComma = false;
+
+			writer w(buffer + n, size - n);
+			run(w, more, needsComma);
+			if (w.position && w.position != w.end) // Fit, with room to spare for the '\0'
+			{
+				n = w.position - buffer;
+				commit(more, needsComma);
+				continue;
+			}
+
+			// Didn't fit:  run it again into the overflow buffer, and hand out as much as does fit now.
+			writer overflow(spill, growTag(), w.required());
+			run(overflow, more, needsComma);
+			if (!overflow) { failed = true; break; }
+			commit(more, needsComma);
+			spillBegin = 0;
+			spillEnd   = overflow.size();
+			n += unspill(buffer + n, size - n);
+		}
+		return n;
+	}
+}} // namespace mmk::json
+
+#endif /* ndef ZMMK_IG_JSON_PULL_HPP */
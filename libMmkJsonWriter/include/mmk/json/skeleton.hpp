@@ -0,0 +1,165 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_SKELETON_HPP
+#define ZMMK_IG_JSON_SKELETON_HPP
+
+#include "writer.hpp"
+
+#if defined(MMK_JSON_WRITER_FORMAT_CBOR) || defined(MMK_JSON_WRITER_FORMAT_MSGPACK)
+	#error mmk/json/skeleton.hpp only writes JSON
+#endif
+
+namespace mmk { namespace json {
+
+	// Where a skeleton's values go:  written into the shape in place of each value that changes per record.
+	inline raw slot() { return raw("\x01", 1); }
+
+	// A record shape rendered once - keys, nesting, commas and all - with slots for its values.  Written with the usual
+	// scopes, so anything that works there works here, and values that never change can be left in:
+	//
+	//     std::vector<char> buffer;
+	//     MMK_JSON_WRITER_GROW_OBJECT(shape, buffer, 0)
+	//     {
+	//         shape("type", "reading");                    // Constant, part of the skeleton
+	//         shape("id", mmk::json::slot());
+	//         MMK_JSON_WRITER_OBJECT_OBJECT(shape, "at") { shape("x", mmk::json::slot()); shape("y", mmk::json::slot()); }
+	//     }
+	//     const mmk::json::skeleton reading(shape.c_str(), shape.size());
+	//
+	//     MMK_JSON_WRITER_ROOT_ARRAY(a, 4096) for (...) MMK_JSON_WRITER_ARRAY_RECORD(a, reading) { a(r.id); a(r.x); a(r.y); }
+	//
+	// Each record is then the text between slots, copied as is, with its values formatted in between - no per key
+	// escaping, commas or brackets to work out.  Values are written as they would be anywhere else, in slot order.
+	class skeleton
+	{
+	public:
+		skeleton(const char* rendered, size_t size)
+		{
+			cuts.push_back(0);
+			for (size_t i = 0; i < size; ++i)
+			{
+				if (rendered[i] == '\x01') cuts.push_back(text.size());
+				else text.push_back(rendered[i]);
+			}
+			cuts.push_back(text.size());
+			text.push_back('\0');
+		}
+
+		size_t slots() const { return cuts.size() - 2; }
+
+	private:
+		template < typename Checks > friend class basic_recordWriter;
+
+		std::vector<char>   text;  // Fragments back to back, slots removed
+		std::vector<size_t> cuts;  // Fragment i is text[cuts[i]] up to text[cuts[i+1]]
+	};
+
+	// A record scope:  the skeleton's first fragment when opened, each value followed by the next fragment after that.
+	// Slots left unfilled are written as null (and, with checks, reported.)
+	template < typename Checks > class basic_recordWriter
+	{
+		writer&         w;
+		bool&           parentLock;
+		const skeleton& shape;
+		size_t          filled;
+
+		ZMMK_JSON_WRITER_SAFE_BOOL(basic_recordWriter) { return !!w.position; }
+
+		void fragment(size_t i)
+		{
+			const size_t before = Checks::counts ? w.produced() : 0;
+			w.fragment(&shape.text[shape.cuts[i]], shape.cuts[i+1] - shape.cuts[i]);
+			if (Checks::counts) w.count(&json::stats::structureBytes, before);
+		}
+
+	public:
+		basic_recordWriter(writer& w, const skeleton& shape)
+			: w         (w)
+			, parentLock(w.locked)
+			, shape     (shape)
+			, filled    (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("recordWriter constructed against already locked writer!"); return; }
+			parentLock = true;
+			fragment(0);
+		}
+
+		basic_recordWriter(basic_arrayWriter<Checks>& parent, const skeleton& shape)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, shape     (shape)
+			, filled    (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("recordWriter constructed against already locked arrayWriter!"); return; }
+			parentLock = true;
+			if (Checks::counts) w.countComma(parent.needsComma);
+			if (parent.needsComma) w.syntax(',');
+			parent.needsComma = true;
+			fragment(0);
+		}
+
+		template < typename Key > basic_recordWriter(basic_objectWriter<Checks>& parent, const Key& key, const skeleton& shape)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, shape     (shape)
+			, filled    (0)
+		{
+			if (Checks::enabled && parentLock) { w.error("recordWriter constructed against already locked objectWriter!"); return; }
+			parentLock = true;
+			parent.writeKey(key);
+			fragment(0);
+		}
+
+		~basic_recordWriter()
+		{
+			if (Checks::enabled && filled != shape.slots()) w.error("recordWriter closed with slots left unfilled!");
+			while (filled < shape.slots()) { w.syntax("null"); fragment(++filled); }
+			parentLock = false;
+			if (&parentLock == &w.locked) w.flush(); // Root record finished
+		}
+
+		template < typename Value > void operator()(const Value& value)
+		{
+			if (Checks::enabled && filled == shape.slots()) { w.error("recordWriter::operator()(...) invoked with every slot filled!"); return; }
+			const size_t before = Checks::counts ? w.produced() : 0;
+			w(value);
+			if (Checks::counts) w.count(writer::tokenOf(value), before);
+			fragment(++filled);
+		}
+
+		void operator()(const char* value, size_t size)
+		{
+			if (Checks::enabled && filled == shape.slots()) { w.error("recordWriter::operator()(...) invoked with every slot filled!"); return; }
+			const size_t before = Checks::counts ? w.produced() : 0;
+			w(value, size);
+			if (Checks::counts) w.count(&json::stats::stringBytes, before);
+			fragment(++filled);
+		}
+	};
+
+	namespace detail
+	{
+		template < typename ArrayWriter > struct checksOf;
+		template < typename Checks > struct checksOf< basic_arrayWriter<Checks> > { typedef Checks type; };
+	}
+
+	typedef basic_recordWriter< detail::checksOf<arrayWriter>::type > recordWriter; // Checked like arrayWriter
+}} // namespace mmk::json
+
+#define MMK_JSON_WRITER_ARRAY_RECORD(  name, skeleton      ) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::recordWriter name ## _record_w = ::mmk::json::recordWriter(name, skeleton     )) if (::mmk::json::recordWriter& name = name ## _record_w) ZMMK_JSON_WARN_UNSUPRESS() /* { ... } */
+#define MMK_JSON_WRITER_OBJECT_RECORD( name, key, skeleton ) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::recordWriter name ## _record_w = ::mmk::json::recordWriter(name, key, skeleton)) if (::mmk::json::recordWriter& name = name ## _record_w) ZMMK_JSON_WARN_UNSUPRESS() /* { ... } */
+
+#endif /* ndef ZMMK_IG_JSON_SKELETON_HPP */
@@ -16,8 +16,15 @@
 #ifndef ZMMK_IG_JSON_WRITER_HPP
 #define ZMMK_IG_JSON_WRITER_HPP
 
+#include <string>
 #include <vector>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+	#define ZMMK_JSON_WRITER_CHAR16_T
+#endif
 
 #define ZMMK_JSON_WRITER_SAFE_BOOL(type)              \
 private:                                              \
@@ -34,29 +41,355 @@ private:                                              \
 namespace mmk { namespace json
 {
 	class writer;
-	class arrayWriter;
-	class objectWriter;
+	class parallel;
+	class pullWriter;
+
+	// Scope check policies:  checked scopes report misuse (writing to a scope while a child scope is open, or opening
+	// two children at once) through writer::error, unchecked scopes compile the checks out.  The macros' shadowing
+	// catches most misuse at compile time either way.  objectWriter and arrayWriter are checked unless
+	// MMK_JSON_WRITER_UNCHECKED is defined - keep that consistent across a program.
+	//
+	// instrumented<...> scopes also count bytes by token and nesting depth into the writer's stats, if it has any - see
+	// MMK_JSON_WRITER_STATS.  Other scopes compile the counting out.
+	struct checked   { static const bool enabled = true;  static const bool counts = false; };
+	struct unchecked { static const bool enabled = false; static const bool counts = false; };
+	template < typename Checks > struct instrumented { static const bool enabled = Checks::enabled; static const bool counts = true; };
+
+	template < typename Checks > class basic_objectWriter;
+	template < typename Checks > class basic_arrayWriter;
+	template < typename Checks > class basic_recordWriter;
+
+	// documentWriter, objectWriter and arrayWriter are what the macros write with:  JSON, unless
+	// MMK_JSON_WRITER_FORMAT_CBOR or MMK_JSON_WRITER_FORMAT_MSGPACK picks a binary format - see binary.hpp.
+#if defined(MMK_JSON_WRITER_FORMAT_CBOR) || defined(MMK_JSON_WRITER_FORMAT_MSGPACK)
+	// Defined by binary.hpp, included at the end
+#elif defined(MMK_JSON_WRITER_STATS) && defined(MMK_JSON_WRITER_UNCHECKED)
+	typedef writer                                      documentWriter;
+	typedef basic_objectWriter<instrumented<unchecked> > objectWriter;
+	typedef basic_arrayWriter <instrumented<unchecked> > arrayWriter;
+#elif defined(MMK_JSON_WRITER_STATS)
+	typedef writer                                      documentWriter;
+	typedef basic_objectWriter<instrumented<checked> >  objectWriter;
+	typedef basic_arrayWriter <instrumented<checked> >  arrayWriter;
+#elif defined(MMK_JSON_WRITER_UNCHECKED)
+	typedef writer                        documentWriter;
+	typedef basic_objectWriter<unchecked> objectWriter;
+	typedef basic_arrayWriter <unchecked> arrayWriter;
+#else
+	typedef writer                        documentWriter;
+	typedef basic_objectWriter<checked>   objectWriter;
+	typedef basic_arrayWriter <checked>   arrayWriter;
+#endif
 
 	struct noKeyTag {};
+	struct growTag  {}; // writer(std::vector<char>&, growTag()) resizes the vector instead of failing on overflow.
+	struct measureTag {}; // writer(measureTag()) stores nothing, it only counts - see writer::required().
+	struct truncateTag {}; // writer(buffer, size, truncateTag()) cuts documents short on overflow - see writer::truncated().
+	struct resumeTag {}; // Scopes pullWriter reopens mid document - see pull.hpp.
+
+	// An object key quoted and escaped ahead of time - see MMK_JSON_KEY.  fragment is ,"key": so that writing a key,
+	// comma included, is a single bounds check and memcpy.
+	struct key
+	{
+		const char* fragment;
+		size_t      size;
 
-	class writer
+		key(const char* fragment, size_t size) : fragment(fragment), size(size) {}
+	};
+
+	// UTF-8 text, copied through as-is instead of \u00XX escaping every byte >= 0x80:  o("name", mmk::json::utf8(name)).
+	// Invalid sequences are replaced with U+FFFD.  Works for keys too.  size is (size_t)-1 for '\0' terminated strings.
+	struct utf8
+	{
+		const char* data;
+		size_t      size;
+
+		explicit utf8(const char* text) : data(text), size((size_t)-1) {}
+		explicit utf8(const std::string& text) : data(text.data()), size(text.size()) {}
+		utf8(const char* text, size_t size) : data(text), size(size) {}
+	};
+
+	// Wide text, transcoded straight into the output:  wchar_t is UTF-16 where it's 16 bits (Windows) and UTF-32 where it's
+	// 32, unsigned short and char16_t are always UTF-16.  Characters beyond ASCII are \uXXXX escaped (keeping output 7-bit,
+	// like const char*) unless you ask for utf8Output.  Unpaired surrogates become U+FFFD.  Works for keys too.
+	// const wchar_t* and std::wstring values are written as wide(value) automatically.
+	struct wide
+	{
+		enum encoding { escaped, utf8Output };
+
+		const void* data;
+		size_t      size;     // In code units, (size_t)-1 for '\0' terminated strings
+		unsigned    unitSize; // 2 or 4 bytes
+		encoding    output;
+
+		explicit wide(const wchar_t*        text,               encoding output = escaped) : data(text),        size((size_t)-1),  unitSize(sizeof(wchar_t)), output(output) {}
+		         wide(const wchar_t*        text,  size_t size, encoding output = escaped) : data(text),        size(size),        unitSize(sizeof(wchar_t)), output(output) {}
+		explicit wide(const std::wstring&   text,               encoding output = escaped) : data(text.data()), size(text.size()), unitSize(sizeof(wchar_t)), output(output) {}
+		explicit wide(const unsigned short* utf16,              encoding output = escaped) : data(utf16),       size((size_t)-1),  unitSize(2),               output(output) {}
+		         wide(const unsigned short* utf16, size_t size, encoding output = escaped) : data(utf16),       size(size),        unitSize(2),               output(output) {}
+#ifdef ZMMK_JSON_WRITER_CHAR16_T
+		explicit wide(const char16_t*       utf16,              encoding output = escaped) : data(utf16),       size((size_t)-1),  unitSize(2),               output(output) {}
+		         wide(const char16_t*       utf16, size_t size, encoding output = escaped) : data(utf16),       size(size),        unitSize(2),               output(output) {}
+		explicit wide(const std::u16string& utf16,              encoding output = escaped) : data(utf16.data()),size(utf16.size()),unitSize(2),               output(output) {}
+#endif
+	};
+
+	// Already serialized JSON, copied in verbatim as a value:  o("device", mmk::json::raw(cachedDeviceJson)).
+	// Nothing is validated - garbage in, garbage out.
+	struct raw
+	{
+		const char* data;
+		size_t      size;
+
+		explicit raw(const char* json) : data(json), size(json ? strlen(json) : 0) {}
+		explicit raw(const std::string& json) : data(json.data()), size(json.size()) {}
+		raw(const char* json, size_t size) : data(json), size(size) {}
+	};
+
+	// Binary data, written as a base64 string:  o("registers", mmk::json::base64(&context, sizeof(context))).  Encoded
+	// straight into the output - no temporary copy, and nothing to escape.  urlSafe uses '-' and '_' for '+' and '/', and
+	// leaves off the '=' padding (RFC 4648 section 5, as in JWTs.)
+	struct base64
 	{
-		char* const     begin;
-		char* const     end;
-		char*           position;
-		bool            locked;
+		enum alphabet { standard, urlSafe };
 
-		friend class objectWriter;
-		friend class arrayWriter;
+		const void* data;
+		size_t      size;
+		alphabet    chars;
+
+		base64(const void* data, size_t size, alphabet chars = standard) : data(data), size(size), chars(chars) {}
+	};
+
+	// Binary data, written as a string of lowercase hex digit pairs:  o("code", mmk::json::hex(instructions, 16)).
+	struct hex
+	{
+		const void* data;
+		size_t      size;
+
+		hex(const void* data, size_t size) : data(data), size(size) {}
+	};
+
+	// Where a streaming writer drains its buffer whenever it fills (and when its root scope closes), so output size is no
+	// longer bounded by the buffer size.  The callback should consume all size bytes, or return false to fail the writer.
+	// Streaming buffers should be at least 32 bytes - numbers are formatted in place and can't be split across flushes.
+	struct sink
+	{
+		typedef bool (*function)(void* context, const char* data, size_t size);
+
+		function    callback;
+		void*       context;
+
+		sink() : callback(0), context(0) {}
+		sink(function callback, void* context) : callback(callback), context(context) {}
+	};
+
+	sink fileSink(FILE* file); // fwrite()s to file
+	sink fdSink(int fd);       // write()s to a raw file descriptor
+
+	// Where a growable writer gets more room:  callback returns the start of at least needed bytes - moved, perhaps, but
+	// with the first used kept - and sets capacity, or returns 0 to fail the writer.  needed is 0 when a root scope closes:
+	// the document is used bytes long, and the result is ignored.  Writers growing a std::vector<char> use one internally,
+	// mmap.hpp's mappedStorage(...) grows a memory mapped file.
+	struct storage
+	{
+		typedef char* (*function)(void* context, size_t used, size_t needed, size_t& capacity);
+
+		function    callback;
+		void*       context;
+
+		storage() : callback(0), context(0) {}
+		storage(function callback, void* context) : callback(callback), context(context) {}
+	};
+
+	// One run of output - laid out like POSIX's struct iovec, so segment arrays can be cast for writev/sendmsg.
+	struct segment
+	{
+		const char* data;
+		size_t      size;
+	};
+
+	// Where a gathering writer records its output: runs of its own buffer, interleaved with references to raw values of
+	// at least threshold bytes, which are never copied.  Once the root scope closes, segments[0, count) spell out the
+	// whole document - referenced memory must outlive them.  Running out of segments fails the writer, like running out
+	// of buffer does.
+	struct gather
+	{
+		segment*    segments;
+		size_t      capacity;
+		size_t      count;
+		size_t      threshold;
+		const char* pending; // Start of the buffer run not recorded as a segment yet
+
+		gather(segment* segments, size_t capacity, size_t threshold = 4096) : segments(segments), capacity(capacity), count(0), threshold(threshold), pending(0) {}
+		template < size_t capacity > explicit gather(segment (&segments)[capacity], size_t threshold = 4096) : segments(segments), capacity(capacity), count(0), threshold(threshold), pending(0) {}
+
+		size_t size() const { size_t bytes = 0; for (size_t i = 0; i < count; ++i) bytes += segments[i].size; return bytes; }
+	};
+
+	bool writeSegments(int fd, const gather& output); // writev()s to a raw file descriptor, resuming partial writes
+
+	// Where misuse and allocation failures are reported - stderr unless a handler is set.  Set it before writing starts:
+	// it isn't synchronized with writers on other threads.
+	typedef void (*errorHandler)(void* context, const char* message);
+	void setErrorHandler(errorHandler handler, void* context = 0); // 0 restores stderr
+	void reportError(const char* message);
+
+	// Counters for a writer, or summed over a process - see MMK_JSON_WRITER_STATS.  Bytes are counted by the scopes that
+	// write them, so writing straight to a writer (pullWriter, parallel) only shows up as escapes, flushes and errors.
+	struct stats
+	{
+		size_t documents;       // Root scopes closed
+		size_t keyBytes;        // Commas, quotes and colons included
+		size_t stringBytes;     // Quotes included - base64 and hex values too
+		size_t numberBytes;     // Commas between bulk array(...) elements included
+		size_t structureBytes;  // Brackets, and commas between array elements
+		size_t otherBytes;      // true, false, null and raw JSON
+		size_t escapes;         // Characters written as escape sequences, in keys and values
+		size_t overflows;       // Documents that outgrew a fixed buffer (or were truncated)
+		size_t neededBytes;     // The most any of those needed - see writer::required()
+		size_t largestDocument; // Bytes, flushed ones included
+		size_t maxDepth;        // Root scope = 1
+		size_t errors;          // Reported through reportError
+		size_t flushedBytes;    // Handed to sinks, or referenced by gather segments, instead of staying in the buffer
+		size_t depth;           // Scopes open right now - 0 in snapshots
+	};
+
+	// A MMK_JSON_WRITER_ROOT (or STREAM, GATHER, ...) in the source, and how big its documents get:  buffers need to be
+	// highWater+1 bytes, for the '\0'.  Statically initialized by the macros, and registered the first time one finishes.
+	struct callSite
+	{
+		const char* file;
+		unsigned    line;
+		const char* name;
+		size_t      bufferSize; // 0 for MEASURE and GROW
+		size_t      documents;
+		size_t      highWater;  // Largest document
+		size_t      overflows;
+		callSite*   next;
+		bool        registered;
+	};
+
+	// Counts for a writer while in scope, then adds itself to the process wide stats (and site's.)  Declared by the
+	// macros when MMK_JSON_WRITER_STATS is defined, but works with any writer - declare it after the writer.
+	class writerStats : public stats
+	{
+		callSite* site;
+
+		writerStats(const writerStats&);
+		writerStats& operator=(const writerStats&);
+	public:
+		explicit writerStats(writer& w, callSite* site = 0);
+		~writerStats();
+	};
+
+	// Snapshots of everything writerStats have added up so far.  Thread safe.
+	stats                   processStats();
+	std::vector<callSite>   callSiteStats(); // In order of first use, next pointers cleared
+	void                    resetStats();    // Call sites are zeroed, but stay registered
+
+	class writer
+	{
+		char*               begin;
+		char*               end;
+		char*               position;
+		bool                locked;
+		sink                output;
+		json::storage       growable;
+		json::gather*       gathering;
+		size_t              skipped;  // Bytes counted instead of stored, once position == end - see required()
+		bool                truncating;
+		bool                dropping;  // Truncated:  everything is dropped but the closing brackets of scopes kept open
+		size_t              dropDepth; // How many of the innermost open scopes were cut off, closing brackets and all
+		json::stats*        counters;  // Only set by writerStats - always here, so the flag doesn't change writer's layout
+
+		template < typename Checks > friend class basic_objectWriter;
+		template < typename Checks > friend class basic_arrayWriter;
+		template < typename Checks > friend class basic_recordWriter;
+		friend class parallel;
+		friend class pullWriter;
+		friend class writerStats;
 
 		void error(const char*);
-		void syntax(const char*);
-		void syntax(char);
+
+		// For instrumented scopes:  bytes written so far (flushed ones included), and which counter a value's bytes go to.
+		typedef size_t json::stats::* counter;
+		size_t produced() const { return !counters ? 0 : counters->flushedBytes + (position == end ? skipped : position ? size_t(position-begin) : 0); }
+		void   count(counter c, size_t before) { const size_t after = produced(); if (counters && after > before) counters->*c += after - before; }
+		void   countComma(bool comma) { if (counters) counters->structureBytes += comma; }
+		void   countOpen(bool comma);
+		void   countClose(bool root);
+
+		template < typename Value > static counter tokenOf(const Value&) { return &json::stats::numberBytes; }
+		static counter tokenOf(const char*)          { return &json::stats::stringBytes; }
+		static counter tokenOf(char*)                { return &json::stats::stringBytes; }
+		static counter tokenOf(const std::string&)   { return &json::stats::stringBytes; }
+		static counter tokenOf(const json::utf8&)    { return &json::stats::stringBytes; }
+		static counter tokenOf(const json::base64&)  { return &json::stats::stringBytes; }
+		static counter tokenOf(const json::hex&)     { return &json::stats::stringBytes; }
+		static counter tokenOf(const wchar_t*)       { return &json::stats::stringBytes; }
+		static counter tokenOf(wchar_t*)             { return &json::stats::stringBytes; }
+		static counter tokenOf(const std::wstring&)  { return &json::stats::stringBytes; }
+		static counter tokenOf(const json::wide&)    { return &json::stats::stringBytes; }
+#ifdef ZMMK_JSON_WRITER_CHAR16_T
+		static counter tokenOf(const char16_t*)      { return &json::stats::stringBytes; }
+#endif
+		static counter tokenOf(bool)                 { return &json::stats::otherBytes; }
+		static counter tokenOf(const json::raw&)     { return &json::stats::otherBytes; }
+		void syntax(const char* s) { write(s, strlen(s)); }
+		void syntax(char ch)       { if (position && end-position > 1) { *position++ = ch; *position = '\0'; } else if (position == end) ++skipped; else overflow(ch); }
+
+		// Inline for the common case, overflow(...) handles growing, flushing, and failing.  Counting (position == end,
+		// see required()) is inline too, so dry runs stay cheap.
+		void write(const char* data, size_t size)
+		{
+			if (position && size < size_t(end-position)) { memcpy(position, data, size); position += size; *position = '\0'; }
+			else if (position == end) skipped += size;
+			else overflow(data, size);
+		}
+		void overflow(const char* data, size_t size);
+		void overflow(char ch);
+
+		// Pre-rendered JSON between values - see skeleton.hpp.  Truncating writers need its brackets one at a time.
+		void fragment(const char* data, size_t size) { if (!truncating) write(data, size); else truncatingFragment(data, size); }
+		void truncatingFragment(const char* data, size_t size);
+		void skip(size_t size);
+		void truncate(char next);
+		bool reserve(size_t size);
+		bool grow(size_t size);
+		static char* growVector(void* context, size_t used, size_t needed, size_t& capacity);
+		void reference(const char* data, size_t size);
+		void escape(const char* value, size_t size, bool utf8 = false);
+		void escapeChar(unsigned char ch);
+		template < typename Unit > void transcode(const Unit* value, size_t size, bool utf8);
+		template < typename Unsigned > void integer(Unsigned magnitude, bool negative);
+		void blob(const unsigned char* data, size_t size, size_t encodedSize, size_t groupIn, size_t groupOut, size_t (*encode)(char*, const unsigned char*, size_t, int), int variant);
+
+		// Comma separated values, with a leading comma if comma is set - for arrayWriter::array(...)'s bulk paths.
+		template < typename Value > void numbers(const Value* values, size_t count, bool comma);
+		void numbers(const   signed int*       values, size_t count, bool comma);
+		void numbers(const unsigned int*       values, size_t count, bool comma);
+		void numbers(const   signed long*      values, size_t count, bool comma);
+		void numbers(const unsigned long*      values, size_t count, bool comma);
+		void numbers(const   signed long long* values, size_t count, bool comma);
+		void numbers(const unsigned long long* values, size_t count, bool comma);
+		void numbers(const float*              values, size_t count, bool comma);
+		void numbers(const double*             values, size_t count, bool comma);
 
 		void operator()(         const char* value);
-		// TODO: Wide string support
+		void operator()(const char* value, size_t size); // May contain '\0's
+		void operator()(const std::string&   value);
+		void operator()(const json::utf8&    value);
+		void operator()(const json::raw&     value);
+		void operator()(const json::base64&  value);
+		void operator()(const json::hex&     value);
+		void operator()(const wchar_t*       value);
+		void operator()(const std::wstring&  value);
+		void operator()(const json::wide&    value);
+#ifdef ZMMK_JSON_WRITER_CHAR16_T
+		void operator()(const char16_t*      value) { (*this)(json::wide(value)); }
+#endif
 
-		void operator()(         bool        value);
+		void operator()(         bool        value) { if (value) write("true", 4); else write("false", 5); }
 
 		// Values smaller than int should auto-promote unambiguously
 		void operator()(unsigned int         value);
@@ -66,114 +399,477 @@ namespace mmk { namespace json
 		void operator()(unsigned long long   value);
 		void operator()(  signed long long   value);
 
+		// Written as the shortest decimal that round-trips (42.0 -> 42, 1e-9 -> 1e-9.)
+		// NaN and infinities have no JSON representation and are written as null.
+		// long double is narrowed to double first - which is what JSON readers will parse it as anyways.
 		void operator()(         float       value);
 		void operator()(         double      value);
 		void operator()(         long double value);
 
-		ZMMK_JSON_WRITER_SAFE_BOOL(writer) { return !!position; }
+		ZMMK_JSON_WRITER_SAFE_BOOL(writer) { return position && (position != end || begin == end); } // Counting is only a failure if there was a buffer
 
 	public:
-		explicit writer(char* buffer, size_t bufferSize)
-			: begin   (buffer+0)
-			, end     (buffer+bufferSize)
-			, position(bufferSize ? buffer+0 : 0)
-			, locked  (false)
+		explicit writer(char* buffer, size_t bufferSize, sink output = sink())
+			: begin     (buffer+0)
+			, end       (buffer+bufferSize)
+			, position  (bufferSize ? buffer+0 : 0)
+			, locked    (false)
+			, output    (output)
+			, growable  ()
+			, gathering (0)
+			, skipped   (0)
+			, truncating(false)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
 		{
 			if (position) position[0] = '\0';
 		}
 
-		template < size_t bufferSize > explicit writer(char (&buffer)[bufferSize])
-			: begin   (buffer+0)
-			, end     (buffer+bufferSize)
-			, position(bufferSize ? buffer+0 : 0)
-			, locked  (false)
+		template < size_t bufferSize > explicit writer(char (&buffer)[bufferSize], sink output = sink())
+			: begin     (buffer+0)
+			, end       (buffer+bufferSize)
+			, position  (bufferSize ? buffer+0 : 0)
+			, locked    (false)
+			, output    (output)
+			, growable  ()
+			, gathering (0)
+			, skipped   (0)
+			, truncating(false)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
 		{
 			if (position) position[0] = '\0';
 		}
 
 		explicit writer(std::vector<char>& buffer)
-			: begin   (buffer.data())
-			, end     (buffer.data()+buffer.size())
-			, position(buffer.size() ? buffer.data() : 0)
-			, locked  (false)
+			: begin     (buffer.data())
+			, end       (buffer.data()+buffer.size())
+			, position  (buffer.size() ? buffer.data() : 0)
+			, locked    (false)
+			, growable  ()
+			, gathering (0)
+			, skipped   (0)
+			, truncating(false)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
 		{
 			if (position) position[0] = '\0';
 		}
 
-		const char* c_str() const { return locked ? 0 : position ? begin : 0; }
-		size_t      size()  const { return locked ? 0 : position ? (position-begin) : 0; }
+		// Grows buffer geometrically as needed, so writing only fails if allocation does.  Pass expectedBytes to size it
+		// up front - when the guess holds, nothing is reallocated.  buffer.size() ends up as the capacity used, not the
+		// output length: that's still size().
+		writer(std::vector<char>& buffer, growTag, size_t expectedBytes = 0)
+			: begin     (0)
+			, end       (0)
+			, position  (0)
+			, locked    (false)
+			, growable  (growVector, &buffer)
+			, gathering (0)
+			, skipped   (0)
+			, truncating(false)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
+		{
+			if (buffer.size() <= expectedBytes) buffer.resize(expectedBytes+1);
+			begin    = &buffer[0];
+			end      = begin + buffer.size();
+			position = begin;
+			position[0] = '\0';
+		}
+
+		// Never fails for lack of room once the root scope is open:  on overflow, output is cut back to the last whole
+		// element that leaves room to close every scope still open there, and only those closing brackets are written from
+		// then on.  The result is valid JSON, just missing its tail - truncated() says if that happened.
+		writer(char* buffer, size_t bufferSize, truncateTag)
+			: begin     (buffer+0)
+			, end       (buffer+bufferSize)
+			, position  (bufferSize ? buffer+0 : 0)
+			, locked    (false)
+			, growable  ()
+			, gathering (0)
+			, skipped   (0)
+			, truncating(true)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
+		{
+			if (position) position[0] = '\0';
+		}
+
+		template < size_t bufferSize > writer(char (&buffer)[bufferSize], truncateTag)
+			: begin     (buffer+0)
+			, end       (buffer+bufferSize)
+			, position  (bufferSize ? buffer+0 : 0)
+			, locked    (false)
+			, growable  ()
+			, gathering (0)
+			, skipped   (0)
+			, truncating(true)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
+		{
+			if (position) position[0] = '\0';
+		}
+
+		// Grows into storage as needed, like a growable std::vector writer - expectedBytes included.
+		explicit writer(json::storage storage, size_t expectedBytes = 0);
+
+		// Runs everything through the usual scopes, but only counts bytes - required() is the exact size to write for.
+		explicit writer(measureTag);
+
+		// Records output in segments instead of copying large raw values - see gather.  c_str() and size() only describe
+		// the buffered part.
+		writer(char* buffer, size_t bufferSize, json::gather& segments)
+			: begin     (buffer+0)
+			, end       (buffer+bufferSize)
+			, position  (bufferSize ? buffer+0 : 0)
+			, locked    (false)
+			, growable  ()
+			, gathering (&segments)
+			, skipped   (0)
+			, truncating(false)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
+		{
+			if (position) position[0] = '\0';
+			segments.count   = 0;
+			segments.pending = begin;
+		}
+
+		template < size_t bufferSize > writer(char (&buffer)[bufferSize], json::gather& segments)
+			: begin     (buffer+0)
+			, end       (buffer+bufferSize)
+			, position  (bufferSize ? buffer+0 : 0)
+			, locked    (false)
+			, growable  ()
+			, gathering (&segments)
+			, skipped   (0)
+			, truncating(false)
+			, dropping  (false)
+			, dropDepth (0)
+			, counters  (0)
+		{
+			if (position) position[0] = '\0';
+			segments.count   = 0;
+			segments.pending = begin;
+		}
+
+		// Drains everything written so far to the sink (a no-op without one) or, when gathering, records it as a segment.
+		// Returns false if the writer has failed.  Root scopes flush automatically when they close.
+		bool flush();
+
+		// With a sink, these only describe the tail that hasn't been flushed yet.
+		const char* c_str() const { return locked ? 0 : position && position != end ? begin : 0; }
+		size_t      size()  const { return locked ? 0 : position && position != end ? (position-begin) : 0; }
+
+		// Length of the whole document, including whatever didn't fit:  fixed buffers without a sink stop storing once
+		// they run out of room, but keep counting.  Retry with a buffer of at least required()+1 bytes (for the '\0'), or
+		// pass it as a growable writer's expectedBytes.  0 if the writer failed for any other reason.
+		bool        truncated() const { return dropping; }
+		size_t      required() const { return locked || !position ? 0 : position == end ? skipped : size_t(position-begin); }
 	};
 
-	class objectWriter
+	inline void writer::countOpen(bool comma)
+	{
+		if (!counters) return;
+		counters->structureBytes += 1 + comma;
+		if (++counters->depth > counters->maxDepth) counters->maxDepth = counters->depth;
+	}
+
+	inline void writer::countClose(bool root)
+	{
+		if (!counters) return;
+		++counters->structureBytes;
+		if (counters->depth) --counters->depth;
+		if (!root) return;
+
+		const size_t bytes = produced();
+		++counters->documents;
+		if (bytes > counters->largestDocument) counters->largestDocument = bytes;
+		if ((position == end && begin != end) || dropping)
+		{
+			++counters->overflows;
+			if (bytes > counters->neededBytes) counters->neededBytes = bytes;
+		}
+	}
+
+	template < typename Checks > class basic_objectWriter
 	{
 		writer& w;
 		bool&   parentLock;
 		bool    locked;
 		bool    needsComma;
+		bool    resumed;
 
-		friend class arrayWriter;
+		friend class basic_arrayWriter<Checks>;
+		friend class basic_recordWriter<Checks>;
+		friend class pullWriter;
 
-		ZMMK_JSON_WRITER_SAFE_BOOL(objectWriter) { return !!w.position; }
+		// Comma (if needed), key, and colon.  Only string-like keys - anything else is a compile time error.
+		template < typename Key > void writeStringKey(const Key& key)
+		{
+			const size_t before = Checks::counts ? w.produced() : 0;
+			if (needsComma) w.syntax(',');
+			needsComma = true;
+			w(key);
+			w.syntax(':');
+			if (Checks::counts) w.count(&json::stats::keyBytes, before);
+		}
 
-	public:
-		objectWriter(writer& w, noKeyTag);
-		objectWriter(arrayWriter& parent, noKeyTag);
-		objectWriter(objectWriter& parent, const char* key);
-		~objectWriter();
+		void writeKey(const char*         key) { writeStringKey(key); }
+		void writeKey(const std::string&  key) { writeStringKey(key); }
+		void writeKey(const json::utf8&   key) { writeStringKey(key); }
+		void writeKey(const wchar_t*      key) { writeStringKey(key); }
+		void writeKey(const json::wide&   key) { writeStringKey(key); }
+#ifdef ZMMK_JSON_WRITER_CHAR16_T
+		void writeKey(const char16_t*     key) { writeStringKey(key); }
+#endif
 
-		template < typename Value > void operator()(const char* key, Value value)
+		void writeKey(const json::key& key)
 		{
-			if (locked) { w.error("objectWriter::operator()(...) invoked while locked by child writer!"); return; }
-			if (needsComma) w.syntax(",");
+			const size_t before = Checks::counts ? w.produced() : 0;
+			w.write(key.fragment + !needsComma, key.size - !needsComma);
 			needsComma = true;
-			w(key);
-			w.syntax(":");
+			if (Checks::counts) w.count(&json::stats::keyBytes, before);
+		}
+
+		ZMMK_JSON_WRITER_SAFE_BOOL(basic_objectWriter) { return !!w.position; }
+
+		// Reopens a scope whose '{' was written by an earlier writer, without writing the '}' either.
+		basic_objectWriter(writer& w, bool needsComma, resumeTag)
+			: w         (w)
+			, parentLock(w.locked)
+			, locked    (false)
+			, needsComma(needsComma)
+			, resumed   (true)
+		{
+			parentLock = true;
+		}
+
+	public:
+		basic_objectWriter(writer& w, noKeyTag)
+			: w         (w)
+			, parentLock(w.locked)
+			, locked    (false)
+			, needsComma(false)
+			, resumed   (false)
+		{
+			if (Checks::enabled && parentLock) { w.error("objectWriter constructed against already locked writer!"); return; }
+			parentLock = true;
+			w.syntax('{');
+			if (Checks::counts) w.countOpen(false);
+		}
+
+		basic_objectWriter(basic_arrayWriter<Checks>& parent, noKeyTag)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, needsComma(false)
+			, resumed   (false)
+		{
+			if (Checks::enabled && parentLock) { w.error("objectWriter constructed against already locked arrayWriter!"); return; }
+			parentLock = true;
+			if (Checks::counts) w.countOpen(parent.needsComma);
+			if (parent.needsComma) w.syntax(',');
+			parent.needsComma = true;
+			w.syntax('{');
+		}
+
+		template < typename Key > basic_objectWriter(basic_objectWriter& parent, const Key& key)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, needsComma(false)
+			, resumed   (false)
+		{
+			if (Checks::enabled && parentLock) { w.error("objectWriter constructed against already locked objectWriter!"); return; }
+			parentLock = true;
+			parent.writeKey(key);
+			w.syntax('{');
+			if (Checks::counts) w.countOpen(false);
+		}
+
+		~basic_objectWriter()
+		{
+			if (resumed) { parentLock = false; return; }
+			w.syntax('}');
+			if (Checks::counts) w.countClose(&parentLock == &w.locked);
+			parentLock = false;
+			if (&parentLock == &w.locked) w.flush(); // Root scope finished
+		}
+
+		template < typename Key, typename Value > void operator()(const Key& key, const Value& value)
+		{
+			if (Checks::enabled && locked) { w.error("objectWriter::operator()(...) invoked while locked by child writer!"); return; }
+			writeKey(key);
+			const size_t before = Checks::counts ? w.produced() : 0;
 			w(value);
+			if (Checks::counts) w.count(writer::tokenOf(value), before);
 		}
 
-		template < typename Container > void array(const char* key, const Container& container);
+		template < typename Key > void operator()(const Key& key, const char* value, size_t size)
+		{
+			if (Checks::enabled && locked) { w.error("objectWriter::operator()(...) invoked while locked by child writer!"); return; }
+			writeKey(key);
+			const size_t before = Checks::counts ? w.produced() : 0;
+			w(value, size);
+			if (Checks::counts) w.count(&json::stats::stringBytes, before);
+		}
+
+		// Arrays of numbers (std::vector, C arrays, or pointer and count) take a bulk path with no per element overhead.
+		template < typename Key, typename Container > void array(const Key& key, const Container& container);
+		template < typename Key, typename Value, typename Allocator > void array(const Key& key, const std::vector<Value, Allocator>& values) { basic_arrayWriter<Checks> child(*this, key); child.values(values.empty() ? 0 : &values[0], values.size()); }
+		template < typename Key, typename Allocator > void array(const Key& key, const std::vector<bool, Allocator>& values) { basic_arrayWriter<Checks> child(*this, key); for (size_t i = 0; i < values.size(); ++i) child((bool)values[i]); }
+		template < typename Key, typename Value, size_t N > void array(const Key& key, const Value (&values)[N]) { basic_arrayWriter<Checks> child(*this, key); child.values(values, N); }
+		template < typename Key, typename Value > void array(const Key& key, const Value* values, size_t count) { basic_arrayWriter<Checks> child(*this, key); child.values(values, count); }
 	};
 
-	class arrayWriter
+	template < typename Checks > class basic_arrayWriter
 	{
 		writer& w;
 		bool&   parentLock;
 		bool    locked;
 		bool    needsComma;
+		bool    resumed;
+
+		friend class basic_objectWriter<Checks>;
+		friend class basic_recordWriter<Checks>;
+		friend class parallel;
+		friend class pullWriter;
+
+		ZMMK_JSON_WRITER_SAFE_BOOL(basic_arrayWriter) { return !!w.position; }
+
+		// Reopens a scope whose '[' was written by an earlier writer, without writing the ']' either.
+		basic_arrayWriter(writer& w, bool needsComma, resumeTag)
+			: w         (w)
+			, parentLock(w.locked)
+			, locked    (false)
+			, needsComma(needsComma)
+			, resumed   (true)
+		{
+			parentLock = true;
+		}
 
-		friend class objectWriter;
-
-		ZMMK_JSON_WRITER_SAFE_BOOL(arrayWriter) { return !!w.position; }
+		template < typename Value > void values(const Value* data, size_t count) { for (size_t i = 0; i < count; ++i) (*this)(data[i]); }
+		void values(const   signed int*       data, size_t count) { numbers(data, count); }
+		void values(const unsigned int*       data, size_t count) { numbers(data, count); }
+		void values(const   signed long*      data, size_t count) { numbers(data, count); }
+		void values(const unsigned long*      data, size_t count) { numbers(data, count); }
+		void values(const   signed long long* data, size_t count) { numbers(data, count); }
+		void values(const unsigned long long* data, size_t count) { numbers(data, count); }
+		void values(const float*              data, size_t count) { numbers(data, count); }
+		void values(const double*             data, size_t count) { numbers(data, count); }
+
+		template < typename Value > void numbers(const Value* data, size_t count)
+		{
+			if (Checks::enabled && locked) { w.error("arrayWriter::array(...) invoked while locked by child writer!"); return; }
+			const size_t before = Checks::counts ? w.produced() : 0;
+			w.numbers(data, count, needsComma);
+			if (Checks::counts) w.count(&json::stats::numberBytes, before);
+			needsComma = needsComma || count;
+		}
 
 	public:
-		explicit arrayWriter(writer& w, noKeyTag);
-		explicit arrayWriter(arrayWriter& parent, noKeyTag);
-		arrayWriter(objectWriter& parent, const char* key);
-		~arrayWriter();
+		explicit basic_arrayWriter(writer& w, noKeyTag)
+			: w         (w)
+			, parentLock(w.locked)
+			, locked    (false)
+			, needsComma(false)
+			, resumed   (false)
+		{
+			if (Checks::enabled && parentLock) { w.error("arrayWriter constructed against already locked writer!"); return; }
+			parentLock = true;
+			w.syntax('[');
+			if (Checks::counts) w.countOpen(false);
+		}
+
+		explicit basic_arrayWriter(basic_arrayWriter& parent, noKeyTag)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, needsComma(false)
+			, resumed   (false)
+		{
+			if (Checks::enabled && parentLock) { w.error("arrayWriter constructed against already locked arrayWriter!"); return; }
+			parentLock = true;
+			if (Checks::counts) w.countOpen(parent.needsComma);
+			if (parent.needsComma) w.syntax(',');
+			parent.needsComma = true;
+			w.syntax('[');
+		}
+
+		template < typename Key > basic_arrayWriter(basic_objectWriter<Checks>& parent, const Key& key)
+			: w         (parent.w)
+			, parentLock(parent.locked)
+			, locked    (false)
+			, needsComma(false)
+			, resumed   (false)
+		{
+			if (Checks::enabled && parentLock) { w.error("arrayWriter constructed against already locked objectWriter!"); return; }
+			parentLock = true;
+			parent.writeKey(key);
+			w.syntax('[');
+			if (Checks::counts) w.countOpen(false);
+		}
+
+		~basic_arrayWriter()
+		{
+			if (resumed) { parentLock = false; return; }
+			w.syntax(']');
+			if (Checks::counts) w.countClose(&parentLock == &w.locked);
+			parentLock = false;
+			if (&parentLock == &w.locked) w.flush(); // Root scope finished
+		}
 
-		template < typename Value > void operator()(Value value)
+		template < typename Value > void operator()(const Value& value)
 		{
-			if (locked) { w.error("arrayWriter::operator()(...) invoked while locked by child writer!"); return; }
-			if (needsComma) w.syntax(",");
+			if (Checks::enabled && locked) { w.error("arrayWriter::operator()(...) invoked while locked by child writer!"); return; }
+			if (Checks::counts) w.countComma(needsComma);
+			if (needsComma) w.syntax(',');
 			needsComma = true;
+			const size_t before = Checks::counts ? w.produced() : 0;
 			w(value);
+			if (Checks::counts) w.count(writer::tokenOf(value), before);
+		}
+
+		void operator()(const char* value, size_t size)
+		{
+			if (Checks::enabled && locked) { w.error("arrayWriter::operator()(...) invoked while locked by child writer!"); return; }
+			if (Checks::counts) w.countComma(needsComma);
+			if (needsComma) w.syntax(',');
+			needsComma = true;
+			const size_t before = Checks::counts ? w.produced() : 0;
+			w(value, size);
+			if (Checks::counts) w.count(&json::stats::stringBytes, before);
 		}
 
+		// Arrays of numbers (std::vector, C arrays, or pointer and count) take a bulk path with no per element overhead.
 		template < typename Container > void array(const Container& container);
+		template < typename Value, typename Allocator > void array(const std::vector<Value, Allocator>& values) { basic_arrayWriter child(*this, noKeyTag()); child.values(values.empty() ? 0 : &values[0], values.size()); }
+		template < typename Allocator > void array(const std::vector<bool, Allocator>& values) { basic_arrayWriter child(*this, noKeyTag()); for (size_t i = 0; i < values.size(); ++i) child((bool)values[i]); }
+		template < typename Value, size_t N > void array(const Value (&values)[N]) { basic_arrayWriter child(*this, noKeyTag()); child.values(values, N); }
+		template < typename Value > void array(const Value* values, size_t count) { basic_arrayWriter child(*this, noKeyTag()); child.values(values, count); }
 	};
 
-	template < typename Container >
-	void objectWriter::array(const char* key, const Container& container)
+	template < typename Checks > template < typename Key, typename Container >
+	void basic_objectWriter<Checks>::array(const Key& key, const Container& container)
 	{
-		arrayWriter child(*this, key);
+		basic_arrayWriter<Checks> child(*this, key);
 		const typename Container::const_iterator end=container.end();
 		for (typename Container::const_iterator i=container.begin(); i != end; ++i) child(*i);
 	}
 
-	template < typename Container >
-	void arrayWriter::array(const Container& container)
+	template < typename Checks > template < typename Container >
+	void basic_arrayWriter<Checks>::array(const Container& container)
 	{
-		arrayWriter child(*this, noKeyTag());
+		basic_arrayWriter<Checks> child(*this, noKeyTag());
 		const typename Container::const_iterator end=container.end();
 		for (typename Container::const_iterator i=container.begin(); i != end; ++i) child(*i);
 	}
@@ -201,12 +897,49 @@ namespace mmk { namespace json
 	#define ZMMK_JSON_WARN_UNSUPRESS()
 #endif
 
+// Pre-escapes an object key at compile time: o(MMK_JSON_KEY("id"), 42).  The literal is pasted between quotes as-is,
+// so it must already be valid JSON string contents - plain ASCII keys are, anything else needs escaping by hand.
+#define MMK_JSON_KEY(literal) ::mmk::json::key(",\"" literal "\":", sizeof(",\"" literal "\":")-1)
+
+// Defining MMK_JSON_WRITER_STATS (everywhere, like MMK_JSON_WRITER_UNCHECKED) makes the scopes instrumented, and has the
+// root macros below count each writer with a writerStats - name_stats - reporting to a callSite for that line.  The
+// library itself doesn't need rebuilding.  Binary formats aren't counted.
+#if defined(MMK_JSON_WRITER_STATS) && !defined(MMK_JSON_WRITER_FORMAT_CBOR) && !defined(MMK_JSON_WRITER_FORMAT_MSGPACK)
+	#define ZMMK_JSON_WRITER_STATS(name, size) ; static ::mmk::json::callSite name ## _site = { __FILE__, __LINE__, #name, size, 0, 0, 0, 0, false }; ::mmk::json::writerStats name ## _stats( name, &name ## _site )
+#else
+	#define ZMMK_JSON_WRITER_STATS(name, size)
+#endif
+
 #define MMK_JSON_WRITER_ARRAY_ARRAY(   name       ) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::arrayWriter  name ## _array_w  = ::mmk::json::arrayWriter (name, ::mmk::json::noKeyTag() )) if (::mmk::json::arrayWriter&  name = name ## _array_w ) ZMMK_JSON_WARN_UNSUPRESS() /* { ... } */
 #define MMK_JSON_WRITER_OBJECT_ARRAY(  name, key  ) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::arrayWriter  name ## _array_w  = ::mmk::json::arrayWriter (name, key                     )) if (::mmk::json::arrayWriter&  name = name ## _array_w ) ZMMK_JSON_WARN_UNSUPRESS() /* { ... } */
 #define MMK_JSON_WRITER_ARRAY_OBJECT(  name       ) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::objectWriter name ## _object_w = ::mmk::json::objectWriter(name, ::mmk::json::noKeyTag() )) if (::mmk::json::objectWriter& name = name ## _object_w) ZMMK_JSON_WARN_UNSUPRESS() /* { ... } */
 #define MMK_JSON_WRITER_OBJECT_OBJECT( name, key  ) ZMMK_JSON_WARN_SUPRESS() if (::mmk::json::objectWriter name ## _object_w = ::mmk::json::objectWriter(name, key                     )) if (::mmk::json::objectWriter& name = name ## _object_w) ZMMK_JSON_WARN_UNSUPRESS() /* { ... } */
-#define MMK_JSON_WRITER_ROOT(          name, size ) char name ## _buf [size]; ::mmk::json::writer name( name ## _buf )
+#define MMK_JSON_WRITER_ROOT(          name, size ) char name ## _buf [size]; ::mmk::json::documentWriter name( name ## _buf ) ZMMK_JSON_WRITER_STATS(name, size)
 #define MMK_JSON_WRITER_ROOT_OBJECT(   name, size ) MMK_JSON_WRITER_ROOT(name, size); MMK_JSON_WRITER_ARRAY_OBJECT(name) /* { ... } */
 #define MMK_JSON_WRITER_ROOT_ARRAY(    name, size ) MMK_JSON_WRITER_ROOT(name, size); MMK_JSON_WRITER_ARRAY_ARRAY(name)  /* { ... } */
+#define MMK_JSON_WRITER_STREAM(        name, size, sink ) char name ## _buf [size]; ::mmk::json::documentWriter name( name ## _buf, sink ) ZMMK_JSON_WRITER_STATS(name, size)
+#define MMK_JSON_WRITER_STREAM_OBJECT( name, size, sink ) MMK_JSON_WRITER_STREAM(name, size, sink); MMK_JSON_WRITER_ARRAY_OBJECT(name) /* { ... } */
+#define MMK_JSON_WRITER_STREAM_ARRAY(  name, size, sink ) MMK_JSON_WRITER_STREAM(name, size, sink); MMK_JSON_WRITER_ARRAY_ARRAY(name)  /* { ... } */
+#if defined(MMK_JSON_WRITER_FORMAT_CBOR) || defined(MMK_JSON_WRITER_FORMAT_MSGPACK) // Gathering and truncating are JSON only - fail with a name that says so
+#define MMK_JSON_WRITER_GATHER(        name, size, gather ) typedef char MMK_JSON_WRITER_GATHER_is_JSON_only[-1]
+#define MMK_JSON_WRITER_TRUNCATE(      name, size ) typedef char MMK_JSON_WRITER_TRUNCATE_is_JSON_only[-1]
+#else
+#define MMK_JSON_WRITER_GATHER(        name, size, gather ) char name ## _buf [size]; ::mmk::json::documentWriter name( name ## _buf, gather ) ZMMK_JSON_WRITER_STATS(name, size)
+#define MMK_JSON_WRITER_TRUNCATE(      name, size ) char name ## _buf [size]; ::mmk::json::documentWriter name( name ## _buf, ::mmk::json::truncateTag() ) ZMMK_JSON_WRITER_STATS(name, size)
+#endif
+#define MMK_JSON_WRITER_GATHER_OBJECT( name, size, gather ) MMK_JSON_WRITER_GATHER(name, size, gather); MMK_JSON_WRITER_ARRAY_OBJECT(name) /* { ... } */
+#define MMK_JSON_WRITER_GATHER_ARRAY(  name, size, gather ) MMK_JSON_WRITER_GATHER(name, size, gather); MMK_JSON_WRITER_ARRAY_ARRAY(name)  /* { ... } */
+#define MMK_JSON_WRITER_TRUNCATE_OBJECT(name, size ) MMK_JSON_WRITER_TRUNCATE(name, size); MMK_JSON_WRITER_ARRAY_OBJECT(name) /* { ... } */
+#define MMK_JSON_WRITER_TRUNCATE_ARRAY( name, size ) MMK_JSON_WRITER_TRUNCATE(name, size); MMK_JSON_WRITER_ARRAY_ARRAY(name)  /* { ... } */
+#define MMK_JSON_WRITER_MEASURE(       name       ) ::mmk::json::documentWriter name( (::mmk::json::measureTag()) ) ZMMK_JSON_WRITER_STATS(name, 0)
+#define MMK_JSON_WRITER_MEASURE_OBJECT(name       ) MMK_JSON_WRITER_MEASURE(name); MMK_JSON_WRITER_ARRAY_OBJECT(name) /* { ... } */
+#define MMK_JSON_WRITER_MEASURE_ARRAY( name       ) MMK_JSON_WRITER_MEASURE(name); MMK_JSON_WRITER_ARRAY_ARRAY(name)  /* { ... } */
+#define MMK_JSON_WRITER_GROW(          name, vector, expectedBytes ) ::mmk::json::documentWriter name( vector, ::mmk::json::growTag(), expectedBytes ) ZMMK_JSON_WRITER_STATS(name, 0)
+#define MMK_JSON_WRITER_GROW_OBJECT(   name, vector, expectedBytes ) MMK_JSON_WRITER_GROW(name, vector, expectedBytes); MMK_JSON_WRITER_ARRAY_OBJECT(name) /* { ... } */
+#define MMK_JSON_WRITER_GROW_ARRAY(    name, vector, expectedBytes ) MMK_JSON_WRITER_GROW(name, vector, expectedBytes); MMK_JSON_WRITER_ARRAY_ARRAY(name)  /* { ... } */
+
+#if defined(MMK_JSON_WRITER_FORMAT_CBOR) || defined(MMK_JSON_WRITER_FORMAT_MSGPACK)
+#include "binary.hpp"
+#endif
 
 #endif /* ndef ZMMK_IG_JSON_WRITER_HPP */
@@ -0,0 +1,471 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Shortest round-trip float formatting, after Ulf Adams' "Ryu: Fast Float-to-String Conversion" (PLDI 2018.)
+// Finds the shortest decimal within the rounding interval of the input (closest to the exact value on ties) using only
+// integer arithmetic - no printf, no locale, no allocations.
+
+#include "dtoa.hpp"
+#include "dtoa_tables.hpp"
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace mmk { namespace json { namespace detail
+{
+	namespace
+	{
+		typedef unsigned int       uint32;
+		typedef unsigned long long uint64;
+
+		// C++03 static_assert
+		typedef char uint32IsThirtyTwoBits[sizeof(uint32) == 4 && sizeof(float) == 4 ? 1 : -1];
+		typedef char uint64IsSixtyFourBits[sizeof(uint64) == 8 && sizeof(double) == 8 ? 1 : -1];
+
+		// ceil(log2(5^e)) for 0 < e <= 3528, 1 for e == 0
+		inline int    pow5bits (int e) { return (int)(((uint32)e * 1217359) >> 19) + 1; }
+		// floor(log10(2^e)) for 0 <= e <= 1650
+		inline uint32 log10Pow2(int e) { return ((uint32)e * 78913) >> 18; }
+		// floor(log10(5^e)) for 0 <= e <= 2620
+		inline uint32 log10Pow5(int e) { return ((uint32)e * 732923) >> 20; }
+
+		template < typename Unsigned > inline uint32 pow5Factor(Unsigned value)
+		{
+			uint32 count = 0;
+			while (value % 5 == 0) { value /= 5; ++count; }
+			return count;
+		}
+
+		template < typename Unsigned > inline bool multipleOfPowerOf5(Unsigned value, uint32 p) { return pow5Factor(value) >= p; }
+		template < typename Unsigned > inline bool multipleOfPowerOf2(Unsigned value, uint32 p) { return (value & ((Unsigned(1) << p) - 1)) == 0; }
+
+
+
+		// Double (64-bit) core
+
+		inline uint64 umul128(uint64 a, uint64 b, uint64* productHi)
+		{
+#if defined(__SIZEOF_INT128__)
+			__extension__ typedef unsigned __int128 uint128;
+			const uint128 product = (uint128)a * b;
+			*productHi = (uint64)(product >> 64);
+			return (uint64)product;
+#elif defined(_MSC_VER) && defined(_M_X64)
+			return _umul128(a, b, productHi);
+#else
+			const uint32 aLo = (uint32)a, aHi = (uint32)(a >> 32);
+			const uint32 bLo = (uint32)b, bHi = (uint32)(b >> 32);
+
+			const uint64 b00 = (uint64)aLo * bLo;
+			const uint64 b01 = (uint64)aLo * bHi;
+			const uint64 b10 = (uint64)aHi * bLo;
+			const uint64 b11 = (uint64)aHi * bHi;
+
+			const uint64 mid1 = b10 + (b00 >> 32);
+			const uint64 mid2 = b01 + (uint32)mid1;
+
+			*productHi = b11 + (mid1 >> 32) + (mid2 >> 32);
+			return (mid2 << 32) | (uint32)b00;
+#endif
+		}
+
+		// (m * mul) >> j, where mul is 128-bit and 64 < j < 128
+		inline uint64 mulShift64(uint64 m, const uint64* mul, int j)
+		{
+			uint64 high1;
+			const uint64 low1 = umul128(m, mul[1], &high1);
+			uint64 high0;
+			umul128(m, mul[0], &high0);
+			const uint64 sum = high0 + low1;
+			if (sum < high0) ++high1;
+			const int shift = j - 64;
+			return (high1 << (64 - shift)) | (sum >> shift);
+		}
+
+		// Decimal mantissa * 10^exponent.
+		struct decimal
+		{
+			uint64 mantissa;
+			int    exponent;
+		};
+
+		decimal doubleToDecimal(uint64 ieeeMantissa, uint32 ieeeExponent)
+		{
+			const int mantissaBits = 52;
+			const int bias         = 1023;
+
+			// Step 1: Decode, shifting left by 2 to leave room for the half-way points of the rounding interval.
+			int    e2;
+			uint64 m2;
+			if (ieeeExponent == 0)
+			{
+				e2 = 1 - bias - mantissaBits - 2;
+				m2 = ieeeMantissa;
+			}
+			else
+			{
+				e2 = (int)ieeeExponent - bias - mantissaBits - 2;
+				m2 = (1ull << mantissaBits) | ieeeMantissa;
+			}
+			const bool acceptBounds = (m2 & 1) == 0; // Round-half-even parsers will accept the interval endpoints of even mantissas
+
+			// Step 2: The interval of valid decimal representations is [mm, mp] (scaled by 4.)  The lower bound is closer at powers of 2.
+			const uint64 mv      = 4 * m2;
+			const uint32 mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+
+			// Step 3: Convert to a decimal power base.
+			uint64 vr, vp, vm;
+			int    e10;
+			bool   vmIsTrailingZeros = false;
+			bool   vrIsTrailingZeros = false;
+			if (e2 >= 0)
+			{
+				const uint32 q = log10Pow2(e2) - (e2 > 3);
+				e10 = (int)q;
+				const int k = doublePow5InvBitcount + pow5bits((int)q) - 1;
+				const int i = -e2 + (int)q + k;
+				vr = mulShift64(4 * m2,                doublePow5InvSplit[q], i);
+				vp = mulShift64(4 * m2 + 2,            doublePow5InvSplit[q], i);
+				vm = mulShift64(4 * m2 - 1 - mmShift,  doublePow5InvSplit[q], i);
+				if (q <= 21)
+				{
+					// Only one of mp, mv, and mm can be a multiple of 5, if any.
+					if (mv % 5 == 0)        vrIsTrailingZeros = multipleOfPowerOf5(mv, q);
+					else if (acceptBounds)  vmIsTrailingZeros = multipleOfPowerOf5(mv - 1 - mmShift, q);
+					else                    vp -= multipleOfPowerOf5(mv + 2, q);
+				}
+			}
+			else
+			{
+				const uint32 q = log10Pow5(-e2) - (-e2 > 1);
+				e10 = (int)q + e2;
+				const int i = -e2 - (int)q;
+				const int k = pow5bits(i) - doublePow5Bitcount;
+				const int j = (int)q - k;
+				vr = mulShift64(4 * m2,                doublePow5Split[i], j);
+				vp = mulShift64(4 * m2 + 2,            doublePow5Split[i], j);
+				vm = mulShift64(4 * m2 - 1 - mmShift,  doublePow5Split[i], j);
+				if (q <= 1)
+				{
+					// mv = 4 * m2 always has at least two trailing 0 bits.
+					vrIsTrailingZeros = true;
+					if (acceptBounds)   vmIsTrailingZeros = mmShift == 1; // mm = mv - 1 - mmShift has 1 trailing 0 bit iff mmShift == 1.
+					else                --vp;                               // mp = mv + 2 always has at least one trailing 0 bit.
+				}
+				else if (q < 63)
+				{
+					vrIsTrailingZeros = multipleOfPowerOf2(mv, q);
+				}
+			}
+
+			// Step 4: Find the shortest decimal representation in the interval.
+			int    removed          = 0;
+			uint32 lastRemovedDigit = 0;
+			uint64 output;
+			if (vmIsTrailingZeros || vrIsTrailingZeros)
+			{
+				// General case (~0.7%)
+				while (vp / 10 > vm / 10)
+				{
+					vmIsTrailingZeros &= vm % 10 == 0;
+					vrIsTrailingZeros &= lastRemovedDigit == 0;
+					lastRemovedDigit = (uint32)(vr % 10);
+					vr /= 10; vp /= 10; vm /= 10;
+					++removed;
+				}
+				if (vmIsTrailingZeros)
+				{
+					while (vm % 10 == 0)
+					{
+						vrIsTrailingZeros &= lastRemovedDigit == 0;
+						lastRemovedDigit = (uint32)(vr % 10);
+						vr /= 10; vp /= 10; vm /= 10;
+						++removed;
+					}
+				}
+				if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) lastRemovedDigit = 4; // Exactly .5 - round to even
+				output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) || lastRemovedDigit >= 5);
+			}
+			else
+			{
+				// Common case (~99.3%)
+				bool roundUp = false;
+				if (vp / 100 > vm / 100)
+				{
+					roundUp = vr % 100 >= 50;
+					vr /= 100; vp /= 100; vm /= 100;
+					removed += 2;
+				}
+				while (vp / 10 > vm / 10)
+				{
+					roundUp = vr % 10 >= 5;
+					vr /= 10; vp /= 10; vm /= 10;
+					++removed;
+				}
+				output = vr + (vr == vm || roundUp);
+			}
+
+			decimal result;
+			result.mantissa = output;
+			result.exponent = e10 + removed;
+			return result;
+		}
+
+
+
+		// Float (32-bit) core
+
+		// (m * factor) >> shift, where shift > 32
+		inline uint32 mulShift32(uint32 m, uint64 factor, int shift)
+		{
+			const uint64 bits0 = (uint64)m * (uint32)factor;
+			const uint64 bits1 = (uint64)m * (uint32)(factor >> 32);
+			return (uint32)(((bits0 >> 32) + bits1) >> (shift - 32));
+		}
+
+		inline uint32 mulPow5InvDivPow2(uint32 m, uint32 q, int j) { return mulShift32(m, floatPow5InvSplit[q], j); }
+		inline uint32 mulPow5DivPow2   (uint32 m, uint32 i, int j) { return mulShift32(m, floatPow5Split[i],    j); }
+
+		decimal floatToDecimal(uint32 ieeeMantissa, uint32 ieeeExponent)
+		{
+			const int mantissaBits = 23;
+			const int bias         = 127;
+
+			int    e2;
+			uint32 m2;
+			if (ieeeExponent == 0)
+			{
+				e2 = 1 - bias - mantissaBits - 2;
+				m2 = ieeeMantissa;
+			}
+			else
+			{
+				e2 = (int)ieeeExponent - bias - mantissaBits - 2;
+				m2 = (1u << mantissaBits) | ieeeMantissa;
+			}
+			const bool acceptBounds = (m2 & 1) == 0;
+
+			const uint32 mv      = 4 * m2;
+			const uint32 mp      = 4 * m2 + 2;
+			const uint32 mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+			const uint32 mm      = 4 * m2 - 1 - mmShift;
+
+			uint32 vr, vp, vm;
+			int    e10;
+			bool   vmIsTrailingZeros = false;
+			bool   vrIsTrailingZeros = false;
+			uint32 lastRemovedDigit  = 0;
+			if (e2 >= 0)
+			{
+				const uint32 q = log10Pow2(e2);
+				e10 = (int)q;
+				const int k = floatPow5InvBitcount + pow5bits((int)q) - 1;
+				const int i = -e2 + (int)q + k;
+				vr = mulPow5InvDivPow2(mv, q, i);
+				vp = mulPow5InvDivPow2(mp, q, i);
+				vm = mulPow5InvDivPow2(mm, q, i);
+				if (q != 0 && (vp - 1) / 10 <= vm / 10)
+				{
+					// We need to know one removed digit even if we aren't going to loop below.
+					const int l = floatPow5InvBitcount + pow5bits((int)(q - 1)) - 1;
+					lastRemovedDigit = mulPow5InvDivPow2(mv, q - 1, -e2 + (int)q - 1 + l) % 10;
+				}
+				if (q <= 9)
+				{
+					if (mv % 5 == 0)        vrIsTrailingZeros = multipleOfPowerOf5(mv, q);
+					else if (acceptBounds)  vmIsTrailingZeros = multipleOfPowerOf5(mm, q);
+					else                    vp -= multipleOfPowerOf5(mp, q);
+				}
+			}
+			else
+			{
+				const uint32 q = log10Pow5(-e2);
+				e10 = (int)q + e2;
+				const int i = -e2 - (int)q;
+				const int k = pow5bits(i) - floatPow5Bitcount;
+				int j = (int)q - k;
+				vr = mulPow5DivPow2(mv, (uint32)i, j);
+				vp = mulPow5DivPow2(mp, (uint32)i, j);
+				vm = mulPow5DivPow2(mm, (uint32)i, j);
+				if (q != 0 && (vp - 1) / 10 <= vm / 10)
+				{
+					j = (int)q - 1 - (pow5bits(i + 1) - floatPow5Bitcount);
+					lastRemovedDigit = mulPow5DivPow2(mv, (uint32)(i + 1), j) % 10;
+				}
+				if (q <= 1)
+				{
+					vrIsTrailingZeros = true;
+					if (acceptBounds)   vmIsTrailingZeros = mmShift == 1;
+					else                --vp;
+				}
+				else if (q < 31)
+				{
+					vrIsTrailingZeros = multipleOfPowerOf2(mv, q - 1);
+				}
+			}
+
+			int    removed = 0;
+			uint32 output;
+			if (vmIsTrailingZeros || vrIsTrailingZeros)
+			{
+				while (vp / 10 > vm / 10)
+				{
+					vmIsTrailingZeros &= vm % 10 == 0;
+					vrIsTrailingZeros &= lastRemovedDigit == 0;
+					lastRemovedDigit = vr % 10;
+					vr /= 10; vp /= 10; vm /= 10;
+					++removed;
+				}
+				if (vmIsTrailingZeros)
+				{
+					while (vm % 10 == 0)
+					{
+						vrIsTrailingZeros &= lastRemovedDigit == 0;
+						lastRemovedDigit = vr % 10;
+						vr /= 10; vp /= 10; vm /= 10;
+						++removed;
+					}
+				}
+				if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) lastRemovedDigit = 4;
+				output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) || lastRemovedDigit >= 5);
+			}
+			else
+			{
+				while (vp / 10 > vm / 10)
+				{
+					lastRemovedDigit = vr % 10;
+					vr /= 10; vp /= 10; vm /= 10;
+					++removed;
+				}
+				output = vr + (vr == vm || lastRemovedDigit >= 5);
+			}
+
+			decimal result;
+			result.mantissa = output;
+			result.exponent = e10 + removed;
+			return result;
+		}
+
+
+
+		const char digitPairs[] =
+			"0001020304050607080910111213141516171819"
+			"2021222324252627282930313233343536373839"
+			"4041424344454647484950515253545556575859"
+			"6061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+
+		// JSON layout, following ECMAScript's Number::toString rules (so output matches JSON.stringify), minus the
+		// redundant '+' in positive exponents: 42, 0.1, 1.5e-7, 1e21
+		size_t formatDecimal(char* out, bool negative, decimal value)
+		{
+			uint64 mantissa = value.mantissa;
+			int    exponent = value.exponent;
+			while (mantissa % 10 == 0) { mantissa /= 10; ++exponent; }
+
+			// At most 17 digits: split into 32-bit halves to keep 64-bit division out of the digit loop.
+			char digits[20];
+			char* const digitsEnd = digits + sizeof(digits);
+			char* first = digitsEnd;
+			uint32 low = (uint32)mantissa;
+			if (mantissa > 0xFFFFFFFFu)
+			{
+				low = (uint32)(mantissa % 100000000);
+				for (int i = 0; i < 4; ++i) { const uint32 pair = (low % 100) * 2; low /= 100; *--first = digitPairs[pair+1]; *--first = digitPairs[pair]; }
+				low = (uint32)(mantissa / 100000000);
+			}
+			while (low >= 100) { const uint32 pair = (low % 100) * 2; low /= 100; *--first = digitPairs[pair+1]; *--first = digitPairs[pair]; }
+			if (low >= 10) { *--first = digitPairs[low*2+1]; *--first = digitPairs[low*2]; }
+			else           { *--first = (char)('0' + low); }
+
+			const int k = (int)(digitsEnd - first);    // significant digits
+			const int n = k + exponent;                // position of the decimal point relative to the first digit
+
+			char* o = out;
+			if (negative) *o++ = '-';
+
+			if (k <= n && n <= 21)
+			{
+				memcpy(o, first, k); o += k;
+				memset(o, '0', n-k); o += n-k;
+			}
+			else if (0 < n && n <= 21)
+			{
+				memcpy(o, first, n); o += n;
+				*o++ = '.';
+				memcpy(o, first+n, k-n); o += k-n;
+			}
+			else if (-6 < n && n <= 0)
+			{
+				*o++ = '0';
+				*o++ = '.';
+				memset(o, '0', -n); o += -n;
+				memcpy(o, first, k); o += k;
+			}
+			else
+			{
+				*o++ = first[0];
+				if (k > 1)
+				{
+					*o++ = '.';
+					memcpy(o, first+1, k-1); o += k-1;
+				}
+				*o++ = 'e';
+				int e = n-1;
+				if (e < 0) { *o++ = '-'; e = -e; }
+				if (e >= 100) *o++ = (char)('0' + e / 100);
+				if (e >=  10) *o++ = (char)('0' + e / 10 % 10);
+				*o++ = (char)('0' + e % 10);
+			}
+
+			return o - out;
+		}
+
+		size_t formatSpecial(char* out, bool negative, bool nonFinite)
+		{
+			if (nonFinite) { memcpy(out, "null", 4); return 4; }
+			if (negative)  { memcpy(out, "-0",   2); return 2; }
+			out[0] = '0';
+			return 1;
+		}
+	}
+
+	size_t formatDouble(char* out, double value)
+	{
+		uint64 bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const bool   negative     = (bits >> 63) != 0;
+		const uint64 ieeeMantissa = bits & ((1ull << 52) - 1);
+		const uint32 ieeeExponent = (uint32)((bits >> 52) & 0x7FF);
+
+		if (ieeeExponent == 0x7FF || (ieeeExponent == 0 && ieeeMantissa == 0)) return formatSpecial(out, negative, ieeeExponent == 0x7FF);
+		return formatDecimal(out, negative, doubleToDecimal(ieeeMantissa, ieeeExponent));
+	}
+
+	size_t formatFloat(char* out, float value)
+	{
+		uint32 bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const bool   negative     = (bits >> 31) != 0;
+		const uint32 ieeeMantissa = bits & ((1u << 23) - 1);
+		const uint32 ieeeExponent = (bits >> 23) & 0xFF;
+
+		if (ieeeExponent == 0xFF || (ieeeExponent == 0 && ieeeMantissa == 0)) return formatSpecial(out, negative, ieeeExponent == 0xFF);
+		return formatDecimal(out, negative, floatToDecimal(ieeeMantissa, ieeeExponent));
+	}
+}}} // namespace mmk::json::detail
@@ -0,0 +1,32 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ZMMK_IG_JSON_DTOA_HPP
+#define ZMMK_IG_JSON_DTOA_HPP
+
+#include <stddef.h>
+
+namespace mmk { namespace json { namespace detail
+{
+	// Worst case is e.g. "-0.0000012345678901234567" (sign, "0.", 5 zeros, 17 significant digits.)
+	enum { maxFloatChars = 25 };
+
+	// Writes the shortest JSON number that parses back to exactly value (no '\0'), returning the number of chars written.
+	// Non-finite values have no JSON representation and are written as "null".
+	size_t formatFloat (char* out, float  value);
+	size_t formatDouble(char* out, double value);
+}}} // namespace mmk::json::detail
+
+#endif /* ndef ZMMK_IG_JSON_DTOA_HPP */
@@ -14,174 +14,1416 @@
 */
 
 #include <mmk/json/writer.hpp>
+#include "dtoa.hpp"
 #include <stdio.h>
 #include <string.h>
+#include <new>
 #ifdef _MSC_VER
 #include <windows.h>
 #endif
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// String escaping scans for "special" bytes 16 (SSE2) or 32 (AVX2) bytes at a time.  Define MMK_JSON_WRITER_NO_SIMD to force the scalar fallback.
+#if !defined(MMK_JSON_WRITER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define ZMMK_JSON_WRITER_SSE2
+	#include <emmintrin.h>
+	#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+		#define ZMMK_JSON_WRITER_AVX2
+		#define ZMMK_JSON_WRITER_TARGET_AVX2 __attribute__((target("avx2")))
+		#include <immintrin.h>
+	#elif defined(_MSC_VER) && _MSC_VER >= 1700
+		#define ZMMK_JSON_WRITER_AVX2
+		#define ZMMK_JSON_WRITER_TARGET_AVX2
+		#include <immintrin.h>
+		#include <intrin.h>
+	#endif
+
+	// The scanners' aligned loads read past the end of strings on purpose - AddressSanitizer needs telling.
+	#if defined(__GNUC__) || defined(__clang__)
+		#define ZMMK_JSON_WRITER_OVERREADS __attribute__((no_sanitize_address))
+	#elif defined(_MSC_VER) && defined(__SANITIZE_ADDRESS__)
+		#define ZMMK_JSON_WRITER_OVERREADS __declspec(no_sanitize_address)
+	#else
+		#define ZMMK_JSON_WRITER_OVERREADS
+	#endif
+#endif
 
 namespace mmk { namespace json
 {
+	namespace
+	{
+		const char hexDigits[] = "0123456789abcdef";
+
+		// Two digits per table lookup, "00" through "99".
+		const char digitPairs[] =
+			"0001020304050607080910111213141516171819"
+			"2021222324252627282930313233343536373839"
+			"4041424344454647484950515253545556575859"
+			"6061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+
+		template < typename Unsigned > inline unsigned countDigits(Unsigned value)
+		{
+			unsigned digits = 1;
+			for (;;)
+			{
+				if (value <    10) return digits;
+				if (value <   100) return digits+1;
+				if (value <  1000) return digits+2;
+				if (value < 10000) return digits+3;
+				value /= 10000;
+				digits += 4;
+			}
+		}
+
+		// Writes the digits of value backwards, ending just before last.
+		inline void formatDigits(char* last, unsigned int value)
+		{
+			while (value >= 100)
+			{
+				const unsigned pair = (value % 100) * 2;
+				value /= 100;
+				*--last = digitPairs[pair+1];
+				*--last = digitPairs[pair+0];
+			}
+			if (value >= 10)
+			{
+				*--last = digitPairs[value*2+1];
+				*--last = digitPairs[value*2+0];
+			}
+			else
+			{
+				*--last = (char)('0' + value);
+			}
+		}
+
+		inline void formatDigits(char* last, unsigned long long value)
+		{
+			// Peel off pairs in 64-bit until the rest fits the (much cheaper on 32-bit targets) 32-bit path.
+			while (value > 0xFFFFFFFFu)
+			{
+				const unsigned pair = (unsigned)(value % 100) * 2;
+				value /= 100;
+				*--last = digitPairs[pair+1];
+				*--last = digitPairs[pair+0];
+			}
+			formatDigits(last, (unsigned int)value);
+		}
+
+		inline void formatDigits(char* last, unsigned long value)
+		{
+			if (sizeof(unsigned long) > sizeof(unsigned int)) formatDigits(last, (unsigned long long)value);
+			else                                              formatDigits(last, (unsigned int)value);
+		}
+
+		// Length of the valid UTF-8 sequence at value (which starts with a byte >= 0x80), or 0 if it's invalid or cut short
+		// by limit.  invalid is set to the length of the maximal subpart of an invalid sequence - the bytes one U+FFFD
+		// replaces, per the Unicode standard's recommended practice.
+		size_t utf8Sequence(const char* value, size_t limit, size_t& invalid)
+		{
+			const unsigned char* s    = (const unsigned char*)value;
+			const unsigned char  lead = s[0];
+			invalid = 1;
+			if (lead < 0xC2 || lead > 0xF4) return 0; // Continuation bytes, overlong 2-byte leads, > U+10FFFF
+
+			const size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+			unsigned lo = 0x80, hi = 0xBF; // Second byte ranges are narrowed to exclude overlongs, surrogates, and > U+10FFFF
+			switch (lead)
+			{
+			case 0xE0: lo = 0xA0; break;
+			case 0xED: hi = 0x9F; break;
+			case 0xF0: lo = 0x90; break;
+			case 0xF4: hi = 0x8F; break;
+			}
+
+			for (size_t i = 1; i < length; ++i, lo = 0x80, hi = 0xBF)
+			{
+				if (i >= limit || s[i] < lo || s[i] > hi) { invalid = i; return 0; }
+			}
+			return length;
+		}
+
+		// UTF-8 clean runs on top of a scanner for clean ASCII runs:  Multi-byte sequences are checked one at a time.
+		size_t cleanRunUtf8With(size_t (*asciiRun)(const char*, size_t), const char* value, size_t limit)
+		{
+			size_t run = 0, invalid;
+			for (;;)
+			{
+				run += asciiRun(value + run, limit - run);
+				if (run >= limit || (unsigned char)value[run] < 0x80) return run;
+
+				const size_t sequence = utf8Sequence(value + run, limit - run, invalid);
+				if (!sequence) return run;
+				run += sequence;
+				if (run >= limit) return run;
+			}
+		}
+
+#ifndef ZMMK_JSON_WRITER_SSE2
+		// Bytes that can't be copied verbatim: control codes (including the '\0' terminator), '"', '\\', and DEL/high ASCII (\u escaped to keep our output 7-bit.)
+		inline bool isSpecial(unsigned char ch) { return ch < 0x20 || ch == '\"' || ch == '\\' || ch >= 0x7F; }
+
+		size_t cleanRunScalar(const char* value, size_t limit)
+		{
+			size_t i = 0;
+			while (i < limit && !isSpecial((unsigned char)value[i])) ++i;
+			return i;
+		}
+
+		size_t cleanRunUtf8Scalar(const char* value, size_t limit) { return cleanRunUtf8With(cleanRunScalar, value, limit); }
+#else
+		inline unsigned lowestBit(unsigned mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		inline unsigned specialMask(__m128i chunk)
+		{
+			// Signed compare: 0x80-0xFF are negative, so "< 0x20" also catches high ASCII.
+			const __m128i control = _mm_cmplt_epi8(chunk, _mm_set1_epi8(0x20));
+			const __m128i del     = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(0x7F));
+			const __m128i quote   = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\"'));
+			const __m128i slash   = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+			return (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(control, del), _mm_or_si128(quote, slash)));
+		}
+
+		// Aligned loads never straddle a page boundary, so peeking past the '\0' terminator (or limit) can't fault (same trick as SIMD strlen.)
+		// Scans at most limit bytes - (size_t)-1 for '\0' terminated strings.
+		ZMMK_JSON_WRITER_OVERREADS size_t cleanRunSse2(const char* value, size_t limit)
+		{
+			const char* chunk = (const char*)((size_t)value & ~(size_t)15);
+			unsigned mask = specialMask(_mm_load_si128((const __m128i*)chunk)) >> (value-chunk);
+			if (mask) return lowestBit(mask) < limit ? lowestBit(mask) : limit;
+
+			for (size_t offset = 16 - (value-chunk); offset < limit; offset += 16)
+			{
+				mask = specialMask(_mm_load_si128((const __m128i*)(value + offset)));
+				if (mask) return offset + lowestBit(mask) < limit ? offset + lowestBit(mask) : limit;
+			}
+			return limit;
+		}
+
+		size_t cleanRunUtf8Sse2(const char* value, size_t limit) { return cleanRunUtf8With(cleanRunSse2, value, limit); }
+#endif
+
+#ifdef ZMMK_JSON_WRITER_AVX2
+		ZMMK_JSON_WRITER_TARGET_AVX2 inline unsigned specialMask(__m256i chunk)
+		{
+			const __m256i control = _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), chunk);
+			const __m256i del     = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(0x7F));
+			const __m256i quote   = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\"'));
+			const __m256i slash   = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'));
+			return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(control, del), _mm256_or_si256(quote, slash)));
+		}
+
+		ZMMK_JSON_WRITER_TARGET_AVX2 ZMMK_JSON_WRITER_OVERREADS size_t cleanRunAvx2(const char* value, size_t limit)
+		{
+			const char* chunk = (const char*)((size_t)value & ~(size_t)31);
+			unsigned mask = specialMask(_mm256_load_si256((const __m256i*)chunk)) >> (value-chunk);
+			if (mask) return lowestBit(mask) < limit ? lowestBit(mask) : limit;
+
+			for (size_t offset = 32 - (value-chunk); offset < limit; offset += 32)
+			{
+				mask = specialMask(_mm256_load_si256((const __m256i*)(value + offset)));
+				if (mask) return offset + lowestBit(mask) < limit ? offset + lowestBit(mask) : limit;
+			}
+			return limit;
+		}
+
+		// Like specialMask, but lets bytes >= 0x80 through (signed compares see them as negative, and "less than" 0x20.)
+		ZMMK_JSON_WRITER_TARGET_AVX2 inline unsigned asciiSpecialMask(__m256i chunk)
+		{
+			const __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), chunk), _mm256_cmpgt_epi8(chunk, _mm256_set1_epi8(-1)));
+			const __m256i del     = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(0x7F));
+			const __m256i quote   = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\"'));
+			const __m256i slash   = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'));
+			return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(control, del), _mm256_or_si256(quote, slash)));
+		}
+
+		// Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte":  Each byte is classified against the
+		// byte before it with three nibble lookups, and continuations are checked against the leads 2-3 bytes back.
+		// Returns non-zero bytes where errors are detected - on the byte after whatever started the invalid sequence.
+		enum
+		{
+			utf8TooShort = 1<<0, utf8TooLong  = 1<<1, utf8Overlong3     = 1<<2, utf8TooLarge = 1<<3,
+			utf8Surrogate = 1<<4, utf8Overlong2 = 1<<5, utf8TooLarge1000 = 1<<6, utf8Overlong4 = 1<<6, utf8TwoConts = 1<<7,
+			utf8Carry = utf8TooShort | utf8TooLong | utf8TwoConts
+		};
+
+		const unsigned char utf8Byte1High[16] =
+		{
+			// 0_______ ________ (ASCII)
+			utf8TooLong, utf8TooLong, utf8TooLong, utf8TooLong, utf8TooLong, utf8TooLong, utf8TooLong, utf8TooLong,
+			// 10______ ________ (continuation)
+			utf8TwoConts, utf8TwoConts, utf8TwoConts, utf8TwoConts,
+			// 1100____ 1101____ 1110____ 1111____ (leads)
+			utf8TooShort | utf8Overlong2,
+			utf8TooShort,
+			utf8TooShort | utf8Overlong3 | utf8Surrogate,
+			utf8TooShort | utf8TooLarge | utf8TooLarge1000 | utf8Overlong4,
+		};
+
+		const unsigned char utf8Byte1Low[16] =
+		{
+			utf8Carry | utf8Overlong3 | utf8Overlong2 | utf8Overlong4,      // ____0000
+			utf8Carry | utf8Overlong2,                                      // ____0001
+			utf8Carry,                                                      // ____0010
+			utf8Carry,                                                      // ____0011
+			utf8Carry | utf8TooLarge,                                       // ____0100
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,                    // ____0101
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,                    // ____1___
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+			utf8Carry | utf8TooLarge | utf8TooLarge1000 | utf8Surrogate,    // ____1101
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+			utf8Carry | utf8TooLarge | utf8TooLarge1000,
+		};
+
+		const unsigned char utf8Byte2High[16] =
+		{
+			// ________ 0_______ (ASCII)
+			utf8TooShort, utf8TooShort, utf8TooShort, utf8TooShort, utf8TooShort, utf8TooShort, utf8TooShort, utf8TooShort,
+			// ________ 1000____ 1001____ 101_____ (continuations)
+			utf8TooLong | utf8Overlong2 | utf8TwoConts | utf8Overlong3 | utf8TooLarge1000 | utf8Overlong4,
+			utf8TooLong | utf8Overlong2 | utf8TwoConts | utf8Overlong3 | utf8TooLarge,
+			utf8TooLong | utf8Overlong2 | utf8TwoConts | utf8Surrogate | utf8TooLarge,
+			utf8TooLong | utf8Overlong2 | utf8TwoConts | utf8Surrogate | utf8TooLarge,
+			// ________ 11______ (leads)
+			utf8TooShort, utf8TooShort, utf8TooShort, utf8TooShort,
+		};
+
+		ZMMK_JSON_WRITER_TARGET_AVX2 inline __m256i utf8Lookup(const unsigned char (&table)[16], __m256i nibbles)
+		{
+			return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table)), nibbles);
+		}
+
+		ZMMK_JSON_WRITER_TARGET_AVX2 inline __m256i utf8Errors(__m256i input, __m256i previous)
+		{
+			const __m256i nibble  = _mm256_set1_epi8(0x0F);
+			const __m256i spliced = _mm256_permute2x128_si256(previous, input, 0x21); // previous high lane, input low lane
+			const __m256i prev1   = _mm256_alignr_epi8(input, spliced, 15);
+			const __m256i prev2   = _mm256_alignr_epi8(input, spliced, 14);
+			const __m256i prev3   = _mm256_alignr_epi8(input, spliced, 13);
+
+			const __m256i byte1High = utf8Lookup(utf8Byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+			const __m256i byte1Low  = utf8Lookup(utf8Byte1Low,  _mm256_and_si256(prev1, nibble));
+			const __m256i byte2High = utf8Lookup(utf8Byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+			const __m256i pairs     = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+			// 3rd and 4th bytes must be continuations (and are the only places two continuations in a row are allowed.)
+			const __m256i third  = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0-0x80)); // >= 0x80 only for 111_____
+			const __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0-0x80)); // >= 0x80 only for 1111____
+			const __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+			return _mm256_xor_si256(must23, pairs);
+		}
+
+		// Trims run back to the start of a multi-byte sequence it would otherwise cut in half.
+		inline size_t utf8Complete(const char* value, size_t run)
+		{
+			for (size_t back = 1; back <= 3 && back <= run; ++back)
+			{
+				const unsigned char ch = (unsigned char)value[run-back];
+				if (ch <  0x80) return run;
+				if (ch >= 0xC0) return back < (ch >= 0xF0 ? 4u : ch >= 0xE0 ? 3u : 2u) ? run-back : run;
+			}
+			return run;
+		}
+
+		ZMMK_JSON_WRITER_TARGET_AVX2 ZMMK_JSON_WRITER_OVERREADS size_t cleanRunUtf8Avx2(const char* value, size_t limit)
+		{
+			const unsigned skip = (unsigned)((size_t)value & 31);
+			const char*    chunk = value - skip;
+
+			// Zero whatever precedes value in the first chunk:  A stray lead byte there would flag value's first bytes.
+			const __m256i index = _mm256_setr_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31);
+			__m256i input    = _mm256_and_si256(_mm256_load_si256((const __m256i*)chunk), _mm256_cmpgt_epi8(index, _mm256_set1_epi8((char)(skip-1))));
+			__m256i previous = _mm256_setzero_si256();
+			unsigned ignore  = skip ? (1u << skip) - 1 : 0;
+			bool multibyte   = false; // previous chunk had bytes >= 0x80, which could continue into this one
+
+			for (;;)
+			{
+				// Skip clean ASCII as fast as cleanRunAvx2 would - the common case, even in mostly non-ASCII text.
+				if (!multibyte) while (!(specialMask(input) & ~ignore))
+				{
+					if ((size_t)(chunk - value) + 32 >= limit) return limit;
+					ignore = 0;
+					chunk += 32;
+					input  = _mm256_load_si256((const __m256i*)chunk);
+				}
+
+				const size_t   base = (size_t)(chunk - value); // Wraps "negative" for the first chunk, but ignore keeps run >= 0
+				const unsigned high = (unsigned)_mm256_movemask_epi8(input);
+				unsigned       stop = asciiSpecialMask(input);
+				if (high || multibyte) stop |= ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(utf8Errors(input, previous), _mm256_setzero_si256()));
+				stop &= ~ignore;
+
+				if (stop)
+				{
+					const size_t run = base + lowestBit(stop);
+					return utf8Complete(value, run < limit ? run : limit);
+				}
+				if (base + 32 >= limit) return utf8Complete(value, limit);
+
+				previous  = input;
+				multibyte = high != 0;
+				ignore    = 0;
+				chunk    += 32;
+				input     = _mm256_load_si256((const __m256i*)chunk);
+			}
+		}
+
+		bool hasAvx2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			const int osxsaveAndAvx = (1<<27) | (1<<28);
+			if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx) return false;
+			if ((_xgetbv(0) & 6) != 6) return false; // OS saves XMM+YMM state
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1<<5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") != 0;
+#endif
+		}
+#endif
+
+		// Binary values:  hex 16 bytes at a time (SSE2), base64 24 bytes at a time (AVX2.)  Each returns the characters written.
+		const char base64Chars[2][65] =
+		{
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", // base64::standard
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_", // base64::urlSafe
+		};
+
+		size_t encodeBase64Scalar(char* out, const unsigned char* in, size_t size, int alphabet)
+		{
+			const char* const chars = base64Chars[alphabet];
+			const bool        pad   = alphabet == json::base64::standard;
+			char* const       start = out;
+
+			size_t i = 0;
+			for (; i + 3 <= size; i += 3, out += 4)
+			{
+				const unsigned long group = (unsigned long)in[i] << 16 | (unsigned long)in[i+1] << 8 | in[i+2];
+				out[0] = chars[group >> 18];
+				out[1] = chars[(group >> 12) & 63];
+				out[2] = chars[(group >>  6) & 63];
+				out[3] = chars[group & 63];
+			}
+
+			if (i < size) // 1 or 2 bytes left over
+			{
+				const bool          two   = i + 1 < size;
+				const unsigned long group = (unsigned long)in[i] << 16 | (two ? (unsigned long)in[i+1] << 8 : 0);
+				*out++ = chars[group >> 18];
+				*out++ = chars[(group >> 12) & 63];
+				if (two) *out++ = chars[(group >> 6) & 63];
+				else if (pad) *out++ = '=';
+				if (pad) *out++ = '=';
+			}
+			return size_t(out - start);
+		}
+
+		size_t encodeHexScalar(char* out, const unsigned char* in, size_t size, int)
+		{
+			for (size_t i = 0; i < size; ++i)
+			{
+				out[2*i+0] = hexDigits[in[i] >> 4];
+				out[2*i+1] = hexDigits[in[i] & 15];
+			}
+			return 2*size;
+		}
+
+#ifdef ZMMK_JSON_WRITER_SSE2
+		inline __m128i hexDigitsOf(__m128i nibbles)
+		{
+			const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+			return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+		}
+
+		size_t encodeHex(char* out, const unsigned char* in, size_t size, int)
+		{
+			size_t i = 0;
+			for (; i + 16 <= size; i += 16)
+			{
+				const __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+				const __m128i high  = _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+				const __m128i low   = _mm_and_si128(bytes, _mm_set1_epi8(0x0F));
+				_mm_storeu_si128((__m128i*)(out + 2*i +  0), hexDigitsOf(_mm_unpacklo_epi8(high, low)));
+				_mm_storeu_si128((__m128i*)(out + 2*i + 16), hexDigitsOf(_mm_unpackhi_epi8(high, low)));
+			}
+			return 2*i + encodeHexScalar(out + 2*i, in + i, size - i, 0);
+		}
+#else
+		size_t encodeHex(char* out, const unsigned char* in, size_t size, int) { return encodeHexScalar(out, in, size, 0); }
+#endif
+
+#ifdef ZMMK_JSON_WRITER_AVX2
+		// Each lane splits 12 bytes into 16 sextets with a shuffle and two multiplies (Mula and Lemire's "Faster Base64
+		// Encoding and Decoding Using AVX2 Instructions"), then maps sextets to characters by range with another shuffle.
+		// Reads 28 bytes for every 24 encoded, so the last few groups are left to encodeBase64Scalar.
+		ZMMK_JSON_WRITER_TARGET_AVX2 size_t encodeBase64Avx2(char* out, const unsigned char* in, size_t size, int alphabet)
+		{
+			const __m256i split  = _mm256_setr_epi8(1,0,2,1, 4,3,5,4, 7,6,8,7, 10,9,11,10,  1,0,2,1, 4,3,5,4, 7,6,8,7, 10,9,11,10);
+			const char    plus   = alphabet == json::base64::standard ? '+' - 62 : '-' - 62;
+			const char    slash  = alphabet == json::base64::standard ? '/' - 63 : '_' - 63;
+			const __m256i offset = _mm256_setr_epi8( // Added to sextets:  A-Z, a-z, 0-9 (x10), 62, 63
+				'A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, plus, slash, 0, 0,
+				'A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, plus, slash, 0, 0);
+
+			size_t i = 0;
+			for (; i + 28 <= size; i += 24, out += 32)
+			{
+				const __m128i lo    = _mm_loadu_si128((const __m128i*)(in + i +  0));
+				const __m128i hi    = _mm_loadu_si128((const __m128i*)(in + i + 12));
+				const __m256i bytes = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), split);
+
+				const __m256i ac      = _mm256_mulhi_epu16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+				const __m256i bd      = _mm256_mullo_epi16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+				const __m256i sextets = _mm256_or_si256(ac, bd);
+
+				// 0 for A-Z, 1 for a-z, 2-11 for digits, 12 and 13 for the last two
+				const __m256i range = _mm256_sub_epi8(_mm256_subs_epu8(sextets, _mm256_set1_epi8(51)), _mm256_cmpgt_epi8(sextets, _mm256_set1_epi8(25)));
+				_mm256_storeu_si256((__m256i*)out, _mm256_add_epi8(sextets, _mm256_shuffle_epi8(offset, range)));
+			}
+			return i / 3 * 4 + encodeBase64Scalar(out, in + i, size - i, alphabet);
+		}
+#endif
+
+		size_t cleanRunDetect    (const char* value, size_t limit);
+		size_t cleanRunUtf8Detect(const char* value, size_t limit);
+		size_t encodeBase64Detect(char* out, const unsigned char* in, size_t size, int alphabet);
+
+		// Constant-initialized so they're valid even when writing JSON from other static initializers.
+		// Racing threads may both detect, but will store the same results.
+		size_t (*cleanRun)    (const char*, size_t) = cleanRunDetect;
+		size_t (*cleanRunUtf8)(const char*, size_t) = cleanRunUtf8Detect; // Also lets valid UTF-8 sequences through
+		size_t (*encodeBase64)(char*, const unsigned char*, size_t, int) = encodeBase64Detect;
+
+		void detect()
+		{
+#if defined(ZMMK_JSON_WRITER_AVX2)
+			const bool avx2 = hasAvx2();
+			cleanRun     = avx2 ? cleanRunAvx2     : cleanRunSse2;
+			cleanRunUtf8 = avx2 ? cleanRunUtf8Avx2 : cleanRunUtf8Sse2;
+			encodeBase64 = avx2 ? encodeBase64Avx2 : encodeBase64Scalar;
+#elif defined(ZMMK_JSON_WRITER_SSE2)
+			cleanRun     = cleanRunSse2;
+			cleanRunUtf8 = cleanRunUtf8Sse2;
+			encodeBase64 = encodeBase64Scalar;
+#else
+			cleanRun     = cleanRunScalar;
+			cleanRunUtf8 = cleanRunUtf8Scalar;
+			encodeBase64 = encodeBase64Scalar;
+#endif
+		}
+
+		size_t cleanRunDetect    (const char* value, size_t limit) { detect(); return cleanRun    (value, limit); }
+		size_t cleanRunUtf8Detect(const char* value, size_t limit) { detect(); return cleanRunUtf8(value, limit); }
+		size_t encodeBase64Detect(char* out, const unsigned char* in, size_t size, int alphabet) { detect(); return encodeBase64(out, in, size, alphabet); }
+	}
+
+	namespace
+	{
+		// Wide strings:  Runs of clean ASCII units are found 8 (16-bit) or 4 (32-bit) units at a time, then narrowed in bulk.
+		template < typename Unit > inline bool isSpecialUnit(Unit unit) { return unit < 0x20 || unit >= 0x7F || unit == '\"' || unit == '\\'; }
+
+		template < typename Unit > size_t cleanRunWideScalar(const Unit* value, size_t limit)
+		{
+			size_t i = 0;
+			while (i < limit && !isSpecialUnit(value[i])) ++i;
+			return i;
+		}
+
+#ifdef ZMMK_JSON_WRITER_SSE2
+		inline unsigned specialMask(__m128i chunk, unsigned short)
+		{
+			// Signed compares: units >= 0x8000 are negative, so "< 0x20" catches those too.
+			const __m128i outside = _mm_or_si128(_mm_cmplt_epi16(chunk, _mm_set1_epi16(0x20)), _mm_cmpgt_epi16(chunk, _mm_set1_epi16(0x7E)));
+			const __m128i quote   = _mm_cmpeq_epi16(chunk, _mm_set1_epi16('\"'));
+			const __m128i slash   = _mm_cmpeq_epi16(chunk, _mm_set1_epi16('\\'));
+			return (unsigned)_mm_movemask_epi8(_mm_or_si128(outside, _mm_or_si128(quote, slash)));
+		}
+
+		inline unsigned specialMask(__m128i chunk, unsigned int)
+		{
+			const __m128i outside = _mm_or_si128(_mm_cmplt_epi32(chunk, _mm_set1_epi32(0x20)), _mm_cmpgt_epi32(chunk, _mm_set1_epi32(0x7E)));
+			const __m128i quote   = _mm_cmpeq_epi32(chunk, _mm_set1_epi32('\"'));
+			const __m128i slash   = _mm_cmpeq_epi32(chunk, _mm_set1_epi32('\\'));
+			return (unsigned)_mm_movemask_epi8(_mm_or_si128(outside, _mm_or_si128(quote, slash)));
+		}
+
+		// Same aligned-load trick as cleanRunSse2, so '\0' terminated strings can't fault either.
+		template < typename Unit > ZMMK_JSON_WRITER_OVERREADS size_t cleanRunWide(const Unit* value, size_t limit)
+		{
+			const size_t perChunk = 16 / sizeof(Unit);
+			if ((size_t)value % sizeof(Unit)) return cleanRunWideScalar(value, limit); // Misaligned units never line up with chunks
+
+			const Unit* chunk = (const Unit*)((size_t)value & ~(size_t)15);
+			const size_t skip = value - chunk;
+			unsigned mask = specialMask(_mm_load_si128((const __m128i*)chunk), Unit()) >> (skip * sizeof(Unit));
+			if (mask) return lowestBit(mask) / sizeof(Unit) < limit ? lowestBit(mask) / sizeof(Unit) : limit;
+
+			for (size_t offset = perChunk - skip; offset < limit; offset += perChunk)
+			{
+				mask = specialMask(_mm_load_si128((const __m128i*)(value + offset)), Unit());
+				if (mask) return offset + lowestBit(mask) / sizeof(Unit) < limit ? offset + lowestBit(mask) / sizeof(Unit) : limit;
+			}
+			return limit;
+		}
+
+		inline void narrow(char* out, const unsigned short* in, size_t count)
+		{
+			for (; count >= 16; count -= 16, in += 16, out += 16)
+			{
+				const __m128i lo = _mm_loadu_si128((const __m128i*)(in + 0));
+				const __m128i hi = _mm_loadu_si128((const __m128i*)(in + 8));
+				_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(lo, hi));
+			}
+			while (count--) *out++ = (char)*in++;
+		}
+
+		inline void narrow(char* out, const unsigned int* in, size_t count)
+		{
+			for (; count >= 16; count -= 16, in += 16, out += 16)
+			{
+				const __m128i lo = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(in + 0)), _mm_loadu_si128((const __m128i*)(in +  4)));
+				const __m128i hi = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(in + 8)), _mm_loadu_si128((const __m128i*)(in + 12)));
+				_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(lo, hi));
+			}
+			while (count--) *out++ = (char)*in++;
+		}
+#else
+		template < typename Unit > size_t cleanRunWide(const Unit* value, size_t limit) { return cleanRunWideScalar(value, limit); }
+
+		template < typename Unit > inline void narrow(char* out, const Unit* in, size_t count)
+		{
+			while (count--) *out++ = (char)*in++;
+		}
+#endif
+
+		// Encodes a code point >= 0x80 as UTF-8, or as \uXXXX escapes (a surrogate pair above U+FFFF.)  Returns the length.
+		size_t encodeCodepoint(char* out, unsigned long ch, bool utf8)
+		{
+			if (utf8)
+			{
+				if (ch < 0x800)   { out[0] = (char)(0xC0 | (ch >>  6));                                                                                   out[1] = (char)(0x80 | (ch & 0x3F)); return 2; }
+				if (ch < 0x10000) { out[0] = (char)(0xE0 | (ch >> 12)); out[1] = (char)(0x80 | ((ch >>  6) & 0x3F));                                    out[2] = (char)(0x80 | (ch & 0x3F)); return 3; }
+				                    out[0] = (char)(0xF0 | (ch >> 18)); out[1] = (char)(0x80 | ((ch >> 12) & 0x3F)); out[2] = (char)(0x80 | ((ch >> 6) & 0x3F)); out[3] = (char)(0x80 | (ch & 0x3F)); return 4;
+			}
+
+			if (ch >= 0x10000)
+			{
+				ch -= 0x10000;
+				return encodeCodepoint(out, 0xD800 + (ch >> 10), false) + encodeCodepoint(out + 6, 0xDC00 + (ch & 0x3FF), false);
+			}
+
+			out[0] = '\\';
+			out[1] = 'u';
+			out[2] = hexDigits[(ch >> 12) & 0xF];
+			out[3] = hexDigits[(ch >>  8) & 0xF];
+			out[4] = hexDigits[(ch >>  4) & 0xF];
+			out[5] = hexDigits[(ch >>  0) & 0xF];
+			return 6;
+		}
+	}
+
+	namespace
+	{
+		bool fileSinkCallback(void* context, const char* data, size_t size)
+		{
+			return fwrite(data, 1, size, (FILE*)context) == size;
+		}
+
+		bool fdSinkCallback(void* context, const char* data, size_t size)
+		{
+			const int fd = (int)(size_t)context;
+			while (size)
+			{
+#ifdef _WIN32
+				const int chunk = size > 0x40000000 ? 0x40000000 : (int)size;
+				const int written = _write(fd, data, chunk);
+				if (written < 0) return false;
+#else
+				const ssize_t written = ::write(fd, data, size);
+				if (written < 0 && errno == EINTR) continue;
+				if (written < 0) return false;
+#endif
+				data += written;
+				size -= written;
+			}
+			return true;
+		}
+	}
+
+	sink fileSink(FILE* file) { return sink(fileSinkCallback, file); }
+	sink fdSink(int fd)       { return sink(fdSinkCallback, (void*)(size_t)fd); }
+
+	bool writeSegments(int fd, const gather& output)
+	{
+#ifdef _WIN32
+		for (size_t i = 0; i < output.count; ++i) if (!fdSinkCallback((void*)(size_t)fd, output.segments[i].data, output.segments[i].size)) return false;
+		return true;
+#else
+		typedef char segmentMatchesIovec[sizeof(segment) == sizeof(iovec) && offsetof(segment, size) == offsetof(iovec, iov_len) ? 1 : -1];
+		(void)sizeof(segmentMatchesIovec);
+
+		size_t first = 0, skip = 0; // skip: bytes of segments[first] already written
+		while (first < output.count)
+		{
+			if (skip) // Resume a partially written segment on its own
+			{
+				if (!fdSinkCallback((void*)(size_t)fd, output.segments[first].data + skip, output.segments[first].size - skip)) return false;
+				++first;
+				skip = 0;
+				continue;
+			}
+
+			const size_t batch = output.count - first < IOV_MAX ? output.count - first : IOV_MAX;
+			ssize_t written = ::writev(fd, (const iovec*)(output.segments + first), (int)batch);
+			if (written < 0 && errno == EINTR) continue;
+			if (written < 0) return false;
+
+			while (first < output.count && (size_t)written >= output.segments[first].size) written -= output.segments[first++].size;
+			skip = written;
+		}
+		return true;
+#endif
+	}
+
+	namespace
+	{
+		errorHandler    onError        = 0;
+		void*           onErrorContext = 0;
+
+		// Process wide stats, and the call sites that have reported to them.  Only locked while a writerStats adds itself.
+		stats           totals;
+		callSite*       firstSite = 0;
+		callSite*       lastSite  = 0;
+
+#ifdef _WIN32
+		volatile LONG   statsLock = 0;
+		void lockStats()   { while (InterlockedExchange(&statsLock, 1)) Sleep(0); }
+		void unlockStats() { InterlockedExchange(&statsLock, 0); }
+#else
+		pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+		void lockStats()   { pthread_mutex_lock(&statsLock); }
+		void unlockStats() { pthread_mutex_unlock(&statsLock); }
+#endif
+
+		struct statsLocked
+		{
+			statsLocked()  { lockStats(); }
+			~statsLocked() { unlockStats(); }
+		};
+
+		void addMax(size_t& total, size_t value) { if (value > total) total = value; }
+	}
+
+	void setErrorHandler(errorHandler handler, void* context)
+	{
+		onError        = handler;
+		onErrorContext = context;
+	}
+
+	void reportError(const char* message)
+	{
+		if (onError) onError(onErrorContext, message);
+		else fprintf(stderr, "mmk::json::writer::error(\"%s\")\n", message);
+	}
+
+	writerStats::writerStats(writer& w, callSite* site)
+		: site(site)
+	{
+		stats& counters = *this;
+		memset(&counters, 0, sizeof(counters));
+		w.counters = this;
+	}
+
+	writerStats::~writerStats()
+	{
+		statsLocked locked;
+		totals.documents      += documents;
+		totals.keyBytes       += keyBytes;
+		totals.stringBytes    += stringBytes;
+		totals.numberBytes    += numberBytes;
+		totals.structureBytes += structureBytes;
+		totals.otherBytes     += otherBytes;
+		totals.escapes        += escapes;
+		totals.overflows      += overflows;
+		totals.errors         += errors;
+		totals.flushedBytes   += flushedBytes;
+		addMax(totals.neededBytes,     neededBytes);
+		addMax(totals.largestDocument, largestDocument);
+		addMax(totals.maxDepth,        maxDepth);
+
+		if (!site) return;
+		if (!site->registered)
+		{
+			site->registered = true;
+			site->next       = 0;
+			if (lastSite) lastSite->next = site; else firstSite = site;
+			lastSite = site;
+		}
+		site->documents += documents;
+		site->overflows += overflows;
+		addMax(site->highWater, largestDocument);
+	}
+
+	stats processStats()
+	{
+		statsLocked locked;
+		return totals;
+	}
+
+	std::vector<callSite> callSiteStats()
+	{
+		statsLocked locked;
+		std::vector<callSite> sites;
+		for (const callSite* site = firstSite; site; site = site->next)
+		{
+			sites.push_back(*site);
+			sites.back().next = 0;
+		}
+		return sites;
+	}
+
+	void resetStats()
+	{
+		statsLocked locked;
+		totals = stats();
+		for (callSite* site = firstSite; site; site = site->next)
+		{
+			site->documents = 0;
+			site->highWater = 0;
+			site->overflows = 0;
+		}
+	}
+
+	namespace
+	{
+		char measuring[1] = ""; // Where dry runs point - never written, position == end sends everything to skip(...)
+	}
+
+	writer::writer(json::storage storage, size_t expectedBytes)
+		: begin     (0)
+		, end       (0)
+		, position  (0)
+		, locked    (false)
+		, growable  (storage)
+		, gathering (0)
+		, skipped   (0)
+		, truncating(false)
+		, dropping  (false)
+		, dropDepth (0)
+		, counters  (0)
+	{
+		size_t capacity = 0;
+		begin = storage.callback(storage.context, 0, expectedBytes+1, capacity);
+		if (!begin) { error("writer::writer(storage) failed to allocate!"); return; }
+		end      = begin + capacity;
+		position = begin;
+		position[0] = '\0';
+	}
+
+	writer::writer(measureTag)
+		: begin     (measuring)
+		, end       (measuring)
+		, position  (measuring)
+		, locked    (false)
+		, growable  ()
+		, gathering (0)
+		, skipped   (0)
+		, truncating(false)
+		, dropping  (false)
+		, dropDepth (0)
+		, counters  (0)
+	{
+	}
+
 	void writer::error(const char* message)
 	{
-		fprintf(stderr, "mmk::json::writer::error(\"%s\")\n", message);
+		if (counters) ++counters->errors;
+		reportError(message);
 	}
 
-	void writer::syntax(const char* s)
+	void writer::overflow(const char* data, size_t size)
 	{
-		if (!locked) { error("writer::syntax(...) invoked without being locked by a scope!"); return; }
 		if (!position) return;
+		if (size >= size_t(end-position)) // Always leave room for '\0'
+		{
+			if (growable.callback) { if (!grow(size)) return; }
+			else if (!output.callback || !flush()) { skip(size); return; }
+			if (size >= size_t(end-position))
+			{
+				// Bigger than the entire buffer - hand it straight to the sink.
+				if (!output.callback(output.context, data, size)) position = 0;
+				else if (counters) counters->flushedBytes += size;
+				return;
+			}
+		}
 
-		const size_t n = end-position;
-		const size_t w = snprintf(position, end-position, "%s", s);
-		position = (w >= n) ? 0 : (position + w);
+		memcpy(position, data, size);
+		position += size;
+		*position = '\0';
 	}
 
-	void writer::syntax(char ch)
+	// Out of room for good.  Fixed buffers stop storing but keep counting, so required() can say how much they needed.
+	void writer::skip(size_t size)
 	{
-		char buf[2] = { ch, '\0' };
-		syntax(buf);
+		if (truncating) { truncate('\0'); return; }
+		if (!position || output.callback || gathering) { position = 0; return; }
+		if (position != end) { skipped = position - begin; position = end; }
+		skipped += size;
 	}
 
-	void writer::operator()(         const char* value)
+	// syntax(...) that didn't fit.  Once truncated, brackets are all that's left to track.
+	void writer::overflow(char ch)
 	{
-		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
-		if (!value ) { syntax("null"); return; }
+		if (!truncating) { overflow(&ch, 1); return; }
+		truncate(ch);
+		if (!dropping) return;
+
+		switch (ch)
+		{
+		case '{': case '[': ++dropDepth; break;
+		case '}': case ']':
+			if (dropDepth) { --dropDepth; break; }
+			*position++ = ch; // truncate(...) left room for this
+			*position = '\0';
+			end = position + 1;
+			break;
+		}
+	}
+
+	// Text goes through write(...), brackets through syntax(...) - so that once truncated, the brackets of scopes the
+	// fragment opens and closes are tracked, and the closing ones still written when they should be.
+	void writer::truncatingFragment(const char* data, size_t size)
+	{
+		const char* const last = data + size;
+		const char* run = data;
+		bool inString = false;
+		for (const char* p = data; p < last; ++p)
+		{
+			if (inString) { if (*p == '\\') ++p; else if (*p == '\"') inString = false; continue; }
+			if (*p == '\"') { inString = true; continue; }
+			if (*p != '{' && *p != '[' && *p != '}' && *p != ']') continue;
+			write(run, p - run);
+			syntax(*p);
+			run = p + 1;
+		}
+		write(run, last - run);
+	}
+
+	namespace
+	{
+		inline bool isEscaped(const char* quote, const char* begin)
+		{
+			size_t backslashes = 0;
+			while (quote-backslashes > begin && quote[-1-(ptrdiff_t)backslashes] == '\\') ++backslashes;
+			return backslashes % 2 == 1;
+		}
+	}
+
+	// Out of room in a truncating writer - next is the syntax(...) character that didn't fit, if that's what it was.  Rather
+	// than tracking element boundaries as they're written, reread the output once:  forwards to find how deeply nested it
+	// ends (and if that's mid string), then backwards along the scopes still open, for the last boundary between elements
+	// with room after it to close them all.
+	void writer::truncate(char next)
+	{
+		if (!position || dropping) return;
+
+		size_t depth    = 0;
+		bool   inString = false;
+		for (const char* p = begin; p < position; ++p)
+		{
+			if (inString) { if (*p == '\\') ++p; else if (*p == '\"') inString = false; }
+			else if (*p == '\"') inString = true;
+			else if (*p == '{' || *p == '[') ++depth;
+			else if (*p == '}' || *p == ']') --depth;
+		}
+
+		// Where the output ends is a boundary too, unless it ends mid element:  within a string, after a comma or colon, or
+		// after a key whose colon didn't fit.
+		const char last = position > begin ? position[-1] : '\0';
+		char*  cut   = 0;
+		size_t kept  = 0;
+		if (!inString && last != ',' && last != ':' && next != ':' && position + depth < end) { cut = position; kept = depth; }
+
+		size_t level = depth, nested = 0;
+		for (char* p = position; !cut && p-- > begin; )
+		{
+			const char ch = *p;
+			if (inString)    { if (ch == '\"' && !isEscaped(p, begin)) inString = false; continue; }
+			if (ch == '\"')  { inString = true; continue; }
+			if (nested)      { if (ch == '}' || ch == ']') ++nested; else if (ch == '{' || ch == '[') --nested; continue; }
+
+			switch (ch)
+			{
+			case '}': case ']': if (p + 1 + level < end) { cut = p + 1; kept = level; } else nested = 1; break;
+			case ',':           if (p     + level < end) { cut = p;     kept = level; } break;
+			case '{': case '[': if (p + 1 + level < end) { cut = p + 1; kept = level; } else --level; break;
+			}
+		}
+
+		if (!cut || cut == begin) { position = 0; return; } // Not even room to open and close the root
+		dropping  = true;
+		dropDepth = depth - kept;
+		position  = cut;
+		*position = '\0';
+		end       = position + 1;
+	}
+
+	// False if there's no room for size bytes, after flushing or growing - in which case they've been skip(...)ped.
+	bool writer::reserve(size_t size)
+	{
+		if (!position) return false;
+		if (size < size_t(end-position)) return true;
+		if (growable.callback) return grow(size);
+		if (output.callback && flush() && size < size_t(end-position)) return true;
+		skip(size);
+		return false;
+	}
+
+	bool writer::grow(size_t size)
+	{
+		const size_t used     = position - begin;
+		size_t       capacity = 0;
+		char* const  moved    = growable.callback(growable.context, used, used + size + 1, capacity);
+		if (!moved) { error("writer::grow(...) failed to allocate!"); position = 0; return false; }
+
+		begin    = moved;
+		end      = begin + capacity;
+		position = begin + used;
+		return true;
+	}
+
+	char* writer::growVector(void* context, size_t, size_t needed, size_t& capacity)
+	{
+		if (!needed) return 0; // Finished a document - nothing to do
+		std::vector<char>& buffer = *(std::vector<char>*)context;
+		size_t size = buffer.size() < 64 ? 64 : buffer.size();
+		while (size < needed) size *= 2;
+
+		try { buffer.resize(size); }
+		catch (const std::bad_alloc&) { return 0; }
+
+		capacity = size;
+		return &buffer[0];
+	}
+
+	void writer::reference(const char* data, size_t size)
+	{
+		if (!position) return;
+		gather& g = *gathering;
+		if (g.capacity - g.count < (position != g.pending ? 2u : 1u)) { position = 0; return; } // Buffered run (if any) and reference
+
+		if (position != g.pending)
+		{
+			segment buffered = { g.pending, size_t(position - g.pending) };
+			g.segments[g.count++] = buffered;
+		}
+		segment referenced = { data, size };
+		g.segments[g.count++] = referenced;
+		if (counters) counters->flushedBytes += size;
+		g.pending = position;
+	}
+
+	bool writer::flush()
+	{
+		if (!position) return false;
+		if (position == end) return begin == end; // Counting:  dry runs are fine, fixed buffers have run out of room
+		if (gathering && position != gathering->pending)
+		{
+			gather& g = *gathering;
+			if (g.count == g.capacity) { position = 0; return false; }
+			segment buffered = { g.pending, size_t(position - g.pending) };
+			g.segments[g.count++] = buffered;
+			g.pending = position;
+		}
+		if (growable.callback && position != end) { size_t capacity = size_t(end - begin); growable.callback(growable.context, size_t(position - begin), 0, capacity); }
+		if (!output.callback || position == begin) return true;
+		if (!output.callback(output.context, begin, position-begin)) { position = 0; return false; }
+		if (counters) counters->flushedBytes += position-begin;
+
+		position = begin;
+		*position = '\0';
+		return true;
+	}
+
+	template < typename Unsigned > void writer::integer(Unsigned magnitude, bool negative)
+	{
+		const unsigned digits = countDigits(magnitude);
+		if (!reserve(digits + negative)) return;
+
+		if (negative) *position++ = '-';
+		position += digits;
+		formatDigits(position, magnitude);
+		*position = '\0';
+	}
+
+	namespace
+	{
+		// formatNumber(out, value) writes value at out and returns the end.  maxChars<Value>::value is the widest it gets.
+		template < typename Value > struct maxChars;
+		template <> struct maxChars<  signed int       > { enum { value = 1 + 3 * sizeof(int)       }; };
+		template <> struct maxChars<unsigned int       > { enum { value = 3 * sizeof(int)           }; };
+		template <> struct maxChars<  signed long      > { enum { value = 1 + 3 * sizeof(long)      }; };
+		template <> struct maxChars<unsigned long      > { enum { value = 3 * sizeof(long)          }; };
+		template <> struct maxChars<  signed long long > { enum { value = 1 + 3 * sizeof(long long) }; };
+		template <> struct maxChars<unsigned long long > { enum { value = 3 * sizeof(long long)     }; };
+		template <> struct maxChars<float              > { enum { value = detail::maxFloatChars     }; };
+		template <> struct maxChars<double             > { enum { value = detail::maxFloatChars     }; };
+
+		template < typename Unsigned > inline char* formatUnsigned(char* out, Unsigned magnitude)
+		{
+			out += countDigits(magnitude);
+			formatDigits(out, magnitude);
+			return out;
+		}
+
+		template < typename Unsigned, typename Signed > inline char* formatSigned(char* out, Signed value)
+		{
+			const bool negative = value < 0;
+			*out = '-';
+			out += negative;
+			return formatUnsigned(out, negative ? Unsigned(0)-(Unsigned)value : (Unsigned)value);
+		}
+
+		inline char* formatNumber(char* out, unsigned int       value) { return formatUnsigned(out, value); }
+		inline char* formatNumber(char* out, unsigned long      value) { return formatUnsigned(out, value); }
+		inline char* formatNumber(char* out, unsigned long long value) { return formatUnsigned(out, value); }
+		inline char* formatNumber(char* out,   signed int       value) { return formatSigned<unsigned int      >(out, value); }
+		inline char* formatNumber(char* out,   signed long      value) { return formatSigned<unsigned long     >(out, value); }
+		inline char* formatNumber(char* out,   signed long long value) { return formatSigned<unsigned long long>(out, value); }
+		inline char* formatNumber(char* out, float              value) { return out + detail::formatFloat (out, value); }
+		inline char* formatNumber(char* out, double             value) { return out + detail::formatDouble(out, value); }
+
+		// How wide formatNumber(...) would be - without formatting integers at all.
+		template < typename Value > inline size_t numberChars(Value value) { char buffer[maxChars<Value>::value]; return formatNumber(buffer, value) - buffer; }
+		inline size_t numberChars(unsigned int       value) { return countDigits(value); }
+		inline size_t numberChars(unsigned long      value) { return countDigits(value); }
+		inline size_t numberChars(unsigned long long value) { return countDigits(value); }
+		inline size_t numberChars(  signed int       value) { return value < 0 ? 1 + countDigits(0u  -(unsigned int      )value) : countDigits((unsigned int      )value); }
+		inline size_t numberChars(  signed long      value) { return value < 0 ? 1 + countDigits(0ul -(unsigned long     )value) : countDigits((unsigned long     )value); }
+		inline size_t numberChars(  signed long long value) { return value < 0 ? 1 + countDigits(0ull-(unsigned long long)value) : countDigits((unsigned long long)value); }
+	}
+
+	// One bounds check per number - against a window with room for the widest one - and no branches for commas.
+	template < typename Value > void writer::numbers(const Value* values, size_t count, bool comma)
+	{
+		enum { widest = 1 + maxChars<Value>::value }; // Comma included
+		for (size_t i = 0; i < count; )
+		{
+			if (!position) return;
+			if (position == end)
+			{
+				// Only counting:  commas, then the numbers.
+				size_t bytes = count - i - !comma;
+				for (; i < count; ++i) bytes += numberChars(values[i]);
+				skip(bytes);
+				return;
+			}
+			if (size_t(end-position) <= widest)
+			{
+				// Near the end of the buffer:  let write(...) decide exactly what fits, grows, flushes, or truncates.
+				if (dropping) return;
+				char buffer[widest];
+				char* out = buffer;
+				*out = ',';
+				out += comma;
+				comma = true;
+				out = formatNumber(out, values[i++]);
+				write(buffer, out-buffer);
+				continue;
+			}
+
+			char*       out   = position;
+			char* const limit = end - widest; // out < limit leaves room for a number and the '\0'
+			while (out < limit && i < count)
+			{
+				*out = ',';
+				out += comma;
+				comma = true;
+				out = formatNumber(out, values[i++]);
+			}
+			position  = out;
+			*position = '\0';
+		}
+	}
+
+	void writer::numbers(const   signed int*       values, size_t count, bool comma) { numbers<  signed int      >(values, count, comma); }
+	void writer::numbers(const unsigned int*       values, size_t count, bool comma) { numbers<unsigned int      >(values, count, comma); }
+	void writer::numbers(const   signed long*      values, size_t count, bool comma) { numbers<  signed long     >(values, count, comma); }
+	void writer::numbers(const unsigned long*      values, size_t count, bool comma) { numbers<unsigned long     >(values, count, comma); }
+	void writer::numbers(const   signed long long* values, size_t count, bool comma) { numbers<  signed long long>(values, count, comma); }
+	void writer::numbers(const unsigned long long* values, size_t count, bool comma) { numbers<unsigned long long>(values, count, comma); }
+	void writer::numbers(const float*              values, size_t count, bool comma) { numbers<float             >(values, count, comma); }
+	void writer::numbers(const double*             values, size_t count, bool comma) { numbers<double            >(values, count, comma); }
+
+	void writer::escape(const char* value, size_t size, bool utf8)
+	{
+		const bool terminated = size == (size_t)-1;
+		size_t (* const scan)(const char*, size_t) = utf8 ? cleanRunUtf8 : cleanRun;
 
 		syntax('\"');
 
-		while (position && position != end)
+		while (position && size) // Never scan 0 bytes - even an aligned load could touch the page after a bounded string.
 		{
-			unsigned char next = *value++;
-			if (!next) break;
+			// Bulk copy everything up to the next byte needing escaping (or the terminator.)
+			const size_t clean = scan(value, size);
+			write(value, clean);
+			value += clean;
+			if (!terminated) size -= clean;
+			if (!size) break;
 
-			switch ((char)next)
+			if (utf8 && (unsigned char)*value >= 0x80)
 			{
-			case '\"': syntax("\\\""); break;
-			case '\\': syntax("\\\\"); break;
-			//case '/':  syntax("\\\/"); break;
-			case '\b': syntax("\\b"); break;
-			case '\f': syntax("\\f"); break;
-			case '\n': syntax("\\n"); break;
-			case '\r': syntax("\\r"); break;
-			case '\t': syntax("\\t"); break;
-			default:
-				if (0x20 <= next && next < 0x7F)
+				// Invalid or truncated - replace it with U+FFFD.  (Or valid, if scan just stopped short.)
+				size_t invalid;
+				const size_t sequence = utf8Sequence(value, size, invalid);
+				if (sequence) write(value, sequence);
+				else          write("\xEF\xBF\xBD", 3);
+
+				const size_t consumed = sequence ? sequence : invalid;
+				value += consumed;
+				if (!terminated) size -= consumed;
+				continue;
+			}
+
+			const unsigned char next = *value++;
+			if (!terminated) --size;
+			else if (!next) break;
+			escapeChar(next);
+		}
+
+		syntax('\"');
+	}
+
+	void writer::escapeChar(unsigned char ch)
+	{
+		if (counters) ++counters->escapes;
+		switch ((char)ch)
+		{
+		case '\"': write("\\\"", 2); break;
+		case '\\': write("\\\\", 2); break;
+		//case '/':  write("\\/", 2); break;
+		case '\b': write("\\b", 2); break;
+		case '\f': write("\\f", 2); break;
+		case '\n': write("\\n", 2); break;
+		case '\r': write("\\r", 2); break;
+		case '\t': write("\\t", 2); break;
+		default:
+			{
+				const char escaped[6] = { '\\', 'u', '0', '0', hexDigits[ch >> 4], hexDigits[ch & 0xF] };
+				write(escaped, sizeof(escaped));
+			}
+			break;
+		}
+	}
+
+	template < typename Unit > void writer::transcode(const Unit* value, size_t size, bool utf8)
+	{
+		const bool terminated = size == (size_t)-1;
+
+		syntax('\"');
+
+		while (position && size)
+		{
+			// Narrow everything up to the next unit needing escaping or encoding (or the terminator) straight into the buffer.
+			size_t clean = cleanRunWide(value, size);
+			if (!terminated) size -= clean;
+			while (clean)
+			{
+				if (size_t(end-position) <= 1 && !reserve(1)) // Flush/grow/fail once full
+				{
+					if (!position) return;
+					skip(clean - 1); // Only counting now - reserve(...) already counted the first unit
+					value += clean;
+					break;
+				}
+				const size_t room  = end - position - 1; // Always leave room for '\0'
+				const size_t piece = clean < room ? clean : room;
+				narrow(position, value, piece);
+				position += piece;
+				*position = '\0';
+				value    += piece;
+				clean    -= piece;
+			}
+			if (!size) break;
+
+			// Then everything up to the next clean ASCII unit - CJK and the like come in long runs of these.
+			while (size)
+			{
+				unsigned long ch = *value;
+				if (ch < 0x80)
 				{
-					syntax(next);
+					if (!isSpecialUnit(ch)) break;
+					if (!ch && terminated) { size = 0; break; }
+					escapeChar((unsigned char)ch);
 				}
 				else
 				{
-					const size_t n = end-position;
-					const size_t w = snprintf(position, n, "\\u%04x", next);
-					position = (w >= n) ? 0 : (position + w);
+					if (ch >= 0xD800 && ch <= 0xDFFF)
+					{
+						// Pair a (UTF-16) high surrogate with the low surrogate following it, if any.  Anything else is invalid.
+						const unsigned long low = sizeof(Unit) == 2 && ch <= 0xDBFF && size > 1 ? (unsigned long)value[1] : 0;
+						if (low >= 0xDC00 && low <= 0xDFFF)
+						{
+							ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+							++value;
+							if (!terminated) --size;
+						}
+						else ch = 0xFFFD;
+					}
+					else if (ch > 0x10FFFF) ch = 0xFFFD;
+					if (counters && !utf8) ++counters->escapes;
+
+					if (size_t(end-position) > 12) { position += encodeCodepoint(position, ch, utf8); *position = '\0'; }
+					else                           { char encoded[12]; write(encoded, encodeCodepoint(encoded, ch, utf8)); }
 				}
-				break;
+
+				++value;
+				if (!terminated) --size;
+				if (!position) return;
 			}
 		}
 
 		syntax('\"');
 	}
 
-	void writer::operator()(         bool        value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; syntax(value ? "true" : "false"); }
-	void writer::operator()(unsigned int         value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%u",   value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(  signed int         value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%i",   value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(unsigned long        value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%lu",  value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(  signed long        value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%li",  value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(unsigned long long   value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%llu", value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(  signed long long   value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%lli", value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(         float       value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%f",   value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(         double      value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%f",   value); position = (w >= n) ? 0 : (position + w); }
-	void writer::operator()(         long double value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; const size_t n = end-position; const size_t w = snprintf(position, n, "%Lf",  value); position = (w >= n) ? 0 : (position + w); }
+	// Binary data as a string, encoded straight into the buffer - a piece at a time (whole groups of groupIn bytes) when it
+	// won't fit a streaming writer's buffer all at once.  Anything else grows, counts, truncates or fails as usual.
+	void writer::blob(const unsigned char* data, size_t size, size_t encodedSize, size_t groupIn, size_t groupOut, size_t (*encode)(char*, const unsigned char*, size_t, int), int variant)
+	{
+		syntax('\"');
+		if (!position) return;
 
+		if (!output.callback || encodedSize < size_t(end-position))
+		{
+			if (reserve(encodedSize))
+			{
+				position += encode(position, data, size, variant);
+				*position = '\0';
+			}
+		}
+		else while (size && position)
+		{
+			size_t groups = size_t(end-position-1) / groupOut;
+			if (!groups && flush()) groups = size_t(end-position-1) / groupOut;
+			if (!groups) { position = 0; return; } // Failed to flush, or a buffer too small for even one group
 
+			const size_t piece = groups * groupIn < size ? groups * groupIn : size;
+			position += encode(position, data, piece, variant);
+			*position = '\0';
+			data     += piece;
+			size     -= piece;
+		}
 
-	objectWriter::objectWriter(json::writer& w, noKeyTag)
-		: w         (w)
-		, parentLock(w.locked)
-		, locked    (false)
-		, needsComma(false)
+		syntax('\"');
+	}
+
+	void writer::operator()(         const char* value)
 	{
-		if (parentLock) { w.error("objectWriter constructed against already locked writer!"); return; }
-		parentLock = true;
-		w.syntax("{");
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		if (!value ) { syntax("null"); return; }
+		escape(value, (size_t)-1);
 	}
 
-	objectWriter::objectWriter(arrayWriter& parent, noKeyTag)
-		: w         (parent.w)
-		, parentLock(parent.locked)
-		, locked    (false)
-		, needsComma(false)
+	void writer::operator()(const char* value, size_t size)
 	{
-		if (parentLock) { w.error("objectWriter constructed against already locked arrayWriter!"); return; }
-		parentLock = true;
-		if (parent.needsComma) w.syntax(",");
-		parent.needsComma = true;
-		w.syntax("{");
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		if (!value ) { syntax("null"); return; }
+		escape(value, size);
 	}
 
-	objectWriter::objectWriter(objectWriter& parent, const char* key)
-		: w         (parent.w)
-		, parentLock(parent.locked)
-		, locked    (false)
-		, needsComma(false)
+	void writer::operator()(const std::string& value)
 	{
-		if (parentLock) { w.error("objectWriter constructed against already locked objectWriter!"); return; }
-		parentLock = true;
-		if (parent.needsComma) w.syntax(",");
-		parent.needsComma = true;
-		w(key);
-		w.syntax(":{");
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		escape(value.data(), value.size());
 	}
 
-	objectWriter::~objectWriter()
+	void writer::operator()(const json::utf8& value)
 	{
-		w.syntax("}");
-		parentLock = false;
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		if (!value.data) { syntax("null"); return; }
+		escape(value.data, value.size, true);
 	}
 
-	arrayWriter::arrayWriter(json::writer& w, noKeyTag)
-		: w         (w)
-		, parentLock(w.locked)
-		, locked    (false)
-		, needsComma(false)
+	void writer::operator()(const wchar_t* value)
 	{
-		if (parentLock) { w.error("objectWriter constructed against already locked writer!"); return; }
-		parentLock = true;
-		w.syntax("[");
+		(*this)(json::wide(value));
 	}
 
-	arrayWriter::arrayWriter(arrayWriter& parent, noKeyTag)
-		: w         (parent.w)
-		, parentLock(parent.locked)
-		, locked    (false)
-		, needsComma(false)
+	void writer::operator()(const std::wstring& value)
 	{
-		if (parentLock) { w.error("objectWriter constructed against already locked arrayWriter!"); return; }
-		parentLock = true;
-		if (parent.needsComma) w.syntax(",");
-		parent.needsComma = true;
-		w.syntax("[");
+		(*this)(json::wide(value));
 	}
 
-	arrayWriter::arrayWriter(objectWriter& parent, const char* key)
-		: w         (parent.w)
-		, parentLock(parent.locked)
-		, locked    (false)
-		, needsComma(false)
+	void writer::operator()(const json::wide& value)
 	{
-		if (parentLock) { w.error("objectWriter constructed against already locked objectWriter!"); return; }
-		parentLock = true;
-		if (parent.needsComma) w.syntax(",");
-		parent.needsComma = true;
-		w(key);
-		w.syntax(":[");
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		if (!value.data) { syntax("null"); return; }
+
+		const bool utf8 = value.output == json::wide::utf8Output;
+		if (value.unitSize == 2) transcode((const unsigned short*)value.data, value.size, utf8);
+		else                     transcode((const unsigned int*  )value.data, value.size, utf8);
 	}
 
-	arrayWriter::~arrayWriter()
+	void writer::operator()(const json::raw& value)
 	{
-		w.syntax("]");
-		parentLock = false;
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		if (!value.data) { syntax("null"); return; }
+		if (gathering && value.size >= gathering->threshold) reference(value.data, value.size);
+		else write(value.data, value.size);
 	}
 
+	void writer::operator()(const json::base64& value)
+	{
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		if (!value.data) { syntax("null"); return; }
+		const size_t encodedSize = value.chars == json::base64::standard ? (value.size + 2) / 3 * 4 : (value.size * 4 + 2) / 3;
+		blob((const unsigned char*)value.data, value.size, encodedSize, 3, 4, encodeBase64, value.chars);
+	}
+
+	void writer::operator()(const json::hex& value)
+	{
+		if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; }
+		if (!value.data) { syntax("null"); return; }
+		blob((const unsigned char*)value.data, value.size, value.size * 2, 1, 2, encodeHex, 0);
+	}
+
+	void writer::operator()(unsigned int         value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; integer(value, false); }
+	void writer::operator()(  signed int         value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; integer(value < 0 ? 0u-(unsigned int)value : (unsigned int)value, value < 0); }
+	void writer::operator()(unsigned long        value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; integer(value, false); }
+	void writer::operator()(  signed long        value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; integer(value < 0 ? 0ul-(unsigned long)value : (unsigned long)value, value < 0); }
+	void writer::operator()(unsigned long long   value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; integer(value, false); }
+	void writer::operator()(  signed long long   value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; integer(value < 0 ? 0ull-(unsigned long long)value : (unsigned long long)value, value < 0); }
+	void writer::operator()(         float       value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; char buf[detail::maxFloatChars]; write(buf, detail::formatFloat (buf, value)); }
+	void writer::operator()(         double      value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; char buf[detail::maxFloatChars]; write(buf, detail::formatDouble(buf, value)); }
+	void writer::operator()(         long double value) { if (!locked) { error("writer::operator()(...) invoked without being locked by a scope!"); return; } if (!position) return; char buf[detail::maxFloatChars]; write(buf, detail::formatDouble(buf, (double)value)); }
+
 }} // namespace mmk::json
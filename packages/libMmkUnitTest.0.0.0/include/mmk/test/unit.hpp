@@ -0,0 +1,22 @@
+// Local stand-in for the libMmkUnitTest nuget package (not part of the repository).
+#pragma once
+#include <cstdio>
+namespace mmk { namespace test { namespace unit {
+	typedef void (*categoryFn)();
+	int  registerCategory(const char* name, categoryFn fn);
+	bool beginTest(const char* name);
+	void fail(const char* file, int line, const char* msg);
+	int  run(int argc, char** argv);
+}}}
+#define ZMMK_UT_CAT2(a,b) a##b
+#define ZMMK_UT_CAT(a,b) ZMMK_UT_CAT2(a,b)
+#define MMK_UNIT_TEST_CATEGORY(name) \
+	static void ZMMK_UT_CAT(zmmk_ut_cat_,__LINE__)(); \
+	static int ZMMK_UT_CAT(zmmk_ut_reg_,__LINE__) = ::mmk::test::unit::registerCategory(name, &ZMMK_UT_CAT(zmmk_ut_cat_,__LINE__)); \
+	static void ZMMK_UT_CAT(zmmk_ut_cat_,__LINE__)()
+#define MMK_UNIT_TEST(name) for (bool zmmk_once = ::mmk::test::unit::beginTest(name); zmmk_once; zmmk_once = false)
+#define ASSERT_MSG(cond, msg) do { if (!(cond)) ::mmk::test::unit::fail(__FILE__, __LINE__, msg); } while(0)
+#define ASSERT(cond) ASSERT_MSG(cond, #cond)
+#define ASSERT_CMP_MSG(a, op, b, msg) ASSERT_MSG((a) op (b), msg)
+#define ASSERT_CMP(a, op, b) ASSERT_MSG((a) op (b), #a " " #op " " #b)
+#define ASSERT_CMP_FMT(a, op, b, ...) do { if (!((a) op (b))) { char zbuf[4096]; snprintf(zbuf, sizeof(zbuf), __VA_ARGS__); ::mmk::test::unit::fail(__FILE__, __LINE__, zbuf); } } while(0)
@@ -0,0 +1,10 @@
+#include <mmk/test/unit.hpp>
+#include <cstdio>
+namespace mmk { namespace test { namespace unit {
+	static const char* names[256]; static categoryFn fns[256]; static int count;
+	static int failures, tests;
+	int registerCategory(const char* name, categoryFn fn) { names[count] = name; fns[count++] = fn; return 0; }
+	bool beginTest(const char* name) { ++tests; printf("  %s\n", name); return true; }
+	void fail(const char* file, int line, const char* msg) { ++failures; printf("    FAIL %s:%d: %s\n", file, line, msg); }
+	int run(int, char**) { for (int i=0;i<count;++i) { printf("%s\n", names[i]); fns[i](); } printf("%d tests, %d failures\n", tests, failures); return failures ? 1 : 0; }
+}}}
@@ -0,0 +1,58 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// The same macros and scopes as main.cpp, switched to CBOR at compile time.  Only this file - a real program should
+// pick one format everywhere, like MMK_JSON_WRITER_UNCHECKED.
+#define MMK_JSON_WRITER_FORMAT_CBOR
+
+#include <mmk/json/writer.hpp>
+#include <mmk/test/unit.hpp>
+#include <string>
+#include <vector>
+
+namespace
+{
+	template < typename ObjectWriter > void writeDevice(ObjectWriter& device)
+	{
+		device("id", 7);
+		MMK_JSON_WRITER_OBJECT_ARRAY(device, "tags") { device("a"); device("b"); }
+		const int readings[] = { 1, 2 };
+		device.array("readings", readings);
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Binary formats (macros)")
+{
+	MMK_UNIT_TEST("Macros write CBOR when MMK_JSON_WRITER_FORMAT_CBOR is defined")
+	{
+		const unsigned char expected[] =
+		{
+			0xbf, 0x62,'i','d', 0x07, 0x64,'t','a','g','s', 0x9f, 0x61,'a', 0x61,'b', 0xff,
+			0x68,'r','e','a','d','i','n','g','s', 0x9f, 0x01, 0x02, 0xff, 0xff,
+		};
+		const std::string cbor((const char*)expected, sizeof(expected));
+
+		MMK_JSON_WRITER_ROOT_OBJECT(device, 64) { writeDevice(device); }
+		ASSERT_MSG(!!device, "Writing CBOR shouldn't fail");
+		ASSERT_MSG(std::string(device.c_str(), device.size()) == cbor, "Should be CBOR");
+
+		MMK_JSON_WRITER_MEASURE_OBJECT(measured) { writeDevice(measured); }
+		ASSERT_CMP(measured.required(), ==, cbor.size());
+
+		std::vector<char> buffer;
+		MMK_JSON_WRITER_GROW_OBJECT(grown, buffer, 0) { writeDevice(grown); }
+		ASSERT_MSG(std::string(grown.c_str(), grown.size()) == cbor, "Growable writers should write CBOR too");
+	}
+}
@@ -14,8 +14,28 @@
 */
 
 #include <mmk/json/writer.hpp>
+#include <mmk/json/binary.hpp>
+#include <mmk/json/fields.hpp>
+#include <mmk/json/log.hpp>
+#ifndef _WIN32
+#include <mmk/json/mmap.hpp>
+#endif
+#include <mmk/json/parallel.hpp>
+#include <mmk/json/pull.hpp>
+#include <mmk/json/skeleton.hpp>
 #include <mmk/test/unit.hpp>
+#include <cctype>
+#include <climits>
+#include <cstdio>
 #include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef ZMMK_HAVE_ZLIB // Defined by the Makefile when zlib is installed, and linked
+#include <mmk/json/deflate.hpp>
+#endif
 
 MMK_UNIT_TEST_CATEGORY("Demos")
 {
@@ -148,6 +168,70 @@ MMK_UNIT_TEST_CATEGORY("Edge Conditions")
 	}
 }
 
+namespace
+{
+	bool appendToString(void* context, const char* data, size_t size)
+	{
+		static_cast<std::string*>(context)->append(data, size);
+		return true;
+	}
+
+	// Straightforward scalar reference for utf8(...) string contents.
+	std::string referenceUtf8(const std::string& input)
+	{
+		std::string out;
+		for (size_t i = 0; i < input.size(); )
+		{
+			const unsigned char ch = (unsigned char)input[i];
+			if (ch < 0x80)
+			{
+				char escaped[8];
+				switch (ch)
+				{
+				case '\"': out += "\\\""; break;
+				case '\\': out += "\\\\"; break;
+				case '\b': out += "\\b";  break;
+				case '\f': out += "\\f";  break;
+				case '\n': out += "\\n";  break;
+				case '\r': out += "\\r";  break;
+				case '\t': out += "\\t";  break;
+				default:
+					if (ch >= 0x20 && ch != 0x7F) out += (char)ch;
+					else { snprintf(escaped, sizeof(escaped), "\\u%04x", ch); out += escaped; }
+					break;
+				}
+				++i;
+				continue;
+			}
+
+			// Unicode Table 3-7, "Well-Formed UTF-8 Byte Sequences"
+			size_t length = 0;
+			unsigned char lo = 0x80, hi = 0xBF;
+			if      (ch >= 0xC2 && ch <= 0xDF) length = 2;
+			else if (ch == 0xE0)               length = 3, lo = 0xA0;
+			else if (ch == 0xED)               length = 3, hi = 0x9F;
+			else if (ch >= 0xE1 && ch <= 0xEF) length = 3;
+			else if (ch == 0xF0)               length = 4, lo = 0x90;
+			else if (ch == 0xF4)               length = 4, hi = 0x8F;
+			else if (ch >= 0xF1 && ch <= 0xF3) length = 4;
+
+			size_t valid = length ? 1 : 0;
+			while (valid && valid < length && i + valid < input.size())
+			{
+				const unsigned char next = (unsigned char)input[i + valid];
+				if (next < lo || next > hi) break;
+				lo = 0x80, hi = 0xBF;
+				++valid;
+			}
+
+			if (length && valid == length) out.append(input, i, length);
+			else                           out += "\xEF\xBF\xBD";
+			i += valid ? valid : 1;
+		}
+		return out;
+	}
+}
+
 MMK_UNIT_TEST_CATEGORY("Formatting tests")
 {
 	MMK_UNIT_TEST("A simple object")
@@ -192,6 +276,161 @@ MMK_UNIT_TEST_CATEGORY("Formatting tests")
 		ASSERT_CMP_FMT(strcmp(a.c_str(), aExpected), ==, 0, "Simple array %s should match expected result %s", a.c_str(), aExpected);
 	}
 
+	MMK_UNIT_TEST("Unchecked scopes write the same JSON")
+	{
+		typedef mmk::json::basic_objectWriter<mmk::json::unchecked> objectWriter;
+		typedef mmk::json::basic_arrayWriter <mmk::json::unchecked> arrayWriter;
+
+		MMK_JSON_WRITER_ROOT(w, 64);
+		{
+			objectWriter o(w, mmk::json::noKeyTag());
+			o("i", 42);
+			{
+				arrayWriter a(o, MMK_JSON_KEY("a"));
+				a(true);
+				objectWriter nested(a, mmk::json::noKeyTag());
+				nested("s", "string");
+			}
+		}
+		ASSERT_MSG(!!w, "Unchecked example shouldn't overflow 64-byte buffer");
+		ASSERT_CMP(std::string(w.c_str()), ==, "{\"i\":42,\"a\":[true,{\"s\":\"string\"}]}");
+	}
+
+	MMK_UNIT_TEST("Pre-escaped keys")
+	{
+		const char oExpected[] = "{\"i\":42,\"a\":[1,2],\"o\":{\"s\":\"string\"},\"v\":[3],\"say \\\"hi\\\"\":true}";
+
+		std::vector<int> v(1, 3);
+		MMK_JSON_WRITER_ROOT_OBJECT( o, 128 )
+		{
+			o(MMK_JSON_KEY("i"), 42);
+			MMK_JSON_WRITER_OBJECT_ARRAY(o, MMK_JSON_KEY("a")) { o(1); o(2); }
+			MMK_JSON_WRITER_OBJECT_OBJECT(o, MMK_JSON_KEY("o")) { o(MMK_JSON_KEY("s"), "string"); }
+			o.array(MMK_JSON_KEY("v"), v);
+			o(MMK_JSON_KEY("say \\\"hi\\\""), true); // Escaping is up to you
+		}
+
+		ASSERT_MSG(!!o, "Pre-escaped keys example shouldn't overflow 128-byte buffer");
+		ASSERT_CMP_FMT(strcmp(o.c_str(), oExpected), ==, 0, "Pre-escaped keys example %s should match expected result %s", o.c_str(), oExpected);
+
+		MMK_JSON_WRITER_ROOT_OBJECT( tight, 10 ) { tight(MMK_JSON_KEY("i"), 42); tight(MMK_JSON_KEY("j"), 1); }
+		ASSERT_MSG(!tight, "Pre-escaped keys should still overflow like any other write");
+	}
+
+	MMK_UNIT_TEST("Integer formatting")
+	{
+		const char aExpected[] =
+		"["
+			"0,9,10,99,100,999,1000,-1,-10,"
+			"2147483647,-2147483648,4294967295,"
+			"9223372036854775807,-9223372036854775808,18446744073709551615,"
+			"4294967296,10000000000000000000"
+		"]";
+
+		MMK_JSON_WRITER_ROOT_ARRAY( a, 256 )
+		{
+			a(0); a(9); a(10); a(99); a(100); a(999); a(1000); a(-1); a(-10);
+			a(INT_MAX); a(INT_MIN); a(UINT_MAX);
+			a(LLONG_MAX); a(LLONG_MIN); a(ULLONG_MAX);
+			a(4294967296ull); a(10000000000000000000ull);
+		}
+
+		ASSERT_MSG(!!a,                                     "Integers example shouldn't overflow 256-byte buffer");
+		ASSERT_CMP_FMT(strcmp(a.c_str(), aExpected), ==, 0, "Integers example %s should match expected result %s", a.c_str(), aExpected);
+
+		// Every length of -123456789, with and without room for the '\0'
+		for (size_t size = 1; size < 16; ++size)
+		{
+			char buffer[16];
+			mmk::json::writer w(buffer, size);
+			{
+				mmk::json::arrayWriter aw(w, mmk::json::noKeyTag());
+				aw(-123456789);
+			}
+			ASSERT_CMP_FMT(!!w, ==, size >= sizeof("[-123456789]"), "[-123456789] should fit exactly when there's room for the terminator (buffer size %u)", (unsigned)size);
+		}
+	}
+
+	MMK_UNIT_TEST("Numeric arrays")
+	{
+		const int                values[]  = { 0, 9, 10, -1, INT_MAX, INT_MIN, 123456 };
+		const std::vector<long long> longs = { 0, LLONG_MAX, LLONG_MIN, -42 };
+		const std::vector<unsigned long long> uwide = { 0, ULLONG_MAX, 10000000000000000000ull };
+		const float              floats[]  = { 0.5f, -1.0f, 3.14159f, 1e-9f };
+		const std::vector<double> doubles  = { 0.1, -2.5, 1e300, 42.0, std::numeric_limits<double>::infinity() };
+		const std::vector<bool>  bools     = { true, false };
+
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024)
+		{
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "i") for (size_t i = 0; i < 7; ++i) expected(values[i]);
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "l") for (size_t i = 0; i < longs.size(); ++i) expected(longs[i]);
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "u") for (size_t i = 0; i < uwide.size(); ++i) expected(uwide[i]);
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "f") for (size_t i = 0; i < 4; ++i) expected(floats[i]);
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "d") for (size_t i = 0; i < doubles.size(); ++i) expected(doubles[i]);
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "b") { expected(true); expected(false); }
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "p") { expected(9); expected(10); }
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "e") { (void)expected; }
+		}
+		ASSERT_MSG(!!expected, "Reference example shouldn't overflow 1024-byte buffer");
+
+		MMK_JSON_WRITER_ROOT_OBJECT(o, 1024)
+		{
+			o.array("i", values);
+			o.array("l", longs);
+			o.array("u", uwide);
+			o.array("f", floats);
+			o.array("d", doubles);
+			o.array("b", bools);
+			o.array("p", values + 1, 2);
+			o.array("e", std::vector<int>());
+		}
+		ASSERT_CMP_FMT(strcmp(o.c_str(), expected.c_str()), ==, 0, "Bulk arrays %s should match %s", o.c_str(), expected.c_str());
+
+		// Same overflow behavior as writing elements one at a time, for every buffer size
+		for (size_t size = 1; size < 128; ++size)
+		{
+			char bulkBuffer[128], serialBuffer[128];
+			mmk::json::writer bulk(bulkBuffer, size), serial(serialBuffer, size);
+			MMK_JSON_WRITER_ARRAY_ARRAY(bulk)   { bulk(1); bulk.array(values); bulk.array(longs); }
+			MMK_JSON_WRITER_ARRAY_ARRAY(serial) { serial(1); MMK_JSON_WRITER_ARRAY_ARRAY(serial) for (size_t i = 0; i < 7; ++i) serial(values[i]); MMK_JSON_WRITER_ARRAY_ARRAY(serial) for (size_t i = 0; i < longs.size(); ++i) serial(longs[i]); }
+			ASSERT_CMP_FMT(!!bulk, ==, !!serial, "Bulk and serial writers should agree on overflowing a %u-byte buffer", (unsigned)size);
+			if (bulk && serial) ASSERT_CMP(std::string(bulk.c_str()), ==, serial.c_str());
+		}
+
+		// Streaming through a small buffer
+		std::vector<int> many;
+		for (int i = 0; i < 1000; ++i) many.push_back(i * 7919 - 500000);
+		std::string streamed;
+		MMK_JSON_WRITER_STREAM_ARRAY(a, 32, mmk::json::sink(appendToString, &streamed)) { a.array(many); }
+		MMK_JSON_WRITER_ROOT_ARRAY(reference, 16 * 1024) { MMK_JSON_WRITER_ARRAY_ARRAY(reference) for (size_t i = 0; i < many.size(); ++i) reference(many[i]); }
+		ASSERT_CMP(streamed, ==, reference.c_str());
+	}
+
+	MMK_UNIT_TEST("Floating point formatting")
+	{
+		// Shortest decimal that round-trips, laid out like JSON.stringify (minus the redundant '+' in exponents.)
+		const char aExpected[] =
+		"["
+			"42,0.1,-0,1e-9,1.5e-7,0.000001,123.456,1e21,100000000000000000000,"
+			"5e-324,1.7976931348623157e308,"
+			"1.1,0.3,16777216,3.4028235e38,"
+			"0.5,"
+			"null,null,null"
+		"]";
+
+		MMK_JSON_WRITER_ROOT_ARRAY( a, 256 )
+		{
+			a(42.0); a(0.1); a(-0.0); a(1e-9); a(1.5e-7); a(0.000001); a(123.456); a(1e21); a(1e20);
+			a(5e-324); a(1.7976931348623157e308);
+			a(1.1f); a(0.3f); a(16777216.0f); a(3.4028235e38f);
+			a(0.5L);
+			a(std::numeric_limits<double>::infinity()); a(-std::numeric_limits<float>::infinity()); a(std::numeric_limits<double>::quiet_NaN());
+		}
+
+		ASSERT_MSG(!!a,                                     "Floats example shouldn't overflow 256-byte buffer");
+		ASSERT_CMP_FMT(strcmp(a.c_str(), aExpected), ==, 0, "Floats example %s should match expected result %s", a.c_str(), aExpected);
+	}
+
 	MMK_UNIT_TEST("String encoding")
 	{
 		const char aExpected[] =
@@ -208,10 +447,9 @@ MMK_UNIT_TEST_CATEGORY("Formatting tests")
 			// Additionally:
 			//    Other low ASCII values (<128) will be copied literally
 			//    High ASCII values (>=128) will be translated to \uNNNN unicode escape syntax - leaving the output pure 7-bit ASCII, avoiding any potential encoding issues.
+			// See "UTF-8 strings" for o("s", utf8(...)) and o(utf8("s"), ...), which pass multi-byte characters through instead.
 			// In the future, I'll probably want to add:
-			//    o("s", utf8(...));  // to treat >=128 values as utf8 encoding instead of high ASCII, allowing multi-character inputs.
 			//    o("s", utf16(...)); // for wchar_t support
-			//    o(utf8("s"), ...);  // Because why limit encoding to values?
 			a("\x01\x1f\x20\x7e\x7f\x80string");
 			a("\" \\ / \b \f \n \r \t");
 		}
@@ -221,6 +459,1598 @@ MMK_UNIT_TEST_CATEGORY("Formatting tests")
 		ASSERT_CMP_MSG(a.size(), ==, sizeof(aExpected)-1,   "Strings example shouldn't overflow 256-byte buffer and should match expected results length");
 		ASSERT_CMP_FMT(strcmp(a.c_str(), aExpected), ==, 0, "Strings example %s should match expected result %s", a.c_str(), aExpected);
 	}
+
+	MMK_UNIT_TEST("UTF-8 strings")
+	{
+		const char oExpected[] =
+		"{"
+			"\"ascii\":"        "\"plain \\\"text\\\"\\n\\u007f\""                                  ","
+			"\"valid\":"        "\"\xC3\xA9 \xE4\xB8\xAD\xE6\x96\x87 \xF0\x9F\x98\x80\""                 ","
+			"\"high ascii\":"   "\"\\u00e9\""                                                            ","
+			"\"\xE9\x94\xAE\":" "\"key\""                                                                ","
+			"\"invalid\":"      "[\"\xEF\xBF\xBD\",\"\xEF\xBF\xBD\xEF\xBF\xBD\",\"\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD\",\"\xEF\xBF\xBDx\",\"a\xEF\xBF\xBD\",\"\xEF\xBF\xBD\",\"\xEF\xBF\xBD\xEF\xBF\xBD\"]" ","
+			"\"bounded\":"      "\"\xE4\xB8\xAD\xEF\xBF\xBD\""
+		"}";
+
+		MMK_JSON_WRITER_ROOT_OBJECT( o, 256 )
+		{
+			o("ascii",                      mmk::json::utf8("plain \"text\"\n\x7f"));
+			o("valid",                      mmk::json::utf8("\xC3\xA9 \xE4\xB8\xAD\xE6\x96\x87 \xF0\x9F\x98\x80"));
+			o("high ascii",                 "\xE9");
+			o(mmk::json::utf8("\xE9\x94\xAE"), "key");
+			MMK_JSON_WRITER_OBJECT_ARRAY(o, mmk::json::utf8("invalid"))
+			{
+				o(mmk::json::utf8("\x80"));             // Lone continuation
+				o(mmk::json::utf8("\xC0\x80"));         // Overlong (each byte is its own maximal subpart)
+				o(mmk::json::utf8("\xED\xA0\x80"));     // Surrogate
+				o(mmk::json::utf8("\xE4\xB8x"));        // Truncated (one replacement for the whole maximal subpart)
+				o(mmk::json::utf8("a\xF0\x9F\x98"));    // Truncated by the terminator
+				o(mmk::json::utf8("\xF5"));             // > U+10FFFF
+				o(mmk::json::utf8("\xF4\x90"));         // > U+10FFFF (F4 can't start anything that 90 continues)
+			}
+			o("bounded", mmk::json::utf8("\xE4\xB8\xAD\xE6\x96\x87", 4)); // Length cuts the second character short
+		}
+
+		ASSERT_MSG(!!o, "UTF-8 example shouldn't overflow 256-byte buffer");
+		ASSERT_CMP_FMT(strcmp(o.c_str(), oExpected), ==, 0, "UTF-8 example %s should match expected result %s", o.c_str(), oExpected);
+	}
+
+	MMK_UNIT_TEST("UTF-8 fuzzing")
+	{
+		// Random mixes of ASCII, valid and invalid sequences at every alignment, checked against the scalar reference.
+		static const char* const pieces[] =
+		{
+			"a", "bc", "defghijklmnopqrstuvwxyz0123456789", "\"", "\\", "\n", "\x01", "\x7f",
+			"\xC3\xA9", "\xE4\xB8\xAD", "\xF0\x9F\x98\x80", "\xEF\xBF\xBF", "\xF4\x8F\xBF\xBF",
+			"\x80", "\xBF", "\xC0", "\xC1\xBF", "\xE0\x80", "\xE0\x9F\xBF", "\xED\xA0", "\xF0\x8F", "\xF4\x90", "\xF8", "\xFF", "\xE4", "\xF0\x9F",
+		};
+
+		unsigned long long x = 0x9E3779B97F4A7C15ull;
+		char buffer[512];
+		for (int iteration = 0; iteration < 5000; ++iteration)
+		{
+			std::string input;
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			const size_t count = (size_t)(x % 48);
+			for (size_t i = 0; i < count; ++i)
+			{
+				x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+				input += pieces[x % (sizeof(pieces)/sizeof(pieces[0]))];
+			}
+
+			const std::string expected = "[\"" + referenceUtf8(input) + "\"]";
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			const size_t offset = (size_t)(x % 64);
+			if (offset + input.size() + 1 > sizeof(buffer)) continue;
+			memset(buffer, '\xE4', sizeof(buffer)); // Lead bytes around the input, to catch anything reading outside it
+			memcpy(buffer + offset, input.c_str(), input.size() + 1);
+
+			MMK_JSON_WRITER_ROOT_ARRAY( terminated, 4096 ) { terminated(mmk::json::utf8(buffer + offset)); }
+			ASSERT_CMP(std::string(terminated.c_str()), ==, expected);
+
+			buffer[offset + input.size()] = '\xE4';
+			MMK_JSON_WRITER_ROOT_ARRAY( bounded, 4096 ) { bounded(mmk::json::utf8(buffer + offset, input.size())); }
+			ASSERT_CMP(std::string(bounded.c_str()), ==, expected);
+		}
+	}
+
+	MMK_UNIT_TEST("Wide strings")
+	{
+		const char oExpected[] =
+		"{"
+			"\"w\":"            "\"wide \\\"text\\\"\\n\""                                      ","
+			"\"escaped\":"      "\"\\u00e9 \\u4e2d \\ud83d\\ude00\""                                ","
+			"\"utf8\":"         "\"\xC3\xA9 \xE4\xB8\xAD \xF0\x9F\x98\x80\""                         ","
+			"\"\\u00e9\":"      "\"wide key\""                                                      ","
+			"\"std\":"          "\"a\\u0000b\""                                                     ","
+			"\"utf16\":"        "[\"\xF0\x9F\x98\x80\",\"\\ufffdx\",\"x\\ufffd\",\"\\ufffd\\ufffd\",\"\xE4\xB8\xAD\"]"
+		"}";
+
+		const unsigned short smiley[]   = { 0xD83D, 0xDE00, 0 };
+		const unsigned short unpaired[] = { 0xD83D, 'x', 0 };
+		const unsigned short lowOnly[]  = { 'x', 0xDE00, 0 };
+		const unsigned short reversed[] = { 0xDE00, 0xD83D, 0 };
+
+		MMK_JSON_WRITER_ROOT_OBJECT( o, 512 )
+		{
+			o("w",                          L"wide \"text\"\n");
+			o("escaped",                    mmk::json::wide(L"\u00e9 \u4e2d \U0001F600"));
+			o("utf8",                       mmk::json::wide(L"\u00e9 \u4e2d \U0001F600", mmk::json::wide::utf8Output));
+			o(L"\u00e9",                    L"wide key");
+			o("std",                        std::wstring(L"a\0b", 3));
+			MMK_JSON_WRITER_OBJECT_ARRAY(o, mmk::json::wide(L"utf16"))
+			{
+				o(mmk::json::wide(smiley,   mmk::json::wide::utf8Output));
+				o(mmk::json::wide(unpaired));
+				o(mmk::json::wide(lowOnly));
+				o(mmk::json::wide(reversed));
+				o(mmk::json::wide(u"\u4e2d\u6587", 1, mmk::json::wide::utf8Output)); // Bounded, char16_t
+			}
+		}
+
+		ASSERT_MSG(!!o, "Wide strings example shouldn't overflow 512-byte buffer");
+		ASSERT_CMP_FMT(strcmp(o.c_str(), oExpected), ==, 0, "Wide strings example %s should match expected result %s", o.c_str(), oExpected);
+
+		if (sizeof(wchar_t) == 4)
+		{
+			const wchar_t invalid[] = { (wchar_t)0x110000, (wchar_t)0xD800, 0 };
+			MMK_JSON_WRITER_ROOT_ARRAY( a, 64 ) { a(invalid); }
+			ASSERT_CMP(std::string(a.c_str()), ==, "[\"\\ufffd\\ufffd\"]");
+		}
+
+		// Every length and alignment, to exercise the SIMD scan and bulk narrowing.
+		char16_t source16[128];
+		wchar_t  sourceW [128];
+		for (size_t i = 0; i < 128; ++i) sourceW[i] = source16[i] = (char16_t)('a' + i % 26);
+		for (size_t offset = 0; offset < 16; ++offset) for (size_t length = 0; length < 80; ++length)
+		{
+			const std::string expected = "[\"" + std::string(source16 + offset, source16 + offset + length) + "\"]";
+			MMK_JSON_WRITER_ROOT_ARRAY( a, 256 ) { a(mmk::json::wide(source16 + offset, length)); a(mmk::json::wide(sourceW + offset, length)); }
+			ASSERT_CMP(std::string(a.c_str()), ==, expected.substr(0, expected.size()-1) + ",\"" + expected.substr(2));
+		}
+
+		// Long clean runs narrowed through a tiny streaming buffer.
+		const std::wstring longText(1000, L'w');
+		std::string streamed;
+		MMK_JSON_WRITER_STREAM_ARRAY(s, 16, mmk::json::sink(appendToString, &streamed)) { s(longText); s(L"\u00e9"); }
+		ASSERT_MSG(!!s, "Streaming wide strings shouldn't fail");
+		ASSERT_CMP(streamed, ==, "[\"" + std::string(1000, 'w') + "\",\"\\u00e9\"]");
+	}
+
+	MMK_UNIT_TEST("Length-aware strings")
+	{
+		const char oExpected[] = "{\"n\":\"a\\u0000b\",\"p\":\"abc\",\"s\":\"std\\\"string\",\"k\":\"\",\"a\":[\"xy\",\"\\n\",[\"z\"]]}";
+
+		// Not '\0' terminated - the writer must stop at the length, not at the quote or junk following it.
+		const char unterminated[] = { 'a', 'b', 'c', '\"', 'j', 'u', 'n', 'k' };
+		const std::string embedded("a\0b", 3);
+		std::vector<std::string> strings;
+		strings.push_back("z");
+
+		MMK_JSON_WRITER_ROOT_OBJECT( o, 128 )
+		{
+			o("n", embedded.data(), embedded.size());
+			o(MMK_JSON_KEY("p"), unterminated, 3);
+			o("s", std::string("std\"string"));
+			o("k", unterminated, 0);
+			MMK_JSON_WRITER_OBJECT_ARRAY(o, "a")
+			{
+				o("xyz", 2);
+				o(std::string("\n"));
+				o.array(strings);
+			}
+		}
+
+		ASSERT_MSG(!!o, "Length-aware strings example shouldn't overflow 128-byte buffer");
+		ASSERT_CMP_FMT(strcmp(o.c_str(), oExpected), ==, 0, "Length-aware strings example %s should match expected result %s", o.c_str(), oExpected);
+
+		// Every length and alignment, to exercise the SIMD scan's limit handling.
+		char source[128];
+		for (size_t i = 0; i < sizeof(source); ++i) source[i] = (char)('a' + i % 26);
+		for (size_t offset = 0; offset < 32; ++offset) for (size_t length = 0; length < 64; ++length)
+		{
+			MMK_JSON_WRITER_ROOT_ARRAY( a, 128 ) { a(source + offset, length); }
+			ASSERT_CMP(std::string(a.c_str()), ==, "[\"" + std::string(source + offset, length) + "\"]");
+		}
+	}
+
+	MMK_UNIT_TEST("Raw JSON values")
+	{
+		const char oExpected[] = "{\"device\":{\"os\":\"linux\",\"cores\":8},\"p\":null,\"a\":[1,[2,3],{}]}";
+		const std::string device = "{\"os\":\"linux\",\"cores\":8}";
+
+		MMK_JSON_WRITER_ROOT_OBJECT( o, 128 )
+		{
+			o("device", mmk::json::raw(device));
+			o("p", mmk::json::raw((const char*)0));
+			MMK_JSON_WRITER_OBJECT_ARRAY(o, "a")
+			{
+				o(1);
+				o(mmk::json::raw("[2,3]"));
+				o(mmk::json::raw("{}junk", 2));
+			}
+		}
+
+		ASSERT_MSG(!!o, "Raw JSON example shouldn't overflow 128-byte buffer");
+		ASSERT_CMP_FMT(strcmp(o.c_str(), oExpected), ==, 0, "Raw JSON example %s should match expected result %s", o.c_str(), oExpected);
+
+		MMK_JSON_WRITER_ROOT_ARRAY( tight, 8 ) { tight(mmk::json::raw(device)); }
+		ASSERT_MSG(!tight, "Raw JSON should overflow like any other write");
+	}
+
+	MMK_UNIT_TEST("Long string encoding")
+	{
+		// Strings are scanned in 16/32 byte chunks - place each kind of special character at every offset, at varying alignments.
+		const char specials[] = "\"\\\b\n\x01\x1f\x7f\x80\xff";
+		char input[128];
+		char expected[512];
+
+		for (size_t align = 0; align < 4; ++align)
+		for (size_t length = 1; length < 80; ++length)
+		for (size_t offset = 0; offset < length; ++offset)
+		for (const char* special = specials; *special; ++special)
+		{
+			char* const value = input + align;
+			memset(value, 'x', length);
+			value[length] = '\0';
+			value[offset] = *special;
+
+			char* e = expected;
+			*e++ = '[';
+			*e++ = '\"';
+			for (size_t i = 0; i < length; ++i)
+			{
+				const unsigned char ch = (unsigned char)value[i];
+				if      (ch == '\"') { *e++ = '\\'; *e++ = '\"'; }
+				else if (ch == '\\') { *e++ = '\\'; *e++ = '\\'; }
+				else if (ch == '\b') { *e++ = '\\'; *e++ = 'b'; }
+				else if (ch == '\n') { *e++ = '\\'; *e++ = 'n'; }
+				else if (ch < 0x20 || ch >= 0x7F) e += sprintf(e, "\\u%04x", ch);
+				else *e++ = (char)ch;
+			}
+			*e++ = '\"';
+			*e++ = ']';
+			*e++ = '\0';
+
+			MMK_JSON_WRITER_ROOT_ARRAY(a, 512) { a(value); }
+			ASSERT_MSG(!!a, "Long strings example shouldn't overflow 512-byte buffer");
+			ASSERT_CMP_FMT(strcmp(a.c_str(), expected), ==, 0, "Long strings example %s should match expected result %s", a.c_str(), expected);
+		}
+	}
+}
+
+namespace
+{
+	bool failingSink(void*, const char*, size_t)
+	{
+		return false;
+	}
+
+	template < typename ObjectWriter > void writeStreamingExample(ObjectWriter& o)
+	{
+		o("i", 42);
+		o("s", "a longer string value, with \"escapes\" \x01 that straddles several buffer flushes");
+		o("n", 0.1);
+		o("b", true);
+		MMK_JSON_WRITER_OBJECT_ARRAY(o, "a") { for (int i = 0; i < 20; ++i) o(i * 111); }
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Streaming")
+{
+	MMK_UNIT_TEST("Tiny buffers stream the same output")
+	{
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024) { writeStreamingExample(expected); }
+		ASSERT_MSG(!!expected, "Reference example shouldn't overflow 1024-byte buffer");
+
+		for (size_t size = 8; size <= 64; ++size)
+		{
+			std::string streamed;
+			char buffer[64];
+			mmk::json::writer w(buffer, size, mmk::json::sink(appendToString, &streamed));
+			MMK_JSON_WRITER_ARRAY_OBJECT(w) { writeStreamingExample(w); }
+
+			ASSERT_CMP_FMT(!!w, ==, true, "Streaming through a %u-byte buffer shouldn't fail", (unsigned)size);
+			ASSERT_CMP_FMT(streamed, ==, expected.c_str(), "Streaming through a %u-byte buffer should produce %s, not %s", (unsigned)size, expected.c_str(), streamed.c_str());
+			ASSERT_CMP_MSG(w.size(), ==, 0, "Closing the root scope should've flushed everything");
+		}
+	}
+
+	MMK_UNIT_TEST("Stream macros and flushing")
+	{
+		std::string streamed;
+		MMK_JSON_WRITER_STREAM_ARRAY(a, 16, mmk::json::sink(appendToString, &streamed))
+		{
+			a("0123456789");
+			ASSERT_CMP_MSG(streamed.size(), ==, 0, "Nothing should be flushed until the buffer fills");
+			a("0123456789");
+			ASSERT_CMP_MSG(streamed, ==, "[\"0123456789\",\"", "Buffer should've flushed to make room for the second string");
+		}
+		ASSERT_CMP(streamed, ==, "[\"0123456789\",\"0123456789\"]");
+	}
+
+	MMK_UNIT_TEST("Failing sinks fail the writer")
+	{
+		MMK_JSON_WRITER_STREAM_OBJECT(o, 16, mmk::json::sink(failingSink, 0)) { writeStreamingExample(o); }
+		ASSERT_MSG(!o,        "Writer should fail once its sink does");
+		ASSERT_MSG(!o.c_str(), "Failed streaming writers should have null results");
+	}
+
+	MMK_UNIT_TEST("File sinks")
+	{
+		std::string expected = "[0";
+		for (int i = 1; i < 100; ++i) expected += "," + std::to_string(i);
+		expected += "]";
+
+		char contents[1024] = {};
+		if (FILE* file = tmpfile())
+		{
+			MMK_JSON_WRITER_STREAM_ARRAY(a, 32, mmk::json::fileSink(file)) { for (int i = 0; i < 100; ++i) a(i); }
+			ASSERT_MSG(!!a, "Streaming to a file shouldn't fail");
+
+			rewind(file);
+			const size_t read = fread(contents, 1, sizeof(contents)-1, file);
+			ASSERT_CMP(read, ==, expected.size());
+			fclose(file);
+		}
+		ASSERT_CMP_FMT(expected, ==, contents, "File should contain %s, not %s", expected.c_str(), contents);
+	}
+}
+
+#ifdef ZMMK_HAVE_ZLIB
+namespace
+{
+	std::string inflateAll(const std::string& compressed, int windowBits)
+	{
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, windowBits) != Z_OK) return "(inflateInit2 failed)";
+
+		std::string result;
+		char chunk[256];
+		stream.next_in  = (Bytef*)compressed.data();
+		stream.avail_in = (uInt)compressed.size();
+		int status = Z_OK;
+		while (status == Z_OK)
+		{
+			stream.next_out  = (Bytef*)chunk;
+			stream.avail_out = sizeof(chunk);
+			status = inflate(&stream, Z_NO_FLUSH);
+			result.append(chunk, sizeof(chunk) - stream.avail_out);
+		}
+		inflateEnd(&stream);
+		return status == Z_STREAM_END && !stream.avail_in ? result : "(corrupt stream)";
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Compressing")
+{
+	MMK_UNIT_TEST("Deflated output inflates back to the same JSON")
+	{
+		std::vector<char> expected;
+		MMK_JSON_WRITER_GROW_ARRAY(e, expected, 0) { for (int i = 0; i < 5000; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(e) writeStreamingExample(e); }
+		ASSERT_MSG(!!e, "Reference example shouldn't fail");
+
+		const mmk::json::deflater::format formats[]     = { mmk::json::deflater::gzip, mmk::json::deflater::zlib, mmk::json::deflater::rawDeflate };
+		const int                         windowBits[]  = { 15 + 16, 15, -15 };
+		for (size_t f = 0; f < 3; ++f)
+		{
+			std::string compressed;
+			mmk::json::deflater z(mmk::json::sink(appendToString, &compressed), formats[f]);
+			MMK_JSON_WRITER_STREAM_ARRAY(a, 64, mmk::json::deflateSink(z)) { for (int i = 0; i < 5000; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(a) writeStreamingExample(a); }
+			ASSERT_MSG(!!a, "Compressing shouldn't fail the writer");
+			ASSERT_MSG(z.finish(), "Finishing the stream shouldn't fail");
+			ASSERT_CMP(z.totalIn(), ==, strlen(e.c_str()));
+			ASSERT_CMP(z.totalOut(), ==, compressed.size());
+			ASSERT_CMP_FMT(compressed.size() * 10, <, z.totalIn(), "Repetitive JSON should compress well, format %u", (unsigned)f);
+			ASSERT_CMP_FMT(inflateAll(compressed, windowBits[f]) == e.c_str(), ==, true, "Format %u should round trip", (unsigned)f);
+			ASSERT_MSG(!z.write("x", 1), "Nothing can be written after finish()");
+		}
+	}
+
+	MMK_UNIT_TEST("Failing output sinks fail the writer")
+	{
+		mmk::json::deflater z(mmk::json::sink(failingSink, 0), mmk::json::deflater::gzip, 0); // Stored blocks, so output starts early
+		MMK_JSON_WRITER_STREAM_ARRAY(a, 64, mmk::json::deflateSink(z)) { for (int i = 0; i < 100000; ++i) a(i); }
+		ASSERT_MSG(!a,      "Writer should fail once the compressor's sink does");
+		ASSERT_MSG(!z.ok(), "Compressor should report the failure");
+		ASSERT_MSG(!z.finish(), "Finishing a failed stream should fail");
+	}
+}
+#endif
+
+MMK_UNIT_TEST_CATEGORY("Growable buffers")
+{
+	MMK_UNIT_TEST("Growing from empty produces the same output")
+	{
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024) { writeStreamingExample(expected); }
+		ASSERT_MSG(!!expected, "Reference example shouldn't overflow 1024-byte buffer");
+
+		std::vector<char> buffer;
+		MMK_JSON_WRITER_GROW_OBJECT(o, buffer, 0) { writeStreamingExample(o); }
+		ASSERT_MSG(!!o, "Growable writers shouldn't fail");
+		ASSERT_CMP(o.size(), ==, expected.size());
+		ASSERT_CMP_FMT(strcmp(o.c_str(), expected.c_str()), ==, 0, "Growable writer output %s should match %s", o.c_str(), expected.c_str());
+		ASSERT_CMP_MSG(buffer.size(), >, o.size(), "Buffer should have room for the '\\0' terminator");
+	}
+
+	MMK_UNIT_TEST("Values larger than several doublings")
+	{
+		const std::string value(10000, 'x');
+		std::vector<char> buffer;
+		MMK_JSON_WRITER_GROW_ARRAY(a, buffer, 0) { a(value.c_str()); a(1); }
+		ASSERT_MSG(!!a, "Growable writers shouldn't fail");
+		ASSERT_CMP(std::string(a.c_str()), ==, "[\"" + value + "\",1]");
+	}
+
+	MMK_UNIT_TEST("Expected size hints avoid reallocation")
+	{
+		std::vector<char> buffer;
+		MMK_JSON_WRITER_GROW_OBJECT(o, buffer, 4096)
+		{
+			const char* const data = buffer.data();
+			writeStreamingExample(o);
+			ASSERT_CMP_MSG((const void*)buffer.data(), ==, (const void*)data, "Output within the hint shouldn't reallocate");
+		}
+		ASSERT_MSG(!!o, "Growable writers shouldn't fail");
+		ASSERT_CMP(buffer.size(), ==, 4097u);
+	}
+
+#ifndef _WIN32
+	MMK_UNIT_TEST("Memory mapped files grow a window at a time, and are trimmed on close")
+	{
+		std::vector<char> buffer;
+		const mmk::json::raw nul("\"\0\"", 3); // Raw values may hold '\0's - the end of the document is no '\0' search
+		MMK_JSON_WRITER_GROW_ARRAY(expected, buffer, 0) { for (int i = 0; i < 5000; ++i) expected(i); expected(nul); }
+		const std::string expectedContents(expected.c_str(), expected.size());
+
+		char path[] = "/tmp/mmkJsonMappedXXXXXX";
+		const int fd = mkstemp(path);
+		ASSERT_MSG(fd != -1, "mkstemp() failed");
+		close(fd);
+
+		for (int closeExplicitly = 0; closeExplicitly < 2; ++closeExplicitly)
+		{
+			{
+				mmk::json::mappedFile file(path, 4096); // Several windows
+				mmk::json::writer w(mmk::json::mappedStorage(file));
+				MMK_JSON_WRITER_ARRAY_ARRAY(w) { for (int i = 0; i < 5000; ++i) w(i); w(nul); }
+				ASSERT_MSG(!!w, "Mapped writers shouldn't fail");
+				ASSERT_CMP(w.size(), ==, expected.size());
+				if (closeExplicitly) ASSERT_MSG(file.close(w.size()), "Closing shouldn't fail");
+			} // ...or the destructor trims to where the root scope closed
+
+			std::string contents;
+			if (FILE* f = fopen(path, "rb"))
+			{
+				char chunk[4096];
+				for (size_t read; (read = fread(chunk, 1, sizeof(chunk), f)) != 0; ) contents.append(chunk, read);
+				fclose(f);
+			}
+			ASSERT_CMP(contents, ==, expectedContents);
+		}
+		remove(path);
+	}
+#endif
+}
+
+namespace
+{
+	template < typename ObjectWriter > void writeMeasuringExample(ObjectWriter& o)
+	{
+		writeStreamingExample(o);
+		const double samples[] = { 0.5, -1e-9, 12345.678, 3.0 };
+		const long long ids[] = { 1, -22, 333, -4444, 9000000000000000000ll };
+		o.array("samples", samples);
+		o.array("ids", ids);
+		o("utf8", mmk::json::utf8("caf\xC3\xA9 \xE6\x97\xA5\xE6\x9C\xAC \xFF"));
+		o("wide", L"wide \u00e9\u65e5 \"quoted\"");
+		o("raw", mmk::json::raw("{\"pre\":[1,2]}"));
+		o(MMK_JSON_KEY("key"), -7);
+		MMK_JSON_WRITER_OBJECT_OBJECT(o, "nested") { o("null", (const char*)0); o("f", 1.5f); }
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Measuring")
+{
+	MMK_UNIT_TEST("Dry runs count exactly what would be written")
+	{
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024) { writeMeasuringExample(expected); }
+		ASSERT_MSG(!!expected, "Reference example shouldn't overflow 1024-byte buffer");
+
+		MMK_JSON_WRITER_MEASURE_OBJECT(m) { writeMeasuringExample(m); }
+		ASSERT_MSG(!!m, "Dry runs shouldn't fail");
+		ASSERT_MSG(!m.c_str(), "Dry runs have no output to return");
+		ASSERT_CMP(m.size(), ==, 0u);
+		ASSERT_CMP(m.required(), ==, expected.size());
+		ASSERT_CMP_MSG(expected.required(), ==, expected.size(), "Writers that fit should require exactly what they wrote");
+
+		std::vector<char> buffer;
+		MMK_JSON_WRITER_GROW_OBJECT(o, buffer, m.required())
+		{
+			const char* const data = buffer.data();
+			writeMeasuringExample(o);
+			ASSERT_CMP_MSG((const void*)buffer.data(), ==, (const void*)data, "Sizing from a dry run shouldn't reallocate");
+		}
+		ASSERT_CMP(std::string(o.c_str()), ==, expected.c_str());
+	}
+
+	MMK_UNIT_TEST("Overflowing writers report the size they needed")
+	{
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024) { writeMeasuringExample(expected); }
+		const size_t needed = expected.size();
+
+		for (size_t size = 1; size <= needed + 2; ++size)
+		{
+			std::vector<char> buffer(size + 1, '#');
+			mmk::json::writer w(&buffer[0], size);
+			MMK_JSON_WRITER_ARRAY_OBJECT(w) { writeMeasuringExample(w); }
+
+			ASSERT_CMP_FMT(!!w, ==, size > needed, "A %u-byte buffer should fit %u bytes and a '\\0' or fail", (unsigned)size, (unsigned)needed);
+			ASSERT_CMP_FMT(w.required(), ==, needed, "A %u-byte buffer should still report the %u bytes needed", (unsigned)size, (unsigned)needed);
+			ASSERT_CMP_FMT(buffer[size], ==, '#', "A %u-byte buffer shouldn't be written past", (unsigned)size);
+			if (!w) { ASSERT_MSG(!w.c_str(), "Overflows should still result in null-string results"); ASSERT_CMP(w.size(), ==, 0u); }
+		}
+	}
+
+	MMK_UNIT_TEST("Other failures don't report a size")
+	{
+		MMK_JSON_WRITER_ROOT_ARRAY(a, 16) { a(1); }
+		ASSERT_CMP_MSG(a.required(), ==, 3u, "[1] is 3 bytes");
+
+		MMK_JSON_WRITER_STREAM_ARRAY(w, 16, mmk::json::sink(failingSink, 0)) { for (int i = 0; i < 100; ++i) w(i); }
+		ASSERT_MSG(!w, "Failing sinks should still fail the writer");
+		ASSERT_CMP_MSG(w.required(), ==, 0u, "Sinks that fail can't say how much was needed");
+	}
+}
+
+namespace
+{
+	// Just enough of a JSON parser to say whether text is one complete, well formed value.
+	struct jsonValidator
+	{
+		const char* p;
+
+		bool literal(const char* word) { const size_t n = strlen(word); if (strncmp(p, word, n)) return false; p += n; return true; }
+		bool digits() { if (*p < '0' || *p > '9') return false; while (*p >= '0' && *p <= '9') ++p; return true; }
+
+		bool number()
+		{
+			if (*p == '-') ++p;
+			if (*p == '0') ++p; else if (!digits()) return false;
+			if (*p == '.') { ++p; if (!digits()) return false; }
+			if (*p == 'e' || *p == 'E') { ++p; if (*p == '+' || *p == '-') ++p; if (!digits()) return false; }
+			return true;
+		}
+
+		bool string()
+		{
+			if (*p++ != '\"') return false;
+			for (;;)
+			{
+				const unsigned char ch = (unsigned char)*p++;
+				if (ch == '\"') return true;
+				if (ch < 0x20) return false;
+				if (ch != '\\') continue;
+				if (*p == 'u') { ++p; for (int i = 0; i < 4; ++i, ++p) if (!isxdigit((unsigned char)*p)) return false; }
+				else if (!*p || !strchr("\"\\/bfnrt", *p++)) return false;
+			}
+		}
+
+		bool value()
+		{
+			switch (*p)
+			{
+			case '{':
+				if (*++p == '}') { ++p; return true; }
+				for (;;) { if (!string() || *p++ != ':' || !value()) return false; if (*p == '}') { ++p; return true; } if (*p++ != ',') return false; }
+			case '[':
+				if (*++p == ']') { ++p; return true; }
+				for (;;) { if (!value()) return false; if (*p == ']') { ++p; return true; } if (*p++ != ',') return false; }
+			case '\"': return string();
+			case 't':  return literal("true");
+			case 'f':  return literal("false");
+			case 'n':  return literal("null");
+			default:   return number();
+			}
+		}
+	};
+
+	bool isValidJson(const char* text)
+	{
+		jsonValidator v = { text };
+		return text && v.value() && !*v.p;
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Truncating")
+{
+	MMK_UNIT_TEST("Every buffer size gives valid JSON")
+	{
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024) { writeMeasuringExample(expected); }
+		ASSERT_MSG(isValidJson(expected.c_str()), "Reference example should be valid JSON");
+		const std::string full = expected.c_str();
+
+		for (size_t size = 3; size <= full.size() + 2; ++size)
+		{
+			std::vector<char> buffer(size + 1, '#');
+			mmk::json::writer w(&buffer[0], size, mmk::json::truncateTag());
+			MMK_JSON_WRITER_ARRAY_OBJECT(w) { writeMeasuringExample(w); }
+
+			ASSERT_CMP_FMT(!!w, ==, true, "Truncating a %u-byte buffer shouldn't fail", (unsigned)size);
+			ASSERT_CMP_FMT(w.truncated(), ==, size <= full.size(), "A %u-byte buffer should only be truncated if %u bytes and a '\\0' don't fit", (unsigned)size, (unsigned)full.size());
+			ASSERT_CMP_FMT(buffer[size], ==, '#', "A %u-byte buffer shouldn't be written past", (unsigned)size);
+			ASSERT_CMP_FMT(w.size(), <, size, "A %u-byte buffer needs room for the '\\0'", (unsigned)size);
+			ASSERT_CMP_FMT(isValidJson(w.c_str()), ==, true, "Truncating to %u bytes should give valid JSON, not %s", (unsigned)size, w.c_str());
+
+			// Whole elements of the original, then closing brackets
+			const std::string out = w.c_str();
+			size_t common = 0;
+			while (common < out.size() && out[common] == full[common]) ++common;
+			ASSERT_CMP_FMT(out.find_first_not_of("]}", common) == std::string::npos, ==, true, "Truncating to %u bytes should only drop whole elements, not give %s", (unsigned)size, out.c_str());
+		}
+	}
+
+	MMK_UNIT_TEST("Nesting, and brackets inside strings")
+	{
+		struct local
+		{
+			static void write(mmk::json::objectWriter& o)
+			{
+				o("tricky", "]}\",{[\\\\\"");
+				MMK_JSON_WRITER_OBJECT_ARRAY(o, "a") { o(1); MMK_JSON_WRITER_ARRAY_OBJECT(o) { o("k]", "v}"); } o("\\"); }
+				MMK_JSON_WRITER_OBJECT_OBJECT(o, "deep") MMK_JSON_WRITER_OBJECT_ARRAY(o, "x") MMK_JSON_WRITER_ARRAY_ARRAY(o) MMK_JSON_WRITER_ARRAY_OBJECT(o)
+				{
+					o("s", "{[,:\"]}");
+					o(MMK_JSON_KEY("n"), 12345);
+				}
+				o("last", false);
+			}
+		};
+
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024) { local::write(expected); }
+		ASSERT_MSG(isValidJson(expected.c_str()), "Reference example should be valid JSON");
+		const std::string full = expected.c_str();
+
+		for (size_t size = 3; size <= full.size() + 1; ++size)
+		{
+			std::vector<char> buffer(size);
+			mmk::json::writer w(&buffer[0], size, mmk::json::truncateTag());
+			MMK_JSON_WRITER_ARRAY_OBJECT(w) { local::write(w); }
+
+			const std::string out = w.c_str() ? w.c_str() : "(null)";
+			ASSERT_CMP_FMT(isValidJson(w.c_str()), ==, true, "Truncating to %u bytes should give valid JSON, not %s", (unsigned)size, out.c_str());
+			size_t common = 0;
+			while (common < out.size() && out[common] == full[common]) ++common;
+			ASSERT_CMP_FMT(out.find_first_not_of("]}", common) == std::string::npos, ==, true, "Truncating to %u bytes should only drop whole elements, not give %s", (unsigned)size, out.c_str());
+		}
+	}
+
+	MMK_UNIT_TEST("Elements that don't fit are rolled back")
+	{
+		MMK_JSON_WRITER_TRUNCATE_OBJECT(o, 32)
+		{
+			o("id", 42);
+			MMK_JSON_WRITER_OBJECT_ARRAY(o, "tags") { o("a"); o("b"); o("a much longer tag than fits"); o("c"); }
+			o("after", true);
+		}
+		ASSERT_MSG(o.truncated(), "Truncation should be reported");
+		ASSERT_CMP(std::string(o.c_str()), ==, "{\"id\":42,\"tags\":[\"a\",\"b\"]}");
+
+		const int values[] = { 1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000 };
+		MMK_JSON_WRITER_TRUNCATE_ARRAY(a, 24) { a(1); a.array(values); a(2); }
+		ASSERT_CMP_MSG(std::string(a.c_str()), ==, "[1,[1000,2000,3000]]", "Bulk arrays should keep every number that fits");
+	}
+
+	MMK_UNIT_TEST("No room for the root scope still fails")
+	{
+		MMK_JSON_WRITER_TRUNCATE_ARRAY(a, 1) { a(1); }
+		ASSERT_MSG(!a, "A 1-byte buffer can't hold [] and a '\\0'");
+
+		MMK_JSON_WRITER_TRUNCATE_OBJECT(o, 2) { o("a", 1); }
+		ASSERT_MSG(!o, "A 2-byte buffer can't hold {} and a '\\0'");
+		ASSERT_MSG(!o.c_str(), "Failed writers should still have null results");
+
+		MMK_JSON_WRITER_TRUNCATE_OBJECT(e, 3) { e("a", 1); }
+		ASSERT_CMP(std::string(e.c_str()), ==, "{}");
+		ASSERT_MSG(e.truncated(), "Truncation should be reported");
+	}
+}
+
+namespace
+{
+	std::string concatenate(const mmk::json::gather& g)
+	{
+		std::string result;
+		for (size_t i = 0; i < g.count; ++i) result.append(g.segments[i].data, g.segments[i].size);
+		return result;
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Gathering")
+{
+	MMK_UNIT_TEST("Large raw values are referenced, not copied")
+	{
+		const std::string blob = "\"" + std::string(5000, 'x') + "\"";
+		mmk::json::segment segments[8];
+		mmk::json::gather g(segments);
+		MMK_JSON_WRITER_GATHER_OBJECT(o, 64, g)
+		{
+			o("small", mmk::json::raw("[1,2,3]"));
+			o("tail", mmk::json::raw(blob));
+			o("n", 1);
+		}
+		ASSERT_MSG(!!o, "Gathering writer shouldn't fail");
+		ASSERT_CMP(g.count, ==, 3u);
+		ASSERT_CMP_MSG((const void*)segments[1].data, ==, (const void*)blob.data(), "Blob should be referenced in place");
+		ASSERT_CMP(concatenate(g), ==, "{\"small\":[1,2,3],\"tail\":" + blob + ",\"n\":1}");
+		ASSERT_CMP(g.size(), ==, concatenate(g).size());
+		ASSERT_CMP_MSG(o.size(), <, 64u, "Buffer should only hold the small tokens");
+	}
+
+	MMK_UNIT_TEST("Gathered output matches copied output")
+	{
+		const std::string a(100, 'a'), b(100, 'b');
+		const mmk::json::raw values[] = { mmk::json::raw(a), mmk::json::raw(b), mmk::json::raw(a) };
+
+		MMK_JSON_WRITER_ROOT_ARRAY(expected, 1024) { for (int i = 0; i < 3; ++i) expected(values[i]); }
+
+		mmk::json::segment segments[16];
+		mmk::json::gather g(segments, 16, 100);
+		MMK_JSON_WRITER_GATHER_ARRAY(w, 64, g) { for (int i = 0; i < 3; ++i) w(values[i]); }
+		ASSERT_MSG(!!w, "Gathering writer shouldn't fail");
+		ASSERT_CMP_MSG(g.count, ==, 7u, "Back to back references should still get separating commas");
+		ASSERT_CMP(concatenate(g), ==, expected.c_str());
+	}
+
+	MMK_UNIT_TEST("Running out of segments fails the writer")
+	{
+		const std::string blob(64, '1');
+		mmk::json::segment segments[4];
+		mmk::json::gather g(segments, 64);
+		MMK_JSON_WRITER_GATHER_ARRAY(w, 64, g) { for (int i = 0; i < 4; ++i) w(mmk::json::raw(blob)); }
+		ASSERT_MSG(!w, "Writer should fail once segments run out");
+	}
+
+	MMK_UNIT_TEST("writeSegments")
+	{
+		const std::string blob(5000, '7');
+		mmk::json::segment segments[8];
+		mmk::json::gather g(segments);
+		MMK_JSON_WRITER_GATHER_ARRAY(w, 64, g) { w(mmk::json::raw(blob)); w(true); w(mmk::json::raw(blob)); }
+		ASSERT_MSG(!!w, "Gathering writer shouldn't fail");
+
+		std::string contents;
+		if (FILE* file = tmpfile())
+		{
+#ifdef _WIN32
+			ASSERT_MSG(mmk::json::writeSegments(_fileno(file), g), "writeSegments shouldn't fail");
+#else
+			ASSERT_MSG(mmk::json::writeSegments(fileno(file), g), "writeSegments shouldn't fail");
+#endif
+			rewind(file);
+			char chunk[1024];
+			for (size_t read; (read = fread(chunk, 1, sizeof(chunk), file)) != 0; ) contents.append(chunk, read);
+			fclose(file);
+		}
+		ASSERT_CMP(contents, ==, "[" + blob + ",true," + blob + "]");
+	}
+}
+
+namespace parallelTest
+{
+	struct unallocatable { operator std::string() const { throw std::bad_alloc(); } };
+}
+
+MMK_UNIT_TEST_CATEGORY("Parallel arrays")
+{
+	MMK_UNIT_TEST("Output matches array(...) for any thread count")
+	{
+		std::vector<double> values;
+		for (int i = 0; i < 1000; ++i) values.push_back(i * 0.37 - 100);
+
+		for (size_t size = 0; size <= values.size(); size = size * 3 + 1)
+		{
+			const std::vector<double> sample(values.begin(), values.begin() + size);
+			std::vector<char> expectedBuffer(64 * 1024), buffer(64 * 1024);
+
+			mmk::json::writer expected(expectedBuffer);
+			MMK_JSON_WRITER_ARRAY_OBJECT(expected) { expected("n", 1); expected.array("values", sample); expected("m", 2); }
+			ASSERT_MSG(!!expected, "Serial reference shouldn't overflow");
+
+			for (unsigned threads = 1; threads <= 8; ++threads)
+			{
+				mmk::json::parallel p(threads, 7);
+				mmk::json::writer w(buffer);
+				MMK_JSON_WRITER_ARRAY_OBJECT(w) { w("n", 1); p.array(w, "values", sample); w("m", 2); }
+				ASSERT_CMP_FMT(!!w, ==, true, "%u elements on %u threads shouldn't fail", (unsigned)size, threads);
+				ASSERT_CMP_FMT(strcmp(w.c_str(), expected.c_str()), ==, 0, "%u elements on %u threads: %s should match %s", (unsigned)size, threads, w.c_str(), expected.c_str());
+			}
+		}
+	}
+
+	MMK_UNIT_TEST("Nested in arrays")
+	{
+		const std::vector<int> values(100, 7);
+		mmk::json::parallel p(4, 10);
+		MMK_JSON_WRITER_ROOT_ARRAY(a, 1024) { a(1); p.array(a, values); p.array(a, std::vector<int>()); }
+		std::string expected = "[1,[7";
+		for (int i = 1; i < 100; ++i) expected += ",7";
+		expected += "],[]]";
+		ASSERT_CMP(std::string(a.c_str()), ==, expected);
+	}
+
+	MMK_UNIT_TEST("Overflow is still reported")
+	{
+		const std::vector<int> values(1000, 12345);
+		mmk::json::parallel p(4, 10);
+		MMK_JSON_WRITER_ROOT_ARRAY(a, 256) { p.array(a, values); }
+		ASSERT_MSG(!a, "Joining chunks into a too small buffer should fail the writer");
+	}
+
+	MMK_UNIT_TEST("Allocation failures are reported")
+	{
+		const std::vector<parallelTest::unallocatable> values(100);
+		mmk::json::parallel p(4, 10);
+		MMK_JSON_WRITER_ROOT_ARRAY(a, 1024) { p.array(a, values); }
+		ASSERT_MSG(!a, "bad_alloc on worker threads should fail the writer, not terminate");
+	}
+
+	MMK_UNIT_TEST("Gathering writers reference chunks")
+	{
+		std::vector<int> values;
+		for (int i = 0; i < 10000; ++i) values.push_back(i);
+		MMK_JSON_WRITER_ROOT_ARRAY(expected, 64 * 1024) { expected.array(values); }
+
+		mmk::json::parallel p(4);
+		mmk::json::segment segments[16];
+		mmk::json::gather g(segments, 16, 1024);
+		MMK_JSON_WRITER_GATHER_ARRAY(a, 64, g) { p.array(a, values); }
+		ASSERT_MSG(!!a, "Gathering parallel output shouldn't fail");
+		ASSERT_CMP(concatenate(g), ==, expected.c_str());
+	}
+}
+
+namespace
+{
+	int fileDescriptor(FILE* file)
+	{
+#ifdef _WIN32
+		return _fileno(file);
+#else
+		return fileno(file);
+#endif
+	}
+
+	std::string readAll(FILE* file)
+	{
+		std::string contents;
+		rewind(file);
+		char chunk[1024];
+		for (size_t read; (read = fread(chunk, 1, sizeof(chunk), file)) != 0; ) contents.append(chunk, read);
+		return contents;
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Logging ring")
+{
+	MMK_UNIT_TEST("Records from many threads arrive whole")
+	{
+		const int threads = 4, records = 500;
+		FILE* file = tmpfile();
+		ASSERT_MSG(file, "tmpfile() failed");
+		if (!file) return;
+
+		mmk::json::logRing::statistics stats;
+		{
+			mmk::json::logRing ring(fileDescriptor(file), 4 * threads * records);
+			std::vector<std::thread> producers;
+			for (int t = 0; t < threads; ++t) producers.push_back(std::thread([&ring, t]
+			{
+				for (int i = 0; i < records; ++i) MMK_JSON_LOG_OBJECT(log, ring) { log("thread", t); log("i", i); log("msg", "hello"); }
+			}));
+			for (size_t t = 0; t < producers.size(); ++t) producers[t].join();
+			stats = ring.stats();
+		}
+		ASSERT_CMP(stats.committed, ==, (unsigned long long)(threads * records));
+		ASSERT_CMP(stats.dropped + stats.oversized + stats.failed, ==, 0ull);
+
+		const std::string contents = readAll(file);
+		fclose(file);
+
+		std::vector<int> next(threads, 0);
+		size_t lines = 0;
+		for (size_t start = 0, end; (end = contents.find('\n', start)) != std::string::npos; start = end + 1, ++lines)
+		{
+			int t = -1, i = -1;
+			const std::string line = contents.substr(start, end - start);
+			ASSERT_CMP_FMT(sscanf(line.c_str(), "{\"thread\":%d,\"i\":%d,\"msg\":\"hello\"}", &t, &i), ==, 2, "Malformed record %s", line.c_str());
+			if (t < 0 || t >= threads) continue;
+			ASSERT_CMP_MSG(i, ==, next[t], "Each thread's records should arrive in order");
+			next[t] = i + 1;
+		}
+		ASSERT_CMP(lines, ==, (size_t)(threads * records));
+	}
+
+	MMK_UNIT_TEST("Full rings and oversized records don't block")
+	{
+		FILE* file = tmpfile();
+		ASSERT_MSG(file, "tmpfile() failed");
+		if (!file) return;
+		{
+			mmk::json::logRing ring(fileDescriptor(file), 2, 32);
+			{
+				mmk::json::logRecord a(ring), b(ring), c(ring);
+				ASSERT_MSG( a && b, "Free slots should be claimed");
+				ASSERT_MSG(!c,      "Third record shouldn't fit in a two slot ring");
+				ASSERT_MSG(!c.w,    "Dropped records get failed writers");
+				mmk::json::writer& aw = a.w;
+				mmk::json::writer& bw = b.w;
+				MMK_JSON_WRITER_ARRAY_OBJECT(aw) { aw("n", 1); }
+				MMK_JSON_WRITER_ARRAY_OBJECT(bw) { bw("s", "a string that won't fit in thirty-two bytes"); }
+			}
+			while (ring.stats().written < 1) std::this_thread::yield(); // Until the background thread frees up the ring
+			MMK_JSON_LOG_ARRAY(log, ring) { log(2); }
+
+			const mmk::json::logRing::statistics stats = ring.stats();
+			ASSERT_CMP(stats.committed, ==, 2ull);
+			ASSERT_CMP(stats.dropped,   ==, 1ull);
+			ASSERT_CMP(stats.oversized, ==, 1ull);
+		}
+		ASSERT_CMP(readAll(file), ==, "{\"n\":1}\n[2]\n");
+		fclose(file);
+	}
+}
+
+namespace
+{
+	std::string bytes(const unsigned char* data, size_t size) { return std::string((const char*)data, size); }
+
+	std::string hex(const std::string& data)
+	{
+		std::string out;
+		char digits[4];
+		for (size_t i = 0; i < data.size(); ++i) { snprintf(digits, sizeof(digits), "%02x ", (unsigned char)data[i]); out += digits; }
+		return out;
+	}
+
+	template < typename ObjectWriter, typename ArrayWriter > void writeBinaryExample(ObjectWriter& o)
+	{
+		o("a", 1);
+		o(MMK_JSON_KEY("neg"), -100);
+		o("s", std::string("hi"));
+		{
+			ArrayWriter a(o, "list");
+			a(true);
+			a(false);
+			a(1.5);
+		}
+	}
+
+	template < typename Writer, typename ObjectWriter, typename ArrayWriter > std::string writeBinaryRecords(Writer& w, int records)
+	{
+		{
+			ArrayWriter a(w, mmk::json::noKeyTag());
+			for (int i = 0; i < records; ++i)
+			{
+				ObjectWriter o(a, mmk::json::noKeyTag());
+				o("id", i * 1000);
+				o("name", "sensor");
+				o("value", i * 0.1);
+				const int history[] = { i, -i, i * 70000 };
+				o.array("history", history);
+			}
+		}
+		return w.data() ? std::string(w.data(), w.size()) : std::string();
+	}
+
+	template < typename Writer, typename ObjectWriter, typename ArrayWriter > void checkBinaryOverflow(const char* format)
+	{
+		std::vector<char> grown;
+		Writer g(grown, mmk::json::growTag());
+		const std::string expected = writeBinaryRecords<Writer, ObjectWriter, ArrayWriter>(g, 20);
+		ASSERT_CMP_FMT(expected.size(), >, 20u * 20u, "%s records should've been written", format);
+
+		Writer m((mmk::json::measureTag()));
+		writeBinaryRecords<Writer, ObjectWriter, ArrayWriter>(m, 20);
+		const size_t required = m.required();
+		ASSERT_MSG(!!m, "Dry runs don't fail");
+		ASSERT_CMP_FMT(required, >=, expected.size(), "%s dry runs should count at least the whole document", format);
+		ASSERT_CMP_FMT(required, <=, expected.size() + 4 * 3, "%s dry runs should only add headroom for open containers", format);
+
+		for (size_t size = 1; size <= required + 1; ++size)
+		{
+			std::vector<char> buffer(size);
+			Writer w(buffer);
+			const std::string written = writeBinaryRecords<Writer, ObjectWriter, ArrayWriter>(w, 20);
+			ASSERT_CMP_FMT(!!w, ==, size > required, "%s in %u bytes should succeed once there's required()+1", format, (unsigned)size);
+			if (w) ASSERT_CMP_FMT(written, ==, expected, "%s in %u bytes should match", format, (unsigned)size);
+			else   ASSERT_CMP_FMT(w.required(), ==, required, "%s in %u bytes should still count what it needed", format, (unsigned)size);
+		}
+	}
+}
+
+namespace
+{
+	// Byte at a time references for the SIMD encoders.
+	std::string referenceBase64(const unsigned char* data, size_t size, bool urlSafe)
+	{
+		const char* chars = urlSafe ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_" : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		std::string out;
+		unsigned bits = 0, count = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			bits = (bits << 8) | data[i];
+			count += 8;
+			while (count >= 6) { count -= 6; out += chars[(bits >> count) & 63]; }
+		}
+		if (count) out += chars[(bits << (6 - count)) & 63];
+		if (!urlSafe) while (out.size() % 4) out += '=';
+		return out;
+	}
+
+	std::string referenceHex(const unsigned char* data, size_t size)
+	{
+		std::string out;
+		for (size_t i = 0; i < size; ++i) { char digits[3]; snprintf(digits, sizeof(digits), "%02x", data[i]); out += digits; }
+		return out;
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Binary values")
+{
+	MMK_UNIT_TEST("RFC 4648 test vectors")
+	{
+		MMK_JSON_WRITER_ROOT_ARRAY(a, 256)
+		{
+			const char* const vectors[] = { "", "f", "fo", "foo", "foob", "fooba", "foobar" };
+			for (size_t i = 0; i < 7; ++i) a(mmk::json::base64(vectors[i], strlen(vectors[i])));
+			a(mmk::json::base64("foob", 4, mmk::json::base64::urlSafe));
+			const unsigned char high[] = { 0xfb, 0xff, 0xbf };
+			a(mmk::json::base64(high, 2));
+			a(mmk::json::base64(high, 3, mmk::json::base64::urlSafe));
+			a(mmk::json::hex(high, 3));
+			a(mmk::json::hex((const void*)0, 0));
+		}
+		ASSERT_CMP(std::string(a.c_str()), ==, "[\"\",\"Zg==\",\"Zm8=\",\"Zm9v\",\"Zm9vYg==\",\"Zm9vYmE=\",\"Zm9vYmFy\",\"Zm9vYg\",\"+/8=\",\"-_-_\",\"fbffbf\",null]");
+	}
+
+	MMK_UNIT_TEST("Matches byte at a time encoding at every length")
+	{
+		std::vector<unsigned char> data(300);
+		unsigned seed = 12345;
+		for (size_t i = 0; i < data.size(); ++i) { seed = seed * 1103515245u + 12345u; data[i] = (unsigned char)(seed >> 16); }
+
+		for (size_t size = 0; size <= data.size(); ++size)
+		{
+			MMK_JSON_WRITER_ROOT_OBJECT(o, 2048)
+			{
+				o("standard", mmk::json::base64(&data[0], size));
+				o(MMK_JSON_KEY("urlSafe"), mmk::json::base64(&data[0], size, mmk::json::base64::urlSafe));
+				o("hex", mmk::json::hex(&data[0], size));
+			}
+			const std::string expected = "{\"standard\":\"" + referenceBase64(&data[0], size, false) + "\",\"urlSafe\":\"" + referenceBase64(&data[0], size, true) + "\",\"hex\":\"" + referenceHex(&data[0], size) + "\"}";
+			ASSERT_CMP_FMT(std::string(o.c_str()), ==, expected, "Encoding %u bytes gave %s", (unsigned)size, o.c_str());
+		}
+	}
+
+	MMK_UNIT_TEST("Fixed, streaming and truncating buffers")
+	{
+		unsigned char data[200];
+		for (size_t i = 0; i < sizeof(data); ++i) data[i] = (unsigned char)(i * 7);
+
+		std::string expected;
+		{
+			MMK_JSON_WRITER_MEASURE_ARRAY(m) { m(mmk::json::base64(data, sizeof(data))); m(mmk::json::hex(data, sizeof(data))); }
+			ASSERT_CMP(m.required(), ==, 2 + 1+268+1 + 1 + 1+400+1);
+
+			std::vector<char> buffer;
+			MMK_JSON_WRITER_GROW_ARRAY(g, buffer, 0) { g(mmk::json::base64(data, sizeof(data))); g(mmk::json::hex(data, sizeof(data))); }
+			expected.assign(g.c_str(), g.size());
+			ASSERT_CMP(expected.size(), ==, m.required());
+		}
+
+		for (size_t size = 1; size <= expected.size() + 1; size += 7)
+		{
+			std::vector<char> buffer(size);
+			mmk::json::writer w(&buffer[0], size);
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) { w(mmk::json::base64(data, sizeof(data))); w(mmk::json::hex(data, sizeof(data))); }
+			ASSERT_CMP_FMT(w.required(), ==, expected.size(), "%u byte buffers should still count what they needed", (unsigned)size);
+
+			std::vector<char> truncating(size + 8);
+			mmk::json::writer t(&truncating[0], truncating.size(), mmk::json::truncateTag());
+			MMK_JSON_WRITER_ARRAY_ARRAY(t) { t(mmk::json::base64(data, sizeof(data))); t(mmk::json::hex(data, sizeof(data))); }
+			ASSERT_CMP_FMT(isValidJson(t.c_str()), ==, true, "Truncating to %u bytes should give valid JSON, not %s", (unsigned)truncating.size(), t.c_str());
+		}
+
+		const size_t streamSizes[] = { 8, 16, 33, 64, 1000 };
+		for (size_t i = 0; i < sizeof(streamSizes)/sizeof(streamSizes[0]); ++i)
+		{
+			std::string streamed;
+			std::vector<char> buffer(streamSizes[i]);
+			mmk::json::writer w(&buffer[0], buffer.size(), mmk::json::sink(appendToString, &streamed));
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) { w(mmk::json::base64(data, sizeof(data))); w(mmk::json::hex(data, sizeof(data))); }
+			ASSERT_CMP_FMT(streamed, ==, expected, "Streaming through %u bytes gave %s", (unsigned)buffer.size(), streamed.c_str());
+		}
+	}
+
+	MMK_UNIT_TEST("Byte strings in CBOR and MessagePack")
+	{
+		const unsigned char data[] = { 0xde, 0xad };
+		char buffer[64];
+		{
+			mmk::json::cborWriter w(buffer);
+			{ mmk::json::cborArrayWriter a(w, mmk::json::noKeyTag()); a(mmk::json::base64(data, 2)); a(mmk::json::hex(data, 1)); }
+			const unsigned char expected[] = { 0x9f, 0x42, 0xde, 0xad, 0x41, 0xde, 0xff };
+			ASSERT_CMP(std::string(w.data(), w.size()), ==, bytes(expected, sizeof(expected)));
+		}
+		{
+			mmk::json::msgpackWriter w(buffer);
+			{ mmk::json::msgpackArrayWriter a(w, mmk::json::noKeyTag()); a(mmk::json::base64(data, 2)); }
+			const unsigned char expected[] = { 0x91, 0xc4, 0x02, 0xde, 0xad };
+			ASSERT_CMP(std::string(w.data(), w.size()), ==, bytes(expected, sizeof(expected)));
+		}
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Binary formats")
+{
+	MMK_UNIT_TEST("CBOR and MessagePack encodings")
+	{
+		char buffer[256];
+		{
+			mmk::json::cborWriter w(buffer);
+			{ mmk::json::cborObjectWriter o(w, mmk::json::noKeyTag()); writeBinaryExample<mmk::json::cborObjectWriter, mmk::json::cborArrayWriter>(o); }
+			const unsigned char expected[] =
+			{
+				0xbf, 0x61,'a', 0x01, 0x63,'n','e','g', 0x38,0x63, 0x61,'s', 0x62,'h','i',
+				0x64,'l','i','s','t', 0x9f, 0xf5, 0xf4, 0xfa,0x3f,0xc0,0x00,0x00, 0xff, 0xff,
+			};
+			ASSERT_CMP_FMT(std::string(w.data(), w.size()), ==, bytes(expected, sizeof(expected)), "CBOR should be %s, not %s", hex(bytes(expected, sizeof(expected))).c_str(), hex(std::string(w.data(), w.size())).c_str());
+		}
+		{
+			mmk::json::msgpackWriter w(buffer);
+			{ mmk::json::msgpackObjectWriter o(w, mmk::json::noKeyTag()); writeBinaryExample<mmk::json::msgpackObjectWriter, mmk::json::msgpackArrayWriter>(o); }
+			const unsigned char expected[] =
+			{
+				0x84, 0xa1,'a', 0x01, 0xa3,'n','e','g', 0xd0,0x9c, 0xa1,'s', 0xa2,'h','i',
+				0xa4,'l','i','s','t', 0x93, 0xc3, 0xc2, 0xca,0x3f,0xc0,0x00,0x00,
+			};
+			ASSERT_CMP_FMT(std::string(w.data(), w.size()), ==, bytes(expected, sizeof(expected)), "MessagePack should be %s, not %s", hex(bytes(expected, sizeof(expected))).c_str(), hex(std::string(w.data(), w.size())).c_str());
+		}
+	}
+
+	MMK_UNIT_TEST("Integer, string and container size boundaries")
+	{
+		char buffer[1024];
+		{
+			mmk::json::cborWriter w(buffer);
+			{
+				mmk::json::cborArrayWriter a(w, mmk::json::noKeyTag());
+				a(23); a(24); a(256); a(-24); a(-25); a(4294967296ull); a(-9223372036854775807ll - 1); a(0.1); a((const char*)0);
+			}
+			const unsigned char expected[] =
+			{
+				0x9f, 0x17, 0x18,0x18, 0x19,0x01,0x00, 0x37, 0x38,0x18, 0x1b,0,0,0,1,0,0,0,0, 0x3b,0x7f,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+				0xfb,0x3f,0xb9,0x99,0x99,0x99,0x99,0x99,0x9a, 0xf6, 0xff,
+			};
+			ASSERT_CMP_FMT(std::string(w.data(), w.size()), ==, bytes(expected, sizeof(expected)), "CBOR should be %s, not %s", hex(bytes(expected, sizeof(expected))).c_str(), hex(std::string(w.data(), w.size())).c_str());
+		}
+		{
+			mmk::json::msgpackWriter w(buffer);
+			{
+				mmk::json::msgpackArrayWriter a(w, mmk::json::noKeyTag());
+				a(127); a(128); a(-32); a(-33); a(-32769); a(65536u); a(std::string(32, 'x'));
+				{ mmk::json::msgpackArrayWriter sixteen(a, mmk::json::noKeyTag()); for (int i = 0; i < 16; ++i) sixteen(i); }
+				{ mmk::json::msgpackObjectWriter empty(a, mmk::json::noKeyTag()); }
+			}
+			std::string expected = bytes((const unsigned char*)"\x99\x7f\xcc\x80\xe0\xd0\xdf\xd2\xff\xff\x7f\xff\xce\x00\x01\x00\x00\xd9\x20", 19) + std::string(32, 'x') + "\xdc";
+			expected += std::string(1, '\0') + "\x10";
+			for (int i = 0; i < 16; ++i) expected += (char)i;
+			expected += "\x80";
+			ASSERT_CMP_FMT(std::string(w.data(), w.size()), ==, expected, "MessagePack should be %s, not %s", hex(expected).c_str(), hex(std::string(w.data(), w.size())).c_str());
+		}
+	}
+
+	MMK_UNIT_TEST("Wide strings are transcoded to UTF-8")
+	{
+		const unsigned short utf16[] = { 'h', 0xe9, 0xd83d, 0xde00, 0xd800, 0 };
+		char buffer[64];
+		mmk::json::msgpackWriter w(buffer);
+		{ mmk::json::msgpackArrayWriter a(w, mmk::json::noKeyTag()); a(mmk::json::wide(utf16)); }
+		const unsigned char expected[] = { 0x91, 0xaa, 'h', 0xc3,0xa9, 0xf0,0x9f,0x98,0x80, 0xef,0xbf,0xbd };
+		ASSERT_CMP_FMT(std::string(w.data(), w.size()), ==, bytes(expected, sizeof(expected)), "Should be %s, not %s", hex(bytes(expected, sizeof(expected))).c_str(), hex(std::string(w.data(), w.size())).c_str());
+	}
+
+	MMK_UNIT_TEST("Escaped MMK_JSON_KEYs are decoded")
+	{
+		char buffer[64];
+		mmk::json::msgpackWriter w(buffer);
+		{ mmk::json::msgpackObjectWriter o(w, mmk::json::noKeyTag()); o(MMK_JSON_KEY("a\\\"b\\u00e9\\ud83d\\ude00"), 1); }
+		const unsigned char expected[] = { 0x81, 0xa9, 'a', '\"', 'b', 0xc3,0xa9, 0xf0,0x9f,0x98,0x80, 0x01 };
+		ASSERT_CMP_FMT(std::string(w.data(), w.size()), ==, bytes(expected, sizeof(expected)), "Should be %s, not %s", hex(bytes(expected, sizeof(expected))).c_str(), hex(std::string(w.data(), w.size())).c_str());
+	}
+
+	MMK_UNIT_TEST("MessagePack lengths past 32 bits fail the writer")
+	{
+		if (sizeof(size_t) <= 4) return;
+		const size_t huge = (size_t)0xffffffffu + 1;
+		mmk::json::msgpackWriter w((mmk::json::measureTag())); // Dry run - nothing is read
+		{ mmk::json::msgpackArrayWriter a(w, mmk::json::noKeyTag()); a("", huge); }
+		ASSERT_MSG(!w, "A 4 GiB string can't be written as MessagePack");
+	}
+
+	MMK_UNIT_TEST("Fixed buffers, growth and dry runs agree")
+	{
+		checkBinaryOverflow<mmk::json::cborWriter,    mmk::json::cborObjectWriter,    mmk::json::cborArrayWriter   >("CBOR");
+		checkBinaryOverflow<mmk::json::msgpackWriter, mmk::json::msgpackObjectWriter, mmk::json::msgpackArrayWriter>("MessagePack");
+	}
+
+	MMK_UNIT_TEST("Streaming")
+	{
+		std::vector<char> grown;
+		mmk::json::cborWriter g(grown, mmk::json::growTag());
+		const std::string cbor = writeBinaryRecords<mmk::json::cborWriter, mmk::json::cborObjectWriter, mmk::json::cborArrayWriter>(g, 20);
+		for (size_t size = 2; size <= 64; ++size)
+		{
+			std::string streamed;
+			char buffer[64];
+			mmk::json::cborWriter w(buffer, size, mmk::json::sink(appendToString, &streamed));
+			writeBinaryRecords<mmk::json::cborWriter, mmk::json::cborObjectWriter, mmk::json::cborArrayWriter>(w, 20);
+			ASSERT_CMP_FMT(!!w, ==, true, "Streaming CBOR through a %u-byte buffer shouldn't fail", (unsigned)size);
+			ASSERT_CMP_FMT(streamed == cbor, ==, true, "Streaming CBOR through a %u-byte buffer should give the same bytes", (unsigned)size);
+		}
+
+		std::vector<char> msgpackGrown;
+		mmk::json::msgpackWriter mg(msgpackGrown, mmk::json::growTag());
+		const std::string msgpack = writeBinaryRecords<mmk::json::msgpackWriter, mmk::json::msgpackObjectWriter, mmk::json::msgpackArrayWriter>(mg, 20);
+		{
+			std::string streamed;
+			mmk::json::msgpackWriter m((mmk::json::measureTag()));
+			writeBinaryRecords<mmk::json::msgpackWriter, mmk::json::msgpackObjectWriter, mmk::json::msgpackArrayWriter>(m, 20);
+			std::vector<char> buffer(m.required() + 1);
+			mmk::json::msgpackWriter w(buffer.data(), buffer.size(), mmk::json::sink(appendToString, &streamed));
+			writeBinaryRecords<mmk::json::msgpackWriter, mmk::json::msgpackObjectWriter, mmk::json::msgpackArrayWriter>(w, 20);
+			ASSERT_MSG(!!w, "MessagePack documents that fit should stream");
+			ASSERT_MSG(streamed == msgpack, "Streamed MessagePack should be the same bytes");
+		}
+		{
+			std::string streamed;
+			char buffer[64];
+			mmk::json::msgpackWriter w(buffer, mmk::json::sink(appendToString, &streamed));
+			writeBinaryRecords<mmk::json::msgpackWriter, mmk::json::msgpackObjectWriter, mmk::json::msgpackArrayWriter>(w, 20);
+			ASSERT_MSG(!w, "MessagePack can't flush open containers");
+			ASSERT_CMP(streamed.size(), ==, 0u);
+			ASSERT_CMP_MSG(w.required(), >=, msgpack.size(), "Should still say how big a buffer it needs");
+		}
+	}
+}
+
+namespace fieldsTest
+{
+	struct position { double lat, lon; };
+	struct tag      { char name[8]; int weight; };
+	struct reading
+	{
+		int                 id;
+		std::string         name;
+		position            where;
+		std::vector<double> samples;
+		int                 window[3];
+		std::vector<tag>    tags;
+		position            bounds[2];
+		bool                ok;
+	};
+	struct empty {};
+
+	MMK_JSON_FIELDS_BEGIN(position)
+		MMK_JSON_FIELD(lat)
+		MMK_JSON_FIELD(lon)
+	MMK_JSON_FIELDS_END()
+
+	MMK_JSON_FIELDS_BEGIN(tag)
+		MMK_JSON_FIELD(name)
+		MMK_JSON_FIELD(weight)
+	MMK_JSON_FIELDS_END()
+
+	MMK_JSON_FIELDS_BEGIN(reading)
+		MMK_JSON_FIELD(id)
+		MMK_JSON_FIELD(name)
+		MMK_JSON_FIELD_AS(where, "position")
+		MMK_JSON_FIELD(samples)
+		MMK_JSON_FIELD(window)
+		MMK_JSON_FIELD(tags)
+		MMK_JSON_FIELD(bounds)
+		MMK_JSON_FIELD(ok)
+	MMK_JSON_FIELDS_END()
+
+	MMK_JSON_FIELDS_BEGIN(empty)
+	MMK_JSON_FIELDS_END()
+
+	reading exampleReading()
+	{
+		reading r;
+		r.id        = 7;
+		r.name      = "north \"gate\"";
+		r.where.lat = 47.5;
+		r.where.lon = -122.25;
+		r.samples.push_back(1.5);
+		r.samples.push_back(2);
+		r.window[0] = 1; r.window[1] = 2; r.window[2] = 3;
+		tag full = { { 'a','b','c','d','e','f','g','h' }, 2 }; // No '\0'
+		tag a    = { "a", 1 };
+		r.tags.push_back(a);
+		r.tags.push_back(full);
+		const position southWest = { 47, -123 }, northEast = { 48, -122 };
+		r.bounds[0] = southWest;
+		r.bounds[1] = northEast;
+		r.ok        = true;
+		return r;
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Struct field lists")
+{
+	MMK_UNIT_TEST("Generated serializers match hand written ones")
+	{
+		const fieldsTest::reading r = fieldsTest::exampleReading();
+
+		MMK_JSON_WRITER_ROOT_OBJECT(expected, 1024)
+		{
+			expected("id", r.id);
+			expected("name", r.name);
+			MMK_JSON_WRITER_OBJECT_OBJECT(expected, "position") { expected("lat", r.where.lat); expected("lon", r.where.lon); }
+			expected.array("samples", r.samples);
+			expected.array("window", r.window);
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "tags")
+			{
+				MMK_JSON_WRITER_ARRAY_OBJECT(expected) { expected("name", "a"); expected("weight", 1); }
+				MMK_JSON_WRITER_ARRAY_OBJECT(expected) { expected("name", "abcdefgh"); expected("weight", 2); }
+			}
+			MMK_JSON_WRITER_OBJECT_ARRAY(expected, "bounds")
+			{
+				MMK_JSON_WRITER_ARRAY_OBJECT(expected) { expected("lat", 47); expected("lon", -123); }
+				MMK_JSON_WRITER_ARRAY_OBJECT(expected) { expected("lat", 48); expected("lon", -122); }
+			}
+			expected("ok", r.ok);
+		}
+
+		MMK_JSON_WRITER_ROOT_OBJECT(generated, 1024) { writeJsonFields(generated, r); }
+		ASSERT_CMP(std::string(generated.c_str()), ==, expected.c_str());
+	}
+
+	MMK_UNIT_TEST("Nesting under keys and in arrays")
+	{
+		const fieldsTest::reading r = fieldsTest::exampleReading();
+		const fieldsTest::empty   e = fieldsTest::empty();
+		const fieldsTest::position p[] = { { 1, 2 }, { 3, 4 } };
+
+		MMK_JSON_WRITER_ROOT_ARRAY(a, 1024)
+		{
+			writeJsonElement(a, p[0]);
+			writeJsonElement(a, e);
+			MMK_JSON_WRITER_ARRAY_OBJECT(a)
+			{
+				writeJsonField(a, "first", p[0]);
+				writeJsonField(a, MMK_JSON_KEY("second"), p[1]);
+				writeJsonField(a, "tags", r.tags);
+			}
+		}
+		ASSERT_CMP(std::string(a.c_str()), ==, "[{\"lat\":1,\"lon\":2},{},{\"first\":{\"lat\":1,\"lon\":2},\"second\":{\"lat\":3,\"lon\":4},\"tags\":[{\"name\":\"a\",\"weight\":1},{\"name\":\"abcdefgh\",\"weight\":2}]}]");
+	}
+}
+
+namespace pullTest
+{
+	struct entry { int id; std::string message; };
+
+	MMK_JSON_FIELDS_BEGIN(entry)
+		MMK_JSON_FIELD(id)
+		MMK_JSON_FIELD(message)
+	MMK_JSON_FIELDS_END()
+
+	struct serverLog
+	{
+		std::string         server;
+		std::vector<entry>  entries;
+		std::vector<int>    none;
+		std::string         big;
+	};
+
+	bool writeNested(mmk::json::pullWriter& p, mmk::json::arrayWriter& nested, void* context, size_t index)
+	{
+		const serverLog& l = *(const serverLog*)context;
+		switch (index)
+		{
+		case 0:  nested(1); return true;
+		case 1:  p.array(nested, l.entries); return true;
+		case 2:  p.array(nested, l.none); return true;
+		case 3:  MMK_JSON_WRITER_ARRAY_ARRAY(nested) { nested(2); nested(3); } return true;
+		default: return false;
+		}
+	}
+
+	bool writeLog(mmk::json::pullWriter& p, mmk::json::objectWriter& log, void* context, size_t index)
+	{
+		const serverLog& l = *(const serverLog*)context;
+		switch (index)
+		{
+		case 0:  log("server", l.server); return true;
+		case 1:  p.array(log, "entries", l.entries); return true;
+		case 2:  MMK_JSON_WRITER_OBJECT_OBJECT(log, "stats") { log("count", (unsigned)l.entries.size()); } return true;
+		case 3:  p.array(log, MMK_JSON_KEY("none"), l.none); return true;
+		case 4:  log("big", l.big); return true;
+		case 5:  p.array(log, "nested", writeNested, context); return true;
+		default: return false;
+		}
+	}
+
+	void writeLogPushed(mmk::json::objectWriter& log, const serverLog& l)
+	{
+		log("server", l.server);
+		MMK_JSON_WRITER_OBJECT_ARRAY(log, "entries") for (size_t i = 0; i < l.entries.size(); ++i) writeJsonElement(log, l.entries[i]);
+		MMK_JSON_WRITER_OBJECT_OBJECT(log, "stats") { log("count", (unsigned)l.entries.size()); }
+		log.array("none", l.none);
+		log("big", l.big);
+		MMK_JSON_WRITER_OBJECT_ARRAY(log, "nested")
+		{
+			log(1);
+			MMK_JSON_WRITER_ARRAY_ARRAY(log) for (size_t i = 0; i < l.entries.size(); ++i) writeJsonElement(log, l.entries[i]);
+			log.array(l.none);
+			MMK_JSON_WRITER_ARRAY_ARRAY(log) { log(2); log(3); }
+		}
+	}
+
+	serverLog exampleLog()
+	{
+		serverLog l;
+		l.server = "eu-1";
+		for (int i = 0; i < 5; ++i)
+		{
+			entry e = { i, std::string(i * 7, 'x') + "\"" };
+			l.entries.push_back(e);
+		}
+		l.big = std::string(300, 'y');
+		return l;
+	}
+
+	std::string pullAll(mmk::json::pullWriter& p, size_t chunkSize)
+	{
+		std::string out;
+		std::vector<char> chunk(chunkSize);
+		while (size_t size = p.pull(&chunk[0], chunkSize))
+		{
+			out.append(&chunk[0], size);
+			if (size != chunkSize && !p.done()) return "short chunk before the end";
+		}
+		return out;
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Pull mode")
+{
+	MMK_UNIT_TEST("Pulling in chunks of any size matches pushing the whole document")
+	{
+		const pullTest::serverLog l = pullTest::exampleLog();
+
+		std::vector<char> buffer;
+		MMK_JSON_WRITER_GROW_OBJECT(expected, buffer, 0) { pullTest::writeLogPushed(expected, l); }
+		const std::string json(expected.c_str(), expected.size());
+		ASSERT(isValidJson(json.c_str()));
+
+		for (size_t chunkSize = 1; chunkSize <= json.size() + 2; ++chunkSize)
+		{
+			mmk::json::pullWriter p(pullTest::writeLog, (void*)&l);
+			const std::string pulled = pullTest::pullAll(p, chunkSize);
+			ASSERT_CMP_FMT(pulled, ==, json, "Pulling %u byte chunks gave %s", (unsigned)chunkSize, pulled.c_str());
+			ASSERT(p.done() && p.ok() && p.depth() == 0);
+		}
+	}
+
+	MMK_UNIT_TEST("Scopes stay open between pulls")
+	{
+		const pullTest::serverLog l = pullTest::exampleLog();
+		mmk::json::pullWriter p(pullTest::writeLog, (void*)&l);
+
+		char chunk[40];
+		ASSERT_CMP(p.pull(chunk, sizeof(chunk)), ==, sizeof(chunk));
+		ASSERT_CMP(std::string(chunk, sizeof(chunk)), ==, "{\"server\":\"eu-1\",\"entries\":[{\"id\":0,\"mes");
+		ASSERT_CMP(p.depth(), ==, 2u);
+		ASSERT(!p.done());
+
+		const std::string rest = pullTest::pullAll(p, 4096);
+		ASSERT_CMP(rest.size(), <, 4096u);
+		ASSERT(isValidJson((std::string(chunk, sizeof(chunk)) + rest).c_str()));
+		ASSERT_CMP(p.pull(chunk, sizeof(chunk)), ==, 0u);
+	}
+
+	MMK_UNIT_TEST("Root arrays and empty documents")
+	{
+		const pullTest::serverLog l = pullTest::exampleLog();
+		mmk::json::pullWriter nested(pullTest::writeNested, (void*)&l);
+		const std::string pulled = pullTest::pullAll(nested, 7);
+		ASSERT(isValidJson(pulled.c_str()));
+		ASSERT_CMP(pulled.substr(0, 9), ==, "[1,[{\"id\"");
+		ASSERT_CMP(pulled.substr(pulled.size() - 13), ==, "\"}],[],[2,3]]");
+
+		mmk::json::pullWriter empty([](mmk::json::pullWriter&, mmk::json::arrayWriter&, void*, size_t) { return false; }, 0);
+		ASSERT_CMP(pullTest::pullAll(empty, 1), ==, "[]");
+	}
+}
+
+namespace skeletonTest
+{
+	struct reading { int id; const char* name; double x, y; bool ok; };
+
+	const reading readings[] =
+	{
+		{ 1, "north",          0.5,  -2,    true  },
+		{ 2, "south \"gate\"",  1e-9, 3.25,  false },
+		{ 3, "east",           -1,   0,     true  },
+	};
+
+	template < typename ObjectWriter > void writeReading(ObjectWriter& o, const reading& r)
+	{
+		o("type", "reading");
+		o(MMK_JSON_KEY("id"), r.id);
+		o("name", r.name);
+		MMK_JSON_WRITER_OBJECT_OBJECT(o, "at") { o("x", r.x); o("y", r.y); }
+		o("ok", r.ok);
+	}
+
+	mmk::json::skeleton readingSkeleton()
+	{
+		std::vector<char> buffer;
+		MMK_JSON_WRITER_GROW_OBJECT(shape, buffer, 0)
+		{
+			shape("type", "reading"); // Constant
+			shape(MMK_JSON_KEY("id"), mmk::json::slot());
+			shape("name", mmk::json::slot());
+			MMK_JSON_WRITER_OBJECT_OBJECT(shape, "at") { shape("x", mmk::json::slot()); shape("y", mmk::json::slot()); }
+			shape("ok", mmk::json::slot());
+		}
+		return mmk::json::skeleton(shape.c_str(), shape.size());
+	}
+
+	template < typename ArrayWriter > void writeRecords(ArrayWriter& a, const mmk::json::skeleton& shape)
+	{
+		for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); ++i) MMK_JSON_WRITER_ARRAY_RECORD(a, shape)
+		{
+			const reading& r = readings[i];
+			a(r.id); a(r.name); a(r.x); a(r.y); a(r.ok);
+		}
+	}
+
+	void collectError(void* context, const char* message) { ((std::vector<std::string>*)context)->push_back(message); }
+}
+
+MMK_UNIT_TEST_CATEGORY("Skeletons")
+{
+	MMK_UNIT_TEST("Records match what the scopes write")
+	{
+		const mmk::json::skeleton shape = skeletonTest::readingSkeleton();
+		ASSERT_CMP(shape.slots(), ==, 5u);
+
+		MMK_JSON_WRITER_ROOT_ARRAY(expected, 1024) for (size_t i = 0; i < 3; ++i) MMK_JSON_WRITER_ARRAY_OBJECT(expected) { skeletonTest::writeReading(expected, skeletonTest::readings[i]); }
+		MMK_JSON_WRITER_ROOT_ARRAY(records, 1024) skeletonTest::writeRecords(records, shape);
+		ASSERT_MSG(!!records, "Writing records shouldn't fail");
+		ASSERT_CMP(std::string(records.c_str()), ==, std::string(expected.c_str()));
+
+		MMK_JSON_WRITER_ROOT_OBJECT(keyed, 1024) MMK_JSON_WRITER_OBJECT_RECORD(keyed, "latest", shape) { keyed(4); keyed("west"); keyed(1); keyed(2); keyed(false); }
+		ASSERT_CMP(std::string(keyed.c_str()), ==, "{\"latest\":{\"type\":\"reading\",\"id\":4,\"name\":\"west\",\"at\":{\"x\":1,\"y\":2},\"ok\":false}}");
+
+		std::string streamed;
+		MMK_JSON_WRITER_STREAM_ARRAY(s, 32, mmk::json::sink(appendToString, &streamed)) skeletonTest::writeRecords(s, shape);
+		ASSERT_CMP(streamed, ==, std::string(expected.c_str()));
+
+		MMK_JSON_WRITER_MEASURE_ARRAY(measured) skeletonTest::writeRecords(measured, shape);
+		ASSERT_CMP(measured.required(), ==, expected.size());
+	}
+
+	MMK_UNIT_TEST("Truncated records are still valid JSON")
+	{
+		const mmk::json::skeleton shape = skeletonTest::readingSkeleton();
+		for (size_t size = 3; size < 300; ++size) // "[]" and the '\0' on up
+		{
+			std::vector<char> buffer(size + 1, '#');
+			mmk::json::writer w(&buffer[0], size, mmk::json::truncateTag());
+			MMK_JSON_WRITER_ARRAY_ARRAY(w) skeletonTest::writeRecords(w, shape);
+			ASSERT_CMP_FMT(buffer[size], ==, '#', "A %u-byte buffer shouldn't be written past", (unsigned)size);
+			ASSERT_CMP_FMT(isValidJson(w.c_str()), ==, true, "Truncating to %u bytes should give valid JSON, not %s", (unsigned)size, w.c_str());
+		}
+	}
+
+	MMK_UNIT_TEST("Unfilled slots are written as null")
+	{
+		const mmk::json::skeleton shape = skeletonTest::readingSkeleton();
+		std::vector<std::string> errors;
+		mmk::json::setErrorHandler(skeletonTest::collectError, &errors);
+		MMK_JSON_WRITER_ROOT_ARRAY(a, 1024) MMK_JSON_WRITER_ARRAY_RECORD(a, shape) { a(7); }
+		mmk::json::setErrorHandler(0);
+
+		ASSERT_CMP(std::string(a.c_str()), ==, "[{\"type\":\"reading\",\"id\":7,\"name\":null,\"at\":{\"x\":null,\"y\":null},\"ok\":null}]");
+		ASSERT_CMP(errors.size(), ==, 1u);
+	}
 }
 
 int main(int argc, char** argv)
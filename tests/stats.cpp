@@ -0,0 +1,124 @@
+/* Copyright 2017 MaulingMonkey
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// The same macros and scopes as main.cpp, instrumented.  Only this file - a real program should define
+// MMK_JSON_WRITER_STATS everywhere or nowhere, like MMK_JSON_WRITER_UNCHECKED.
+#define MMK_JSON_WRITER_STATS
+
+#include <mmk/json/writer.hpp>
+#include <mmk/test/unit.hpp>
+#include <string>
+#include <vector>
+
+namespace
+{
+	bool appendTo(void* context, const char* data, size_t size) { ((std::string*)context)->append(data, size); return true; }
+	void collectError(void* context, const char* message) { ((std::vector<std::string>*)context)->push_back(message); }
+
+	size_t tokenBytes(const mmk::json::stats& s) { return s.keyBytes + s.stringBytes + s.numberBytes + s.structureBytes + s.otherBytes; }
+
+	size_t writeTooMuch(int items)
+	{
+		MMK_JSON_WRITER_ROOT_ARRAY(tooSmall, 8) for (int i = 0; i < items; ++i) tooSmall(i);
+		return tooSmall.required();
+	}
+
+	const mmk::json::callSite* findSite(const std::vector<mmk::json::callSite>& sites, const char* name)
+	{
+		for (size_t i = 0; i < sites.size(); ++i) if (!strcmp(sites[i].name, name)) return &sites[i];
+		return 0;
+	}
+}
+
+MMK_UNIT_TEST_CATEGORY("Stats")
+{
+	MMK_UNIT_TEST("Instrumented writers count bytes by token")
+	{
+		MMK_JSON_WRITER_ROOT_OBJECT(o, 128)
+		{
+			o("id", 7);
+			o(MMK_JSON_KEY("name"), "a\"b");
+			MMK_JSON_WRITER_OBJECT_ARRAY(o, "tags") { o(true); o(1.5); }
+		}
+		ASSERT_MSG(std::string(o.c_str()) == "{\"id\":7,\"name\":\"a\\\"b\",\"tags\":[true,1.5]}", "Instrumenting shouldn't change the output");
+
+		ASSERT_CMP(o_stats.keyBytes,        ==, 21u); // "id": ,"name": ,"tags":
+		ASSERT_CMP(o_stats.stringBytes,     ==, 6u);
+		ASSERT_CMP(o_stats.numberBytes,     ==, 4u);
+		ASSERT_CMP(o_stats.structureBytes,  ==, 5u);
+		ASSERT_CMP(o_stats.otherBytes,      ==, 4u);
+		ASSERT_CMP(tokenBytes(o_stats),     ==, o.size());
+		ASSERT_CMP(o_stats.escapes,         ==, 1u);
+		ASSERT_CMP(o_stats.documents,       ==, 1u);
+		ASSERT_CMP(o_stats.maxDepth,        ==, 2u);
+		ASSERT_CMP(o_stats.depth,           ==, 0u);
+		ASSERT_CMP(o_stats.overflows,       ==, 0u);
+		ASSERT_CMP(o_stats.largestDocument, ==, o.size());
+	}
+
+	MMK_UNIT_TEST("Streamed bytes are counted too")
+	{
+		std::string out;
+		{
+			MMK_JSON_WRITER_STREAM_ARRAY(s, 32, mmk::json::sink(appendTo, &out)) for (int i = 0; i < 100; ++i) s(i);
+			ASSERT_CMP(s_stats.flushedBytes,    ==, out.size());
+			ASSERT_CMP(tokenBytes(s_stats),     ==, out.size());
+			ASSERT_CMP(s_stats.largestDocument, ==, out.size());
+		}
+		ASSERT_CMP(out.size(), >, 32u);
+	}
+
+	MMK_UNIT_TEST("Call sites record overflows and high water marks")
+	{
+		mmk::json::resetStats();
+		const size_t small = writeTooMuch(2); // [0,1] fits
+		const size_t large = writeTooMuch(50);
+
+		const mmk::json::stats process = mmk::json::processStats();
+		ASSERT_CMP(process.documents,   ==, 2u);
+		ASSERT_CMP(process.overflows,   ==, 1u);
+		ASSERT_CMP(process.neededBytes, ==, large);
+
+		const std::vector<mmk::json::callSite> sites = mmk::json::callSiteStats();
+		const mmk::json::callSite* site = findSite(sites, "tooSmall");
+		ASSERT_MSG(site != 0, "writeTooMuch's root should have registered");
+		ASSERT_MSG(!strcmp(site->file, __FILE__), "Call sites should know where they are");
+		ASSERT_CMP(site->bufferSize, ==, 8u);
+		ASSERT_CMP(site->documents,  ==, 2u);
+		ASSERT_CMP(site->overflows,  ==, 1u);
+		ASSERT_CMP(site->highWater,  ==, large);
+		ASSERT_CMP(small,            <,  site->bufferSize);
+
+		mmk::json::resetStats();
+		ASSERT_CMP(mmk::json::processStats().documents, ==, 0u);
+		ASSERT_MSG(findSite(mmk::json::callSiteStats(), "tooSmall") != 0, "Resetting should keep call sites registered");
+	}
+
+	MMK_UNIT_TEST("Errors go to the error handler")
+	{
+		std::vector<std::string> errors;
+		mmk::json::setErrorHandler(collectError, &errors);
+		{
+			MMK_JSON_WRITER_ROOT(w, 64);
+			mmk::json::objectWriter first(w, mmk::json::noKeyTag());
+			mmk::json::objectWriter second(w, mmk::json::noKeyTag()); // Misuse:  the writer is already locked by first
+			ASSERT_CMP(w_stats.errors, ==, 1u);
+		}
+		mmk::json::setErrorHandler(0);
+
+		ASSERT_CMP(errors.size(), ==, 1u);
+		ASSERT_MSG(errors[0] == "objectWriter constructed against already locked writer!", "Should be the scope's message");
+	}
+}